@@ -8,7 +8,8 @@ class DBBenchmark : public benchmark::Fixture {
     if (!initialized.load(std::memory_order_acquire)) {
       std::lock_guard<std::mutex> lock(db_mutex);
       if (!initialized.load(std::memory_order_relaxed)) {
-        db = openDatabaseAndLoadData(numKeys, state.range(0));
+        // durable puts don't need preloaded data, loading it with a sync per put is slow
+        db = syncOnPut ? openDatabase() : openDatabaseAndLoadData(numKeys, state.range(0));
         initialized.store(true, std::memory_order_release);
       }
     }
@@ -27,8 +28,12 @@ class DBBenchmark : public benchmark::Fixture {
 
   std::unique_ptr<bitcask::DB> openDatabase() {
     bitcask::Options options;
-    options.maxFileSize = 64 * 1024 * 1024;  // 64MB max file size
+    options.maxFileSize = maxFileSize;
     options.readOnly = false;
+    options.syncOnPut = syncOnPut;
+    options.writeBufferSize = writeBufferSize;
+    options.mmapReads = mmapReads;
+    options.valueCacheSize = valueCacheSize;
 
     auto dbRet = bitcask::DB::open(DB_PATH, options);
     if (!dbRet.ok()) {
@@ -57,6 +62,45 @@ class DBBenchmark : public benchmark::Fixture {
   std::mutex db_mutex;
   const size_t numKeys = 10000;
   const std::string DB_PATH = "/tmp/bitcask_benchmark";
+  bool syncOnPut = false;
+  size_t writeBufferSize = 0;
+  size_t maxFileSize = 64 * 1024 * 1024;  // 64MB max file size
+  bool mmapReads = false;
+  size_t valueCacheSize = 0;
+};
+
+// Same as DBBenchmark, but appends are coalesced in a 1MB write buffer
+class DBBufferedBenchmark : public DBBenchmark {
+ public:
+  DBBufferedBenchmark() {
+    writeBufferSize = 1024 * 1024;
+  }
+};
+
+// Same as DBBenchmark, but values are read from mapped data files. Files are rolled every 1MB so
+// that almost all values are in rolled out, mapped files.
+class DBMmapBenchmark : public DBBenchmark {
+ public:
+  DBMmapBenchmark() {
+    maxFileSize = 1024 * 1024;
+    mmapReads = true;
+  }
+};
+
+// Same as DBBenchmark, but values are served from a 64MB value cache, which holds all of them
+class DBCachedBenchmark : public DBBenchmark {
+ public:
+  DBCachedBenchmark() {
+    valueCacheSize = 64 * 1024 * 1024;
+  }
+};
+
+// Same as DBBenchmark, but every put is durable
+class DBSyncBenchmark : public DBBenchmark {
+ public:
+  DBSyncBenchmark() {
+    syncOnPut = true;
+  }
 };
 
 // put values
@@ -76,6 +120,38 @@ BENCHMARK_DEFINE_F(DBBenchmark, put)(benchmark::State& state) {
   }
 }
 
+// put values durably. Concurrent writers share syncs via group commit.
+BENCHMARK_DEFINE_F(DBSyncBenchmark, put)(benchmark::State& state) {
+  std::string value = std::string(state.range(0), 'x');
+
+  int64_t iterIndex = 0;
+
+  for (auto _ : state) {
+    bitcask::KeyType key = state.thread_index() * state.iterations() + iterIndex;
+    auto status = db->put(key, value);
+    if (!status.ok()) {
+      state.SkipWithError(status.toString().c_str());
+    }
+    iterIndex++;
+  }
+}
+
+// put values through the write buffer
+BENCHMARK_DEFINE_F(DBBufferedBenchmark, put)(benchmark::State& state) {
+  std::string value = std::string(state.range(0), 'x');
+
+  int64_t iterIndex = 0;
+
+  for (auto _ : state) {
+    bitcask::KeyType key = state.thread_index() * state.iterations() + iterIndex;
+    auto status = db->put(key, value);
+    if (!status.ok()) {
+      state.SkipWithError(status.toString().c_str());
+    }
+    iterIndex++;
+  }
+}
+
 // get values
 BENCHMARK_DEFINE_F(DBBenchmark, get)(benchmark::State& state) {
   int64_t iterIndex = 0;
@@ -89,15 +165,95 @@ BENCHMARK_DEFINE_F(DBBenchmark, get)(benchmark::State& state) {
   }
 }
 
+// get values from mapped files
+BENCHMARK_DEFINE_F(DBMmapBenchmark, get)(benchmark::State& state) {
+  int64_t iterIndex = 0;
+
+  for (auto _ : state) {
+    auto valueRet = db->get(iterIndex % numKeys);
+    if (!valueRet.ok()) {
+      state.SkipWithError(valueRet.status().toString().c_str());
+    }
+    iterIndex++;
+  }
+}
+
+// get values pinned to the mapped files, without copying them
+BENCHMARK_DEFINE_F(DBMmapBenchmark, getPinned)(benchmark::State& state) {
+  int64_t iterIndex = 0;
+  bitcask::PinnableValue value;
+
+  for (auto _ : state) {
+    auto status = db->get(iterIndex % numKeys, &value);
+    if (!status.ok()) {
+      state.SkipWithError(status.toString().c_str());
+    }
+    iterIndex++;
+  }
+}
+
+// get values through the value cache
+BENCHMARK_DEFINE_F(DBCachedBenchmark, get)(benchmark::State& state) {
+  int64_t iterIndex = 0;
+  bitcask::PinnableValue value;
+
+  for (auto _ : state) {
+    auto status = db->get(iterIndex % numKeys, &value);
+    if (!status.ok()) {
+      state.SkipWithError(status.toString().c_str());
+    }
+    iterIndex++;
+  }
+}
+
+// get 100 values at a time
+BENCHMARK_DEFINE_F(DBBenchmark, multiGet)(benchmark::State& state) {
+  const size_t batchSize = 100;
+  std::vector<bitcask::KeyType> keys(batchSize);
+  int64_t iterIndex = 0;
+
+  for (auto _ : state) {
+    for (size_t i = 0; i < batchSize; i++) {
+      // spread over the whole db
+      keys[i] = (iterIndex * batchSize + i * 97) % numKeys;
+    }
+    auto results = db->multiGet(keys);
+    for (const auto& result : results) {
+      if (!result.ok()) {
+        state.SkipWithError(result.status().toString().c_str());
+        break;
+      }
+    }
+    iterIndex++;
+  }
+  state.SetItemsProcessed(state.iterations() * batchSize);
+}
+
 // Test value size from 64B to 4KB
 BENCHMARK_REGISTER_F(DBBenchmark, put)->RangeMultiplier(4)->Range(64, 4096);
 
-// Test 1KB value size with 10 threads
-BENCHMARK_REGISTER_F(DBBenchmark, put)->Arg(1024)->Threads(10);
+// Test 1KB value size from 1 to 16 threads, writing to the active file in parallel
+BENCHMARK_REGISTER_F(DBBenchmark, put)->Arg(1024)->ThreadRange(1, 16)->UseRealTime();
+
+// Test durable puts of 1KB value size from 1 to 16 threads
+BENCHMARK_REGISTER_F(DBSyncBenchmark, put)->Arg(1024)->ThreadRange(1, 16)->UseRealTime();
+
+// Test buffered puts of value size from 64B to 4KB
+BENCHMARK_REGISTER_F(DBBufferedBenchmark, put)->RangeMultiplier(4)->Range(64, 4096);
 
 // Test value size from 64B to 4KB
 BENCHMARK_REGISTER_F(DBBenchmark, get)->RangeMultiplier(4)->Range(64, 4096);
 
+// Test batches of 100 gets of value size from 64B to 4KB
+BENCHMARK_REGISTER_F(DBBenchmark, multiGet)->RangeMultiplier(4)->Range(64, 4096);
+
+// Test reads from mapped files of value size from 64B to 4KB
+BENCHMARK_REGISTER_F(DBMmapBenchmark, get)->RangeMultiplier(4)->Range(64, 4096);
+BENCHMARK_REGISTER_F(DBMmapBenchmark, getPinned)->RangeMultiplier(4)->Range(64, 4096);
+
+// Test cached reads of value size from 64B to 4KB
+BENCHMARK_REGISTER_F(DBCachedBenchmark, get)->RangeMultiplier(4)->Range(64, 4096);
+
 // // Test 1KB value size with 10 threads
 BENCHMARK_REGISTER_F(DBBenchmark, get)->Arg(1024)->Threads(10);
 
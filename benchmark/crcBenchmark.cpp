@@ -0,0 +1,35 @@
+#include <benchmark/benchmark.h>
+
+#include "utils/Crc.h"
+
+namespace {
+
+std::string makeData(size_t size) {
+  std::string data(size, '\0');
+  for (size_t i = 0; i < size; i++) {
+    data[i] = static_cast<char>(i * 31 + 7);
+  }
+  return data;
+}
+
+template <uint32_t (*Extend)(uint32_t, const char*, size_t)>
+void BM_Crc(benchmark::State& state) {
+  auto data = makeData(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Extend(0, data.data(), data.size()));
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+
+}  // namespace
+
+// The bitwise CRC-32 of the records written before CRC32C
+BENCHMARK_TEMPLATE(BM_Crc, bitcask::crc::extend)->RangeMultiplier(4)->Range(16, 4096);
+
+// CRC32C with the implementation picked at runtime
+BENCHMARK_TEMPLATE(BM_Crc, bitcask::crc::extend32c)->RangeMultiplier(4)->Range(16, 4096);
+
+// CRC32C with slicing-by-8 tables, the fallback without SSE4.2
+BENCHMARK_TEMPLATE(BM_Crc, bitcask::crc::extend32cSlicing8)->RangeMultiplier(4)->Range(16, 4096);
+
+BENCHMARK_MAIN();
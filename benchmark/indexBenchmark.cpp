@@ -0,0 +1,128 @@
+#include <benchmark/benchmark.h>
+
+#include "db/FlatIndex.h"
+#include "db/HashIndex.h"
+#include "db/ShardedIndex.h"
+
+namespace {
+
+const bitcask::KeyType kNumKeys = 1000000;
+
+// One index of each type is shared by all threads of a benchmark, and loaded with kNumKeys keys
+template <typename IndexT>
+class IndexBenchmark : public benchmark::Fixture {
+ public:
+  void SetUp(const ::benchmark::State& /* state */) override {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!index) {
+      index = std::make_unique<IndexT>(kNumKeys);
+      for (bitcask::KeyType key = 0; key < kNumKeys; key++) {
+        index->put(key, std::make_shared<bitcask::LogPos>(1, 100, key * 128, 0));
+      }
+    }
+  }
+
+  void TearDown(const ::benchmark::State& state) override {
+    if (state.thread_index() == 0) {
+      std::lock_guard<std::mutex> lock(mutex);
+      index.reset();
+    }
+  }
+
+  // Keys spread over the index, different for each thread
+  static bitcask::KeyType nextKey(uint64_t* seed) {
+    *seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return static_cast<bitcask::KeyType>((*seed >> 33) % kNumKeys);
+  }
+
+  void getKeys(benchmark::State& state) {
+    uint64_t seed = state.thread_index() + 1;
+    for (auto _ : state) {
+      benchmark::DoNotOptimize(index->get(nextKey(&seed)));
+    }
+    state.SetItemsProcessed(state.iterations());
+  }
+
+  void putKeys(benchmark::State& state) {
+    uint64_t seed = state.thread_index() + 1;
+    auto logPos = std::make_shared<bitcask::LogPos>(2, 100, 0, 0);
+    for (auto _ : state) {
+      index->put(nextKey(&seed), logPos);
+    }
+    state.SetItemsProcessed(state.iterations());
+  }
+
+  // One put for every 9 gets
+  void mixKeys(benchmark::State& state) {
+    uint64_t seed = state.thread_index() + 1;
+    auto logPos = std::make_shared<bitcask::LogPos>(2, 100, 0, 0);
+    uint64_t i = 0;
+    for (auto _ : state) {
+      auto key = nextKey(&seed);
+      if (++i % 10 == 0) {
+        index->put(key, logPos);
+      } else {
+        benchmark::DoNotOptimize(index->get(key));
+      }
+    }
+    state.SetItemsProcessed(state.iterations());
+  }
+
+  std::unique_ptr<bitcask::Index> index;
+  std::mutex mutex;
+};
+
+class HashIndexBenchmark : public IndexBenchmark<bitcask::HashIndex> {};
+class FlatIndexBenchmark : public IndexBenchmark<bitcask::FlatIndex> {};
+class ShardedIndexBenchmark : public IndexBenchmark<bitcask::ShardedIndex> {};
+
+}  // namespace
+
+BENCHMARK_DEFINE_F(HashIndexBenchmark, get)(benchmark::State& state) {
+  getKeys(state);
+}
+
+BENCHMARK_DEFINE_F(HashIndexBenchmark, put)(benchmark::State& state) {
+  putKeys(state);
+}
+
+BENCHMARK_DEFINE_F(HashIndexBenchmark, mix)(benchmark::State& state) {
+  mixKeys(state);
+}
+
+BENCHMARK_DEFINE_F(FlatIndexBenchmark, get)(benchmark::State& state) {
+  getKeys(state);
+}
+
+BENCHMARK_DEFINE_F(FlatIndexBenchmark, put)(benchmark::State& state) {
+  putKeys(state);
+}
+
+BENCHMARK_DEFINE_F(FlatIndexBenchmark, mix)(benchmark::State& state) {
+  mixKeys(state);
+}
+
+BENCHMARK_DEFINE_F(ShardedIndexBenchmark, get)(benchmark::State& state) {
+  getKeys(state);
+}
+
+BENCHMARK_DEFINE_F(ShardedIndexBenchmark, put)(benchmark::State& state) {
+  putKeys(state);
+}
+
+BENCHMARK_DEFINE_F(ShardedIndexBenchmark, mix)(benchmark::State& state) {
+  mixKeys(state);
+}
+
+// Scaling of gets, puts and a mix of both from 1 to 64 threads
+BENCHMARK_REGISTER_F(HashIndexBenchmark, get)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK_REGISTER_F(HashIndexBenchmark, put)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK_REGISTER_F(HashIndexBenchmark, mix)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK_REGISTER_F(FlatIndexBenchmark, get)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK_REGISTER_F(FlatIndexBenchmark, put)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK_REGISTER_F(FlatIndexBenchmark, mix)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK_REGISTER_F(ShardedIndexBenchmark, get)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK_REGISTER_F(ShardedIndexBenchmark, put)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK_REGISTER_F(ShardedIndexBenchmark, mix)->ThreadRange(1, 64)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,135 @@
+#include <benchmark/benchmark.h>
+
+#include "bitcask/DB.h"
+#include "db/DBImpl.h"
+
+namespace {
+
+const std::string kDBPath = "/tmp/bitcask_startup_benchmark";
+const size_t kNumKeys = 1000000;
+const size_t kValueSize = 100;
+// About 30 data files
+const size_t kMaxFileSize = 4 * 1024 * 1024;
+
+// Create the db once for all benchmarks
+bool createDB() {
+  static bool created = [] {
+    std::filesystem::remove_all(kDBPath);
+    bitcask::Options options;
+    options.maxFileSize = kMaxFileSize;
+    auto ret = bitcask::DB::open(kDBPath, options);
+    if (!ret.ok()) {
+      LOG(ERROR) << ret.status();
+      return false;
+    }
+    auto db = std::move(ret).value();
+    std::string value(kValueSize, 'x');
+    for (size_t i = 0; i < kNumKeys; i++) {
+      auto status = db->put(static_cast<bitcask::KeyType>(i), value);
+      if (!status.ok()) {
+        LOG(ERROR) << status;
+        return false;
+      }
+    }
+    return db->close().ok();
+  }();
+  return created;
+}
+
+void removeHintFiles() {
+  for (const auto& entry : std::filesystem::directory_iterator(kDBPath)) {
+    if (entry.path().extension() == ".hint") {
+      std::filesystem::remove(entry.path());
+    }
+  }
+}
+
+bitcask::StatusOr<std::unique_ptr<bitcask::DB>> openDB(bool readOnly) {
+  bitcask::Options options;
+  options.maxFileSize = kMaxFileSize;
+  options.readOnly = readOnly;
+  return bitcask::DB::open(kDBPath, options);
+}
+
+// Open the db with state.range(0) threads loading the data files, from their hint files if
+// state.range(1), or by scanning them otherwise. The db is opened read only, so that the hint
+// files are not written by the open. The speedup is over a single thread.
+void BM_Open(benchmark::State& state) {
+  static double singleThreadSeconds[2] = {0, 0};
+  if (!createDB()) {
+    state.SkipWithError("Failed to create the db");
+    return;
+  }
+  FLAGS_index_snapshot = false;
+  FLAGS_index_load_threads = state.range(0);
+  bool hinted = state.range(1);
+  removeHintFiles();
+  if (hinted) {
+    // The hint files are written by a read write open
+    auto ret = openDB(false);
+    if (!ret.ok() || !ret.value()->close().ok()) {
+      state.SkipWithError("Failed to write the hint files");
+      return;
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (auto _ : state) {
+    auto ret = openDB(true);
+    if (!ret.ok()) {
+      state.SkipWithError(ret.status().toString().c_str());
+      break;
+    }
+    ret.value()->close();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  auto seconds = elapsed.count() / state.iterations();
+  if (state.range(0) == 1) {
+    singleThreadSeconds[hinted] = seconds;
+  }
+  if (singleThreadSeconds[hinted] > 0) {
+    state.counters["speedup"] = singleThreadSeconds[hinted] / seconds;
+  }
+  state.counters["keys"] =
+      benchmark::Counter(kNumKeys * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+// Open the db from the index snapshot written by the last close
+void BM_OpenSnapshot(benchmark::State& state) {
+  if (!createDB()) {
+    state.SkipWithError("Failed to create the db");
+    return;
+  }
+  FLAGS_index_snapshot = true;
+  {
+    // The snapshot is written by a read write close
+    auto ret = openDB(false);
+    if (!ret.ok() || !ret.value()->close().ok()) {
+      state.SkipWithError("Failed to write the index snapshot");
+      return;
+    }
+  }
+
+  for (auto _ : state) {
+    auto ret = openDB(true);
+    if (!ret.ok()) {
+      state.SkipWithError(ret.status().toString().c_str());
+      break;
+    }
+    ret.value()->close();
+  }
+  state.counters["keys"] =
+      benchmark::Counter(kNumKeys * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+}  // namespace
+
+BENCHMARK(BM_Open)
+    ->ArgsProduct({{1, 2, 4, 8, 16, 32}, {0, 1}})
+    ->ArgNames({"threads", "hinted"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK(BM_OpenSnapshot)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
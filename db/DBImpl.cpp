@@ -1,17 +1,44 @@
 #include "db/DBImpl.h"
 
+#include "db/DBIterator.h"
+#include "db/DataFileScanner.h"
+#include "db/FlatIndex.h"
 #include "db/HashIndex.h"
+#include "db/OrderedIndex.h"
+#include "db/ShardedIndex.h"
+#include "utils/Crc.h"
 #include "utils/Helper.h"
+#include "utils/WallClock.h"
 
 DEFINE_uint64(max_value_size,
               4096,
               "Max length for the value string. The max of this value is 65535");
 DEFINE_uint64(initial_index_size, 1024 * 1024, "The intial size of index");
+DEFINE_uint64(group_commit_max_bytes,
+              1024 * 1024,
+              "Max bytes of log records a group commit leader writes and syncs at once");
+DEFINE_uint64(multiget_merge_gap,
+              4096,
+              "Max bytes between two records of a multiGet to read both with a single read");
+DEFINE_uint32(index_load_threads,
+              0,
+              "Number of threads loading the data files in parallel to construct the index on "
+              "open. 0 means one per hardware thread");
+DEFINE_bool(index_snapshot,
+            true,
+            "Write a snapshot of the index on close, and load the index from it on open");
+DEFINE_uint32(merge_check_interval_ms,
+              1000,
+              "Interval between two checks for data files to merge automatically");
 
 namespace bitcask {
 
 DBImpl::DBImpl(const std::string& dbname, const Options& options)
-    : options_(options), dbname_(dbname) {}
+    : options_(options),
+      dbname_(dbname),
+      syncPolicy_(options.syncOnPut ? SyncPolicy::kPerWrite : options.syncPolicy),
+      concurrentAppends_(syncPolicy_ != SyncPolicy::kPerWrite && options.writeBufferSize == 0 &&
+                         !options.useDirectIO) {}
 
 DBImpl::~DBImpl() {
   close();
@@ -26,6 +53,11 @@ StatusOr<std::unique_ptr<DB>> DB::open(const std::string& dbname, const Options&
     FLOG_INFO("Trying to open db in rw mode...");
   }
 
+  if (options.indexType == IndexType::kFlat && options.maxFileSize > FlatIndex::kMaxFileSize) {
+    FLOG_ERROR("Max file size {} is over the limit of the flat index", options.maxFileSize);
+    return Status::ERROR(Status::Code::kOverLimit, "Max file size over limit of the index");
+  }
+
   if (!directoryExists(dbname)) {
     if (!createDirectory(dbname)) {
       FLOG_ERROR("Failed to create db path {}: {}", dbname, std::string(strerror(errno)));
@@ -34,6 +66,13 @@ StatusOr<std::unique_ptr<DB>> DB::open(const std::string& dbname, const Options&
   }
 
   auto dbImpl = std::make_unique<DBImpl>(dbname, options);
+  if (options.valueCacheSize > 0) {
+    dbImpl->valueCache_ = std::make_unique<ValueCache>(options.valueCacheSize);
+  }
+  if (options.backgroundIORate > 0) {
+    dbImpl->rateLimiter_ = std::make_unique<RateLimiter>(
+        static_cast<int64_t>(options.backgroundIORate), options.autoTuneBackgroundIO);
+  }
 
   // Try to lock the lock file. Is it's already acquired by another process, refuse to open.
   if (!options.readOnly) {
@@ -62,26 +101,186 @@ StatusOr<std::unique_ptr<DB>> DB::open(const std::string& dbname, const Options&
     return status;
   }
 
+  // What's in the data files on open is taken as durable
+  dbImpl->durablePosition_ = dbImpl->endPosition();
+
+  dbImpl->startBackgroundThread();
+  dbImpl->startMergeThread();
+  dbImpl->opened_ = true;
+
   return dbImpl;
 }
 
 // Retrieve a value by key from a Bitcask datastore
 StatusOr<std::string> DBImpl::get(const KeyType& key) {
-  // search the index
-  auto ret = index_->get(key);
-  if (!ret.ok()) {
-    return ret.status();
+  std::string value;
+  auto status = get(key, &value);
+  if (!status.ok()) {
+    return status;
   }
+  return value;
+}
+
+Status DBImpl::get(const KeyType& key, PinnableValue* value) {
+  return getValue(key, value);
+}
 
-  auto logPos = std::move(ret).value();
-  // read from disk
-  auto valueRet = getValueByLogPos(std::move(logPos));
+Status DBImpl::get(const KeyType& key, std::string* value) {
+  return getValue(key, value);
+}
+
+std::vector<StatusOr<std::string>> DBImpl::multiGet(const std::vector<KeyType>& keys) {
+  return readValues(keys, index_->multiGet(keys));
+}
 
-  if (!valueRet.ok()) {
-    return valueRet.status();
+std::vector<StatusOr<std::string>> DBImpl::readValues(
+    const std::vector<KeyType>& keys,
+    std::vector<StatusOr<std::shared_ptr<LogPos>>> logPoses) {
+  auto results = readValues(logPoses);
+  while (true) {
+    // The keys whose data file is gone, and their new locations
+    std::vector<size_t> retries;
+    std::vector<KeyType> retryKeys;
+    for (size_t i = 0; i < results.size(); i++) {
+      if (!results[i].ok() && results[i].status().code() == Status::Code::kNoSuchFile) {
+        retries.emplace_back(i);
+        retryKeys.emplace_back(keys[i]);
+      }
+    }
+    if (retries.empty()) {
+      return results;
+    }
+    auto newLogPoses = index_->multiGet(retryKeys);
+    std::vector<StatusOr<std::shared_ptr<LogPos>>> retryLogPoses;
+    std::vector<size_t> moved;
+    for (size_t j = 0; j < retries.size(); j++) {
+      auto i = retries[j];
+      // A key which hasn't moved is really missing its data file
+      if (newLogPoses[j].ok() && logPoses[i].ok() &&
+          newLogPoses[j].value()->sameRecord(*logPoses[i].value())) {
+        continue;
+      }
+      logPoses[i] = newLogPoses[j];
+      retryLogPoses.emplace_back(newLogPoses[j]);
+      moved.emplace_back(i);
+    }
+    if (moved.empty()) {
+      return results;
+    }
+    auto values = readValues(retryLogPoses);
+    for (size_t j = 0; j < moved.size(); j++) {
+      results[moved[j]] = std::move(values[j]);
+    }
   }
+}
+
+std::vector<StatusOr<std::string>> DBImpl::readValues(
+    const std::vector<StatusOr<std::shared_ptr<LogPos>>>& logPoses) {
+  std::vector<StatusOr<std::string>> results(logPoses.size());
 
-  return std::move(valueRet).value();
+  // The records to read, in file order
+  std::vector<size_t> toRead;
+  toRead.reserve(logPoses.size());
+  for (size_t i = 0; i < logPoses.size(); i++) {
+    if (!logPoses[i].ok()) {
+      results[i] = logPoses[i].status();
+      continue;
+    }
+    const auto& logPos = *logPoses[i].value();
+    if (valueCache_) {
+      if (auto cached = valueCache_->lookup({logPos.fileId_, logPos.pos_})) {
+        results[i] = *cached;
+        continue;
+      }
+    }
+    toRead.emplace_back(i);
+  }
+  if (toRead.empty()) {
+    return results;
+  }
+  auto recordSize = [](const LogPos& logPos) {
+    return static_cast<FileOffset>(kLogHeaderAndKeySize + logPos.valueSize_);
+  };
+  std::sort(toRead.begin(), toRead.end(), [&](size_t lhs, size_t rhs) {
+    const auto& l = *logPoses[lhs].value();
+    const auto& r = *logPoses[rhs].value();
+    return l.fileId_ < r.fileId_ || (l.fileId_ == r.fileId_ && l.pos_ < r.pos_);
+  });
+
+  // Merge the records of a file not further than FLAGS_multiget_merge_gap apart into one range
+  struct ReadRange {
+    FileID fileId_;
+    FileOffset start_;
+    FileOffset end_;
+    // records of the range in toRead
+    size_t first_;
+    size_t last_;
+    std::unique_ptr<char[]> buf_;
+    Status status_;
+  };
+  std::vector<ReadRange> ranges;
+  for (size_t j = 0; j < toRead.size(); j++) {
+    const auto& logPos = *logPoses[toRead[j]].value();
+    auto end = logPos.pos_ + recordSize(logPos);
+    if (!ranges.empty() && ranges.back().fileId_ == logPos.fileId_ &&
+        logPos.pos_ <= ranges.back().end_ + static_cast<FileOffset>(FLAGS_multiget_merge_gap)) {
+      ranges.back().end_ = std::max(ranges.back().end_, end);
+      ranges.back().last_ = j;
+    } else {
+      ranges.push_back({logPos.fileId_, logPos.pos_, end, j, j, nullptr, Status::OK()});
+    }
+  }
+
+  {
+    // Stay a reader of the file table until all reads are done, so that no data file is closed
+    // meanwhile
+    VersionedFileTable::Reader files(fileTable_);
+    std::vector<IOBackend::ReadRequest> requests;
+    std::vector<ReadRange*> deferredRanges;
+    for (auto& range : ranges) {
+      auto* dataFile = files->find(range.fileId_);
+      if (!dataFile) {
+        // It may have been merged away since the lookup
+        FVLOG1("Data file not found: {}", range.fileId_);
+        range.status_ = Status::ERROR(Status::Code::kNoSuchFile, "data file not found.");
+        continue;
+      }
+      auto size = range.end_ - range.start_;
+      range.buf_ = std::make_unique<char[]>(size);
+      auto numRequests = requests.size();
+      range.status_ = dataFile->readOrDefer(range.start_, size, range.buf_.get(), &requests);
+      if (requests.size() > numRequests) {
+        deferredRanges.emplace_back(&range);
+      }
+    }
+    IOBackend::get(options_.ioBackend)->readBatch(requests);
+    for (size_t k = 0; k < requests.size(); k++) {
+      deferredRanges[k]->status_ = requests[k].status_;
+    }
+  }
+
+  for (const auto& range : ranges) {
+    for (auto j = range.first_; j <= range.last_; j++) {
+      auto i = toRead[j];
+      if (!range.status_.ok()) {
+        results[i] = range.status_;
+        continue;
+      }
+      const auto& logPos = *logPoses[i].value();
+      const char* record = range.buf_.get() + (logPos.pos_ - range.start_);
+      auto status = DataFile::verifyRecord(record, logPos.valueSize_);
+      if (!status.ok()) {
+        results[i] = status;
+        continue;
+      }
+      std::string value(record + kLogHeaderAndKeySize, logPos.valueSize_);
+      if (valueCache_) {
+        valueCache_->insert({logPos.fileId_, logPos.pos_}, std::make_shared<std::string>(value));
+      }
+      results[i] = std::move(value);
+    }
+  }
+  return results;
 }
 
 // Store a key and value in a Bitcask datastore.
@@ -98,27 +297,22 @@ Status DBImpl::put(const KeyType& key, const std::string& value) {
 
   // TODO: Write to WAL
 
+  std::lock_guard<std::mutex> keyLock(keyLocks_[keyStripe(key)]);
   // Write to file first. In case of failure, we can reconstruct index from file.
-  auto logRecord = std::make_unique<LogRecord>(key, value, LogType::WRITE);
-  auto valueSize = logRecord->getValueSize();
-  auto tstamp = logRecord->getTimeStamp();
-  auto ret = appendLogRecord(std::move(logRecord));
+  auto ret = appendRecord(key, value, LogType::WRITE);
   if (!ret.ok()) {
     return ret.status();
   }
 
-  auto offset = std::move(ret).value();
-
   // Update index
-  auto logPos = std::make_shared<LogPos>(
-      activeFileId_, std::move(valueSize), std::move(offset), std::move(tstamp));
-  index_->put(key, logPos);
+  index_->put(key, std::move(ret).value());
 
   return Status::OK();
 }
 
 // Delete a key from a Bitcask datastore
 Status DBImpl::deleteKey(const KeyType& key) {
+  std::lock_guard<std::mutex> keyLock(keyLocks_[keyStripe(key)]);
   // check if key exists
   auto ret = index_->get(key);
   if (!ret.ok()) {
@@ -127,9 +321,8 @@ Status DBImpl::deleteKey(const KeyType& key) {
 
   // TODO: Write to WAL
 
-  // Construct log record
-  auto logRecord = std::make_unique<LogRecord>(key, "", LogType::DELETE);
-  auto appendRet = appendLogRecord(std::move(logRecord));
+  // Append a tombstone
+  auto appendRet = appendRecord(key, "", LogType::DELETE);
   if (!appendRet.ok()) {
     return appendRet.status();
   }
@@ -140,6 +333,96 @@ Status DBImpl::deleteKey(const KeyType& key) {
   return Status::OK();
 }
 
+// Apply all updates in the batch atomically.
+// The batch is encoded into one buffer: a BATCH log record carrying the size and crc of the batch,
+// followed by the log records of all updates. It's appended with a single write, and then all index
+// updates are applied at once.
+Status DBImpl::write(const WriteBatch& batch) {
+  if (UNLIKELY(options_.readOnly)) {
+    return Status::ERROR(Status::Code::kNotAllowed, "write is not allowd in read only mode");
+  }
+  if (batch.count() == 0) {
+    return Status::OK();
+  }
+
+  size_t batchSize = 0;
+  for (const auto& op : batch.ops_) {
+    if (!checkValue(op.value_)) {
+      FLOG_ERROR("Value size over limit. Please check FLAGS_max_value_size");
+      return Status::ERROR(Status::Code::kOverLimit, "Value size over limit.");
+    }
+    batchSize += kLogHeaderSize + sizeof(KeyType) + op.value_.size();
+  }
+  size_t headerSize = kLogHeaderSize + sizeof(KeyType) + kBatchValueSize;
+  if (headerSize + batchSize > options_.maxFileSize ||
+      batchSize > std::numeric_limits<uint32_t>::max()) {
+    FLOG_ERROR("Batch of {} bytes does not fit in a data file", headerSize + batchSize);
+    return Status::ERROR(Status::Code::kOverLimit, "Batch size over limit.");
+  }
+
+  // Encode all records after the batch header, then the batch header covering them.
+  auto buf = std::make_unique<char[]>(headerSize + batchSize);
+  auto tstamp = time::WallClock::fastNowInMicroSec();
+  size_t offset = headerSize;
+  for (const auto& op : batch.ops_) {
+    auto logType = op.type_ == WriteBatch::OpType::kPut ? LogType::WRITE : LogType::DELETE;
+    offset += LogRecord::encodeTo(buf.get() + offset,
+                                  op.key_,
+                                  op.value_.data(),
+                                  static_cast<uint16_t>(op.value_.size()),
+                                  logType,
+                                  tstamp);
+  }
+  char batchValue[kBatchValueSize];
+  uint32_t size32 = static_cast<uint32_t>(batchSize);
+  uint32_t batchCrc = crc::crc32c(buf.get() + headerSize, batchSize);
+  std::memcpy(batchValue, &size32, sizeof(size32));
+  std::memcpy(batchValue + sizeof(size32), &batchCrc, sizeof(batchCrc));
+  LogRecord::encodeTo(buf.get(),
+                      static_cast<KeyType>(batch.count()),
+                      batchValue,
+                      kBatchValueSize,
+                      LogType::BATCH,
+                      tstamp);
+
+  // Lock the stripes of all keys, in stripe order to not deadlock with other batches
+  std::vector<size_t> stripes;
+  stripes.reserve(batch.count());
+  for (const auto& op : batch.ops_) {
+    stripes.emplace_back(keyStripe(op.key_));
+  }
+  std::sort(stripes.begin(), stripes.end());
+  stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+  std::vector<std::unique_lock<std::mutex>> keyLocks;
+  keyLocks.reserve(stripes.size());
+  for (auto stripe : stripes) {
+    keyLocks.emplace_back(keyLocks_[stripe]);
+  }
+
+  struct iovec iov = {buf.get(), headerSize + batchSize};
+  auto ret = appendBuffers(&iov, 1);
+  if (!ret.ok()) {
+    return ret.status();
+  }
+  auto [fileId, pos] = std::move(ret).value();
+
+  // Update index
+  std::vector<std::pair<KeyType, std::shared_ptr<LogPos>>> updates;
+  updates.reserve(batch.count());
+  pos += headerSize;
+  for (const auto& op : batch.ops_) {
+    if (op.type_ == WriteBatch::OpType::kPut) {
+      updates.emplace_back(
+          op.key_,
+          std::make_shared<LogPos>(fileId, static_cast<uint16_t>(op.value_.size()), pos, tstamp));
+    } else {
+      updates.emplace_back(op.key_, nullptr);
+    }
+    pos += kLogHeaderSize + sizeof(KeyType) + op.value_.size();
+  }
+  return index_->batchUpdate(updates);
+}
+
 // List all keys in a Bitcask datastore
 StatusOr<std::vector<KeyType>> DBImpl::listKeys() {
   auto ret = index_->listKeys();
@@ -152,18 +435,66 @@ StatusOr<std::vector<KeyType>> DBImpl::listKeys() {
 // merge the datafiles in the db
 Status DBImpl::merge(const std::string& name) {
   UNUSED(name);
-  return Status::OK();
+  if (UNLIKELY(options_.readOnly)) {
+    return Status::ERROR(Status::Code::kNotAllowed, "merge is not allowd in read only mode");
+  }
+  std::unique_lock<std::mutex> lock(mergeMutex_);
+  if (!mergeRunning_) {
+    return Status::ERROR(Status::Code::kNotAllowed, "db is closed");
+  }
+  auto request = ++mergesRequested_;
+  mergeCv_.notify_all();
+  mergeDoneCv_.wait(lock, [&] { return mergesDone_ >= request || !mergeRunning_; });
+  if (mergesDone_ < request) {
+    return Status::ERROR(Status::Code::kError, "db closed before the merge was done");
+  }
+  return mergeStatus_;
 }
 
 // Force any writes to sync to disk
 Status DBImpl::sync() {
-  // Sync active data file
-  return activeFile_->flush();
+  return syncFiles();
+}
+
+WritePosition DBImpl::writtenPosition() const {
+  std::shared_lock<std::shared_mutex> fileLock(mutex_);
+  return endPosition();
+}
+
+WritePosition DBImpl::endPosition() const {
+  return {activeFileId_, activeFile_->getCurrentFileSize()};
+}
+
+WritePosition DBImpl::durablePosition() const {
+  std::lock_guard<std::mutex> lock(durableMutex_);
+  return durablePosition_;
+}
+
+Stats DBImpl::stats() const {
+  Stats stats;
+  if (valueCache_) {
+    stats.cacheHits = valueCache_->hits();
+    stats.cacheMisses = valueCache_->misses();
+    stats.cacheUsage = valueCache_->usage();
+    stats.cacheCapacity = valueCache_->capacity();
+  }
+  stats.dataFiles = space_.stats();
+  stats.merges = merges_;
+  if (rateLimiter_) {
+    stats.ioThrottledMicros = rateLimiter_->throttledMicros();
+    stats.backgroundIORate = static_cast<uint64_t>(rateLimiter_->bytesPerSecond());
+  }
+  return stats;
 }
 
 // Close a Bitcask data store and flush all pending writes (if any) to disk.
 Status DBImpl::close() {
+  stopMergeThread();
+  stopBackgroundThread();
   sync();
+  if (opened_.exchange(false) && FLAGS_index_snapshot && !options_.readOnly) {
+    writeIndexSnapshot();
+  }
   if (fileLock_) {
     fileLock_->unlock();
   }
@@ -201,15 +532,14 @@ Status DBImpl::openAllDataFiles() {
 
     for (const auto& fileId : allFileIds_) {
       if (fileId != activeFileId_) {
-        auto oldFile = std::make_unique<DataFile>(dbname_, fileId, true);
+        auto oldFile = newDataFile(fileId, true);
         auto status = oldFile->openDataFile();
         if (!status.ok()) {
           return status;
         }
         oldDataFiles_.emplace(fileId, std::move(oldFile));
       } else {
-        activeFile_ = std::make_unique<DataFile>(dbname_, activeFileId_, options_.readOnly);
-        auto status = activeFile_->openDataFile();
+        auto status = openActiveFile();
         if (!status.ok()) {
           return status;
         }
@@ -226,132 +556,1353 @@ Status DBImpl::openAllDataFiles() {
       activeFileId_ = 1;
       allFileIds_.emplace_back(activeFileId_);
 
-      activeFile_ = std::make_unique<DataFile>(dbname_, activeFileId_);
-      auto status = activeFile_->openDataFile();
+      auto status = openActiveFile();
       if (!status.ok()) {
         return status;
       }
     }
   }
 
+  publishFileTable();
   return Status::OK();
 }
 
 Status DBImpl::constructIndex() {
-  index_ = std::make_unique<HashIndex>(FLAGS_initial_index_size);
+  index_ = newIndex();
+  // All bytes of the data files are dead until the index is loaded
+  index_->setSpaceTracker(&space_);
+  for (auto fileId : allFileIds_) {
+    auto* file = fileId == activeFileId_ ? activeFile_.get() : oldDataFiles_.at(fileId).get();
+    struct stat st;
+    int64_t mtimeMs = 0;
+    if (stat(fmt::format("{}/{}.data", dbname_, fileId).c_str(), &st) == 0) {
+      mtimeMs = static_cast<int64_t>(st.st_mtime) * 1000;
+    }
+    space_.addFile(fileId, file->getCurrentFileSize(), mtimeMs);
+  }
 
-  for (const auto& fileId : allFileIds_) {
-    DataFile* curDatafile{nullptr};
-    if (fileId == activeFileId_) {
-      curDatafile = activeFile_.get();
-    } else {
-      if (oldDataFiles_.find(fileId) == oldDataFiles_.end()) {
-        FLOG_ERROR("Data file not found: {}", fileId);
-        return Status::ERROR(Status::Code::kNoSuchFile, "data file not found.");
-      }
-      curDatafile = oldDataFiles_.at(fileId).get();
+  // The first data file, and the offset in it, from which the records are loaded
+  size_t firstLoad = 0;
+  FileOffset start = 0;
+  if (FLAGS_index_snapshot) {
+    auto ret = loadIndexSnapshot();
+    if (ret.ok()) {
+      auto position = ret.value();
+      firstLoad = std::lower_bound(allFileIds_.begin(), allFileIds_.end(), position.fileId_) -
+                  allFileIds_.begin();
+      start = position.offset_;
+    } else if (ret.status().code() != Status::Code::kNoSuchFile) {
+      FLOG_WARN("Loading the index from the data files instead of its snapshot: {}",
+                ret.status().toString());
     }
+  }
 
-    int64_t pos = 0;
-    while (true) {
-      FVLOG2("Loading index from data file {}", fileId);
-      auto result = curDatafile->readLogRecord(pos);
-      if (!result.ok()) {
-        if (result.status().code() == Status::Code::kEOF) {
-          break;  // End of file reached
-        }
-        return result.status();
+  // The data files are loaded in parallel, and applied to the index in file order as they are
+  // loaded, so that the records of later files win
+  struct FileLoad {
+    Status status_;
+    std::unordered_map<KeyType, std::shared_ptr<LogPos>> updates_;
+    bool done_{false};
+  };
+  std::vector<FileLoad> loads(allFileIds_.size());
+  std::atomic<size_t> nextLoad{firstLoad};
+  std::mutex loadMutex;
+  std::condition_variable loadCv;
+  auto loadFiles = [&] {
+    for (size_t i = nextLoad++; i < loads.size(); i = nextLoad++) {
+      std::unordered_map<KeyType, std::shared_ptr<LogPos>> updates;
+      auto status = loadDataFile(allFileIds_[i], i == firstLoad ? start : 0, &updates);
+      {
+        std::lock_guard<std::mutex> lock(loadMutex);
+        loads[i].status_ = status;
+        loads[i].updates_ = std::move(updates);
+        loads[i].done_ = true;
       }
+      loadCv.notify_all();
+    }
+  };
+  size_t numThreads = FLAGS_index_load_threads > 0 ? FLAGS_index_load_threads
+                                                   : std::thread::hardware_concurrency();
+  numThreads = std::min(std::max<size_t>(numThreads, 1), loads.size() - firstLoad);
+  std::vector<thread::NamedThread> threads;
+  for (size_t i = 0; i < numThreads; i++) {
+    threads.emplace_back("bitcask-load", loadFiles);
+  }
 
-      auto logRecord = std::move(result.value());
-      auto key = logRecord->getKey();
-
-      if (logRecord->getLogType() == LogType::WRITE) {
-        auto logPos = std::make_shared<LogPos>(
-            fileId, logRecord->getValueSize(), pos, logRecord->getTimeStamp());
+  Status status;
+  for (size_t i = firstLoad; i < loads.size(); i++) {
+    std::unordered_map<KeyType, std::shared_ptr<LogPos>> updates;
+    {
+      std::unique_lock<std::mutex> lock(loadMutex);
+      loadCv.wait(lock, [&] { return loads[i].done_; });
+      status = loads[i].status_;
+      updates.swap(loads[i].updates_);
+    }
+    if (!status.ok()) {
+      // Don't load any more files
+      nextLoad = loads.size();
+      break;
+    }
+    for (auto& [key, logPos] : updates) {
+      if (logPos) {
         index_->put(key, std::move(logPos));
       } else {
         index_->remove(key);
       }
+    }
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return status;
+}
+
+Status DBImpl::loadDataFile(FileID fileId,
+                            FileOffset start,
+                            std::unordered_map<KeyType, std::shared_ptr<LogPos>>* updates) {
+  DataFile* curDatafile{nullptr};
+  if (fileId == activeFileId_) {
+    curDatafile = activeFile_.get();
+  } else {
+    if (oldDataFiles_.find(fileId) == oldDataFiles_.end()) {
+      FLOG_ERROR("Data file not found: {}", fileId);
+      return Status::ERROR(Status::Code::kNoSuchFile, "data file not found.");
+    }
+    curDatafile = oldDataFiles_.at(fileId).get();
+  }
 
-      pos += logRecord->getTotalSize();
+  FVLOG2("Loading index from data file {}", fileId);
+  std::vector<HintEntry> entries;
+  bool hinted = false;
+  if (fileId != activeFileId_ && start == 0) {
+    auto hints = HintFile::read(dbname_, fileId, curDatafile->getCurrentFileSize());
+    if (hints.ok()) {
+      entries = std::move(hints).value();
+      hinted = true;
+    } else if (hints.status().code() != Status::Code::kNoSuchFile) {
+      FLOG_WARN(
+          "Scanning data file {} instead of its hint file: {}", fileId, hints.status().toString());
     }
   }
 
+  if (!hinted) {
+    auto ret = scanDataFile(fileId, curDatafile, fileId == activeFileId_, start, &entries);
+    if (!ret.ok()) {
+      return ret.status();
+    }
+    auto end = ret.value();
+    if (fileId == activeFileId_) {
+      // A partially written record or batch at the end of the active file is dropped, so that new
+      // records are not appended after it.
+      if (!options_.readOnly && end < curDatafile->getCurrentFileSize()) {
+        FLOG_WARN("Dropping torn log records at {} of data file {}", end, fileId);
+        auto status = curDatafile->truncate(end);
+        if (!status.ok()) {
+          return status;
+        }
+      }
+    } else if (end < curDatafile->getCurrentFileSize()) {
+      // E.g. a hole left by a failed write which could not be padded
+      FLOG_ERROR("Records past {} of data file {} can't be read, {} bytes are skipped",
+                 end,
+                 fileId,
+                 curDatafile->getCurrentFileSize() - end);
+    }
+    if (fileId != activeFileId_ && !options_.readOnly && start == 0) {
+      // Written for the data files retired before hint files were, or before a crash
+      auto status = HintFile::write(dbname_, fileId, entries, end);
+      if (!status.ok()) {
+        FLOG_WARN("Failed to write the hint file of data file {}: {}", fileId, status.toString());
+      }
+    }
+  }
+
+  // Only the last record of a key in the file matters
+  updates->reserve(entries.size());
+  for (const auto& entry : entries) {
+    if (entry.logType_ == LogType::WRITE) {
+      (*updates)[entry.key_] =
+          std::make_shared<LogPos>(fileId, entry.valueSize_, entry.pos_, entry.tstamp_);
+    } else {
+      (*updates)[entry.key_] = nullptr;
+    }
+  }
+  return Status::OK();
+}
+
+StatusOr<FileOffset> DBImpl::scanDataFile(FileID fileId,
+                                          DataFile* file,
+                                          bool active,
+                                          FileOffset start,
+                                          std::vector<HintEntry>* entries,
+                                          IOPriority priority) {
+  // The file is scanned from start to end, read ahead of the scan
+  file->adviseAccess(MADV_SEQUENTIAL);
+  DataFileScanner scanner(file, start, FLAGS_scan_chunk_size, priority);
+  // The end of the last complete record or batch
+  FileOffset end = start;
+  Status status;
+  while ((status = scanner.next()).ok()) {
+    const auto& header = scanner.header();
+    if (header.logType_ == LogType::PADDING) {
+      end = scanner.end();
+      continue;
+    }
+    if (header.logType_ != LogType::BATCH) {
+      entries->push_back(
+          {scanner.key(), header.logType_, header.valueSize_, scanner.offset(), header.tstamp_});
+      end = scanner.end();
+      continue;
+    }
+
+    // Verify the whole batch before listing any of it. Its records are only covered by the crc of
+    // the batch.
+    auto value = scanner.record().substr(kLogHeaderAndKeySize);
+    uint32_t batchSize = 0;
+    uint32_t batchCrc = 0;
+    std::memcpy(&batchSize, value.data(), sizeof(batchSize));
+    std::memcpy(&batchCrc, value.data() + sizeof(batchSize), sizeof(batchCrc));
+    auto batchPos = scanner.end();
+    bool crc32c = header.crc32c_;
+    uint32_t calculatedCrc = 0;
+    auto numEntries = entries->size();
+    while (scanner.end() < batchPos + batchSize) {
+      status = scanner.next(false);
+      if (!status.ok() || scanner.end() > batchPos + batchSize) {
+        break;
+      }
+      auto record = scanner.record();
+      // The batch is checksummed with the algorithm of its BATCH record
+      calculatedCrc = crc32c ? crc::extend32c(calculatedCrc, record.data(), record.size())
+                             : crc::extend(calculatedCrc, record.data(), record.size());
+      entries->push_back({scanner.key(), scanner.header().logType_, scanner.header().valueSize_,
+                          scanner.offset(), scanner.header().tstamp_});
+    }
+    if (!status.ok() && status.code() != Status::Code::kEOF) {
+      return status;
+    }
+    if (!status.ok() || scanner.end() != batchPos + batchSize || calculatedCrc != batchCrc) {
+      entries->resize(numEntries);
+      // A batch is never split across data files, so only the last one written, i.e. the active
+      // file, can end with a torn batch.
+      if (!active) {
+        FLOG_ERROR("Corrupted batch at {} of data file {}", end, fileId);
+        return Status::ERROR(Status::Code::kError, "Corrupted batch");
+      }
+      FLOG_WARN("Torn batch at {} of data file {}", end, fileId);
+      status = Status::ERROR(Status::Code::kEOF, "EOF");
+      break;
+    }
+    end = scanner.end();
+  }
+  // Back to point lookups
+  file->adviseAccess(MADV_RANDOM);
+  // End of file reached, or a torn record
+  if (status.code() != Status::Code::kEOF) {
+    return status;
+  }
+  return end;
+}
+
+StatusOr<WritePosition> DBImpl::loadIndexSnapshot() {
+  auto ret = IndexSnapshot::open(dbname_);
+  if (!ret.ok()) {
+    return ret.status();
+  }
+  auto snapshot = std::move(ret).value();
+  auto position = snapshot->position();
+  std::vector<FileID> fileIds(
+      allFileIds_.begin(),
+      std::upper_bound(allFileIds_.begin(), allFileIds_.end(), position.fileId_));
+  DataFile* file = activeFile_.get();
+  if (position.fileId_ != activeFileId_) {
+    auto it = oldDataFiles_.find(position.fileId_);
+    file = it != oldDataFiles_.end() ? it->second.get() : nullptr;
+  }
+  if (fileIds != snapshot->fileIds() || !file || file->getCurrentFileSize() < position.offset_) {
+    return Status::ERROR(Status::Code::kError, "Index snapshot doesn't match the data files");
+  }
+  snapshot->load(index_.get());
+  FLOG_INFO("Loaded {} keys from the index snapshot at {}:{}",
+            snapshot->numEntries(),
+            position.fileId_,
+            position.offset_);
+  return position;
+}
+
+void DBImpl::writeIndexSnapshot() {
+  std::vector<FileID> fileIds;
+  WritePosition position;
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    for (const auto& [fileId, file] : oldDataFiles_) {
+      fileIds.emplace_back(fileId);
+    }
+    fileIds.emplace_back(activeFileId_);
+    position = endPosition();
+  }
+  std::sort(fileIds.begin(), fileIds.end());
+  auto status = IndexSnapshot::write(dbname_, index_.get(), fileIds, position);
+  if (!status.ok()) {
+    // Not fatal, the index is loaded from the data files instead on open
+    FLOG_WARN("Failed to write the index snapshot: {}", status.toString());
+  }
+}
+
+void DBImpl::writeHintFile(FileID fileId, DataFile* file) {
+  std::vector<HintEntry> entries;
+  // Written in the background, behind gets and writes
+  auto ret = scanDataFile(fileId, file, false, 0, &entries, IOPriority::kLow);
+  auto status = ret.ok() ? HintFile::write(dbname_, fileId, entries, ret.value()) : ret.status();
+  if (!status.ok()) {
+    // Not fatal, the data file is scanned instead on open
+    FLOG_WARN("Failed to write the hint file of data file {}: {}", fileId, status.toString());
+  }
+}
+
+Status DBImpl::removeDataFile(FileID fileId) {
+  space_.remove(fileId);
+  // The hint file first, so that it's never left without its data file, stale if the id is reused
+  for (const auto& fileName :
+       {HintFile::fileName(dbname_, fileId), fmt::format("{}/{}.data", dbname_, fileId)}) {
+    std::error_code ec;
+    std::filesystem::remove(fileName, ec);
+    if (ec) {
+      FLOG_ERROR("Failed to remove {}: {}", fileName, ec.message());
+      return Status::ERROR(Status::Code::kError,
+                           fmt::format("Failed to remove {}: {}", fileName, ec.message()));
+    }
+  }
+  return Status::OK();
+}
+
+Status DBImpl::removeMergedFiles() {
+  while (!mergedFilesLeft_.empty()) {
+    // Older files first, so that the tombstones hiding their records are removed after them
+    auto status = removeDataFile(*mergedFilesLeft_.begin());
+    if (!status.ok()) {
+      return status;
+    }
+    mergedFilesLeft_.erase(mergedFilesLeft_.begin());
+  }
   return Status::OK();
 }
 
-StatusOr<FileOffset> DBImpl::appendLogRecord(std::unique_ptr<LogRecord>&& logRecord) {
+StatusOr<std::shared_ptr<LogPos>> DBImpl::appendRecord(const KeyType& key,
+                                                       const std::string& value,
+                                                       LogType logType) {
+  char header[kLogHeaderAndKeySize];
+  auto valueSize = static_cast<uint16_t>(value.size());
+  auto tstamp = time::WallClock::fastNowInMicroSec();
+  LogRecord::encodeHeader(header, key, value.data(), valueSize, logType, tstamp);
+
+  struct iovec iovs[2] = {{header, kLogHeaderAndKeySize},
+                          {const_cast<char*>(value.data()), value.size()}};
+  auto ret = appendBuffers(iovs, value.empty() ? 1 : 2);
+  if (!ret.ok()) {
+    return ret.status();
+  }
+  auto [fileId, offset] = std::move(ret).value();
+  return std::make_shared<LogPos>(fileId, valueSize, offset, tstamp);
+}
+
+StatusOr<std::pair<FileID, FileOffset>> DBImpl::appendBuffers(struct iovec* iovs, int iovCnt) {
+  if (syncPolicy_ == SyncPolicy::kPerWrite) {
+    // Durable writes share the sync with other concurrent writers.
+    Writer writer(iovs, iovCnt);
+    auto status = groupCommit(&writer);
+    if (!status.ok()) {
+      return status;
+    }
+    space_.append(writer.fileId_, writer.size_);
+    return std::make_pair(writer.fileId_, writer.offset_);
+  }
+
+  size_t size = 0;
+  for (int i = 0; i < iovCnt; i++) {
+    size += iovs[i].iov_len;
+  }
+
+  while (concurrentAppends_) {
+    {
+      // Hold mutex_ shared so that the active file is not rolled out before the write is done
+      std::shared_lock<std::shared_mutex> lock(mutex_);
+      auto offset = activeFile_->reserve(size, options_.maxFileSize);
+      if (offset >= 0) {
+        auto status = activeFile_->writeBuffersAt(iovs, iovCnt, offset, size);
+        if (!status.ok()) {
+          // The range is reserved, and the records of other writers may already follow it. Pad it
+          // so that they are still found on open, or have the file rolled out if that fails too.
+          auto padStatus = activeFile_->padAt(offset, size);
+          if (!padStatus.ok()) {
+            FLOG_ERROR("Failed to pad the failed write at {} of data file {}, rolling it out: {}",
+                       offset,
+                       activeFileId_,
+                       padStatus.toString());
+            activeFile_->markFailed();
+          }
+          space_.append(activeFileId_, size);
+          return status;
+        }
+        recordWrite(size);
+        space_.append(activeFileId_, size);
+        return std::make_pair(activeFileId_, offset);
+      }
+    }
+    // The active file is full, roll it out unless another writer has done it meanwhile
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto fileSize = activeFile_->getCurrentFileSize();
+    if (activeFile_->failed() || (fileSize > 0 && fileSize + size > options_.maxFileSize)) {
+      auto status = rollActiveFile();
+      if (!status.ok()) {
+        return status;
+      }
+    }
+  }
+
   // rolling out data file and write must be atomic
   std::unique_lock<std::shared_mutex> lock(mutex_);
-  if (activeFile_->getCurrentFileSize() + logRecord->getTotalSize() > options_.maxFileSize) {
-    // roll out a new data file
-    activeFile_->flush();
-    activeFile_->closeDataFile();
+  if (activeFile_->getCurrentFileSize() + size > options_.maxFileSize) {
+    auto status = rollActiveFile();
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  auto ret = activeFile_->writeBuffers(iovs, iovCnt);
+  if (!ret.ok()) {
+    return ret.status();
+  }
+  recordWrite(size);
+  space_.append(activeFileId_, size);
+  return std::make_pair(activeFileId_, std::move(ret).value());
+}
 
-    // reopen this data file as read only mode and append to old datafiles
-    auto oldFile = std::make_unique<DataFile>(dbname_, activeFileId_, true);
-    auto status = oldFile->openDataFile();
+Status DBImpl::groupCommit(Writer* writer) {
+  std::unique_lock<std::mutex> lock(writersMutex_);
+  writers_.push_back(writer);
+  while (!writer->done_ && writer != writers_.front()) {
+    writer->cv_.wait(lock);
+  }
+  if (writer->done_) {
+    // A leader has written and synced our buffer.
+    return writer->status_;
+  }
+
+  // We are the leader. Take as many queued writers as fit in one group. Writers arriving from now
+  // on queue up behind the group and one of them leads the next group.
+  std::vector<Writer*> group;
+  size_t groupBytes = 0;
+  for (auto* w : writers_) {
+    if (!group.empty() && groupBytes + w->size_ > FLAGS_group_commit_max_bytes) {
+      break;
+    }
+    group.emplace_back(w);
+    groupBytes += w->size_;
+  }
+  lock.unlock();
+
+  Status status;
+  {
+    std::unique_lock<std::shared_mutex> fileLock(mutex_);
+    status = writeGroup(group);
+    if (status.ok()) {
+      recordWrite(groupBytes);
+      advanceDurablePosition(endPosition(), bytesWritten_);
+    }
+  }
+  FVLOG2("Group commit of {} writes, {} bytes: {}", group.size(), groupBytes, status.toString());
+
+  lock.lock();
+  for (auto* w : group) {
+    DCHECK(w == writers_.front());
+    writers_.pop_front();
+    w->status_ = status;
+    w->done_ = true;
+    if (w != writer) {
+      w->cv_.notify_one();
+    }
+  }
+  // Hand over the leadership to the next waiting writer.
+  if (!writers_.empty()) {
+    writers_.front()->cv_.notify_one();
+  }
+  return status;
+}
+
+Status DBImpl::writeGroup(const std::vector<Writer*>& group) {
+  // Buffers are written in queue order. A run of buffers fitting in the active file goes out with a
+  // single pwritev; the file is rolled between runs when it's full.
+  groupIovs_.clear();
+  size_t runStart = 0;
+  int64_t runBytes = 0;
+  auto writeRun = [&](size_t runEnd) -> Status {
+    if (groupIovs_.empty()) {
+      return Status::OK();
+    }
+    auto ret = activeFile_->writeBuffers(groupIovs_);
+    if (!ret.ok()) {
+      return ret.status();
+    }
+    auto offset = std::move(ret).value();
+    for (auto i = runStart; i < runEnd; i++) {
+      group[i]->fileId_ = activeFileId_;
+      group[i]->offset_ = offset;
+      offset += group[i]->size_;
+    }
+    groupIovs_.clear();
+    runStart = runEnd;
+    runBytes = 0;
+    return Status::OK();
+  };
+
+  for (size_t i = 0; i < group.size(); i++) {
+    auto size = group[i]->size_;
+    if (activeFile_->getCurrentFileSize() + runBytes + size > options_.maxFileSize) {
+      auto status = writeRun(i);
+      if (!status.ok()) {
+        return status;
+      }
+      // The writes in the file being rolled out have to be durable before they are acknowledged
+      status = activeFile_->syncData();
+      if (!status.ok()) {
+        return status;
+      }
+      status = rollActiveFile();
+      if (!status.ok()) {
+        return status;
+      }
+    }
+    groupIovs_.insert(groupIovs_.end(), group[i]->iovs_, group[i]->iovs_ + group[i]->iovCnt_);
+    runBytes += size;
+  }
+  auto status = writeRun(group.size());
+  if (!status.ok()) {
+    return status;
+  }
+
+  // One sync for the whole group. Rolled out files have been synced before rolling.
+  return activeFile_->syncData();
+}
+
+Status DBImpl::rollActiveFile(FileID numReserved) {
+  auto retiredFileId = activeFileId_;
+  auto fileId = activeFileId_ + 1 + numReserved;
+  bool background = false;
+  {
+    std::lock_guard<std::mutex> lock(bgMutex_);
+    background = bgRunning_;
+  }
+
+  // Nothing is changed until the roll can no longer fail, so that a failure leaves the active file
+  // and the next file as they are
+  if (!background) {
+    // roll out a new data file inline. It's not retired unless it's synced, as its records count
+    // as durable once it's rolled out.
+    auto status = activeFile_->flush();
     if (!status.ok()) {
+      FLOG_ERROR("Failed to sync data file {} before rolling it out: {}",
+                 retiredFileId,
+                 status.toString());
       return status;
     }
-    oldDataFiles_.emplace(activeFileId_, std::move(oldFile));
+  } else {
+    // Only write out the buffered bytes here. The retired file is read as it is until the
+    // background thread has synced it and reopened it read only.
+    auto status = activeFile_->flushWriteBuffer();
+    if (!status.ok()) {
+      return status;
+    }
+  }
 
-    // create new active data file
-    activeFileId_++;
-    allFileIds_.emplace_back(activeFileId_);
-    activeFile_.reset(new DataFile(dbname_, activeFileId_));
-    status = activeFile_->openDataFile();
+  // reopen this data file as read only mode, to be appended to old datafiles. The writable one is
+  // closed once the readers still using it have left.
+  std::shared_ptr<DataFile> oldFile;
+  if (!background) {
+    oldFile = newDataFile(retiredFileId, true);
+    auto status = oldFile->openDataFile();
     if (!status.ok()) {
       return status;
     }
-    FLOG_INFO("Rolled out a new data file: {}", activeFileId_);
   }
-  auto ret = activeFile_->writeLogRecord(std::move(logRecord));
+
+  // Take the pre-created file, and have the background thread pre-create the one after the new
+  // active file, meanwhile
+  std::unique_ptr<DataFile> preCreated;
+  FileID preCreatedId = 0;
+  {
+    std::unique_lock<std::mutex> lock(bgMutex_);
+    bgDoneCv_.wait(lock, [this] { return !creatingNextFile_; });
+    preCreated = std::move(nextFile_);
+    preCreatedId = nextFileId_;
+    nextFileId_ = fileId + 1;
+  }
+  DCHECK(!preCreated || preCreatedId == activeFileId_ + 1);
+  std::unique_ptr<DataFile> nextFile;
+  if (preCreated && preCreatedId == fileId) {
+    nextFile = std::move(preCreated);
+  } else {
+    // The background thread is not running or has not caught up, or the id of the pre-created file
+    // is reserved. Create the file inline.
+    auto ret = openWritableFile(fileId);
+    if (!ret.ok()) {
+      // Give the pre-created file back, dropping the one created meanwhile for after fileId
+      std::unique_lock<std::mutex> lock(bgMutex_);
+      bgDoneCv_.wait(lock, [this] { return !creatingNextFile_; });
+      if (nextFile_) {
+        nextFile_.reset();
+        removeDataFile(nextFileId_);
+      }
+      nextFile_ = std::move(preCreated);
+      nextFileId_ = preCreatedId;
+      lock.unlock();
+      bgCv_.notify_all();
+      return ret.status();
+    }
+    nextFile = std::move(ret).value();
+  }
+  if (preCreated) {
+    // Its id is reserved
+    preCreated.reset();
+    removeDataFile(preCreatedId);
+  }
+
+  if (!background) {
+    oldDataFiles_.emplace(retiredFileId, std::move(oldFile));
+  }
+
+  if (background) {
+    auto* retiredFile = activeFile_.get();
+    oldDataFiles_.emplace(retiredFileId, std::move(activeFile_));
+    std::lock_guard<std::mutex> lock(bgMutex_);
+    retiredFiles_.emplace_back(retiredFileId, retiredFile);
+  }
+  bgCv_.notify_all();
+
+  // swap in the new active data file
+  activeFileId_ = fileId;
+  allFileIds_.emplace_back(activeFileId_);
+  activeFile_ = std::move(nextFile);
+  publishFileTable();
+  FLOG_INFO("Rolled out a new data file: {}", activeFileId_);
+  return Status::OK();
+}
+
+Status DBImpl::retireFile(FileID fileId, DataFile* file) {
+  std::shared_ptr<DataFile> oldFile = newDataFile(fileId, true);
+  auto status = file->syncData();
+  if (status.ok()) {
+    status = oldFile->openDataFile();
+  }
+  if (status.ok()) {
+    writeHintFile(fileId, oldFile.get());
+  }
+  {
+    std::lock_guard<std::mutex> syncLock(syncMutex_);
+    std::unique_lock<std::shared_mutex> fileLock(mutex_);
+    if (status.ok()) {
+      auto& slot = oldDataFiles_.at(fileId);
+      DCHECK(slot.get() == file);
+      slot.swap(oldFile);
+      publishFileTable();
+    }
+    // Done with it either way. If it failed, the file stays writable, which does no harm to reads.
+    std::lock_guard<std::mutex> lock(bgMutex_);
+    DCHECK(retiredFiles_.front().second == file);
+    retiredFiles_.pop_front();
+  }
+  bgDoneCv_.notify_all();
+  // Close the writable file out of the locks, once the readers still using it have left. It
+  // releases the unused preallocated space.
+  oldFile.reset();
+  fileTable_.synchronize();
+  FVLOG1("Retired data file {}: {}", fileId, status.toString());
+  return status;
+}
+
+Status DBImpl::openActiveFile() {
+  if (options_.readOnly) {
+    activeFile_ = newDataFile(activeFileId_, true);
+    return activeFile_->openDataFile();
+  }
+  auto ret = openWritableFile(activeFileId_);
   if (!ret.ok()) {
     return ret.status();
   }
+  activeFile_ = std::move(ret).value();
+  return Status::OK();
+}
+
+StatusOr<std::unique_ptr<DataFile>> DBImpl::openWritableFile(FileID fileId) {
+  auto dataFile = newDataFile(fileId, false);
+  auto status = dataFile->openDataFile();
+  if (!status.ok()) {
+    return status;
+  }
+  if (options_.writeBufferSize > 0) {
+    dataFile->enableWriteBuffer(options_.writeBufferSize);
+  }
+  status = dataFile->preallocate(options_.maxFileSize);
+  if (!status.ok()) {
+    // Appends allocate blocks as they go then
+    FLOG_WARN("Failed to preallocate data file {}: {}", fileId, status.toString());
+  }
+  return dataFile;
+}
+
+void DBImpl::publishFileTable() {
+  std::vector<std::pair<FileID, std::shared_ptr<DataFile>>> files(oldDataFiles_.begin(),
+                                                                  oldDataFiles_.end());
+  if (activeFile_) {
+    files.emplace_back(activeFileId_, activeFile_);
+  }
+  fileTable_.publish(std::make_unique<FileTable>(files));
+}
+
+std::unique_ptr<Index> DBImpl::newIndex() const {
+  switch (options_.indexType) {
+    case IndexType::kFlat:
+      return std::make_unique<FlatIndex>(FLAGS_initial_index_size);
+    case IndexType::kSharded:
+      return std::make_unique<ShardedIndex>(FLAGS_initial_index_size);
+    case IndexType::kOrdered:
+      return std::make_unique<OrderedIndex>();
+    case IndexType::kHash:
+    default:
+      return std::make_unique<HashIndex>(FLAGS_initial_index_size);
+  }
+}
+
+std::unique_ptr<DataFile> DBImpl::newDataFile(FileID fileId, bool readOnly) {
+  auto dataFile = std::make_unique<DataFile>(dbname_, fileId, readOnly, options_.useDirectIO);
+  dataFile->setIOBackend(IOBackend::get(options_.ioBackend));
+  // Only read only files are mapped, the ones being written keep being read with syscalls
+  dataFile->setMmapReads(options_.mmapReads);
+  dataFile->setRateLimiter(rateLimiter_.get());
+  return dataFile;
+}
+
+void DBImpl::startBackgroundThread() {
+  if (options_.readOnly) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(bgMutex_);
+    bgRunning_ = true;
+    nextFileId_ = activeFileId_ + 1;
+  }
+  bgThread_ = thread::NamedThread("bitcask-bg", &DBImpl::backgroundWork, this);
+}
+
+void DBImpl::stopBackgroundThread() {
+  {
+    std::lock_guard<std::mutex> lock(bgMutex_);
+    bgStopping_ = true;
+    bgRunning_ = false;
+  }
+  bgCv_.notify_all();
+  if (bgThread_.joinable()) {
+    bgThread_.join();
+  }
+
+  // The background thread is gone, finish its work here
+  std::unique_lock<std::mutex> lock(bgMutex_);
+  while (!retiredFiles_.empty()) {
+    auto [fileId, file] = retiredFiles_.front();
+    lock.unlock();
+    auto status = retireFile(fileId, file);
+    if (!status.ok()) {
+      FLOG_ERROR("Failed to retire data file {}: {}", fileId, status.toString());
+    }
+    lock.lock();
+  }
+  if (nextFile_) {
+    nextFile_.reset();
+    removeDataFile(nextFileId_);
+  }
+}
+
+void DBImpl::backgroundWork() {
+  using Clock = std::chrono::steady_clock;
+  auto flushInterval = std::chrono::milliseconds(options_.writeBufferFlushIntervalMs);
+  auto syncInterval = std::chrono::milliseconds(options_.syncIntervalMs);
+  auto nextFlush = Clock::now() + flushInterval;
+  auto nextSync = Clock::now() + syncInterval;
+  // Don't retry pre-creating a file that failed until the next roll
+  FileID failedFileId = 0;
+  auto syncDue = [&] {
+    auto unsyncedBytes = bytesWritten_ - bytesSynced_;
+    return (syncPolicy_ == SyncPolicy::kBytes && unsyncedBytes >= options_.syncBytes) ||
+           (syncPolicy_ == SyncPolicy::kInterval && unsyncedBytes > 0 && Clock::now() >= nextSync);
+  };
+  auto hasWork = [&] {
+    return bgStopping_ || !retiredFiles_.empty() || (!nextFile_ && nextFileId_ != failedFileId) ||
+           syncDue();
+  };
+
+  std::unique_lock<std::mutex> lock(bgMutex_);
+  while (!bgStopping_) {
+    if (!retiredFiles_.empty()) {
+      // Retire the rolled out files in roll order
+      auto [fileId, file] = retiredFiles_.front();
+      lock.unlock();
+      auto status = retireFile(fileId, file);
+      if (!status.ok()) {
+        FLOG_ERROR("Failed to retire data file {}: {}", fileId, status.toString());
+      }
+      lock.lock();
+    } else if (!nextFile_ && nextFileId_ != failedFileId) {
+      // Pre-create the data file of the next roll
+      auto fileId = nextFileId_;
+      creatingNextFile_ = true;
+      lock.unlock();
+      auto ret = openWritableFile(fileId);
+      lock.lock();
+      creatingNextFile_ = false;
+      if (ret.ok()) {
+        nextFile_ = std::move(ret).value();
+        FVLOG1("Pre-created data file {}", fileId);
+      } else {
+        FLOG_ERROR("Failed to pre-create data file {}: {}", fileId, ret.status().toString());
+        failedFileId = fileId;
+      }
+      bgDoneCv_.notify_all();
+    } else if (syncDue()) {
+      lock.unlock();
+      auto status = syncFiles();
+      if (!status.ok()) {
+        FLOG_ERROR("Failed to sync data files: {}", status.toString());
+      }
+      nextSync = Clock::now() + syncInterval;
+      lock.lock();
+    } else if (options_.writeBufferSize > 0 && Clock::now() >= nextFlush) {
+      lock.unlock();
+      {
+        // Hold mutex_ so that the active file is not rolled out meanwhile
+        std::shared_lock<std::shared_mutex> fileLock(mutex_);
+        auto status = activeFile_->flushWriteBuffer();
+        if (!status.ok()) {
+          FLOG_ERROR("Failed to flush write buffer: {}", status.toString());
+        }
+      }
+      nextFlush = Clock::now() + flushInterval;
+      lock.lock();
+    } else {
+      auto deadline = Clock::time_point::max();
+      if (options_.writeBufferSize > 0) {
+        deadline = std::min(deadline, nextFlush);
+      }
+      if (syncPolicy_ == SyncPolicy::kInterval) {
+        if (Clock::now() >= nextSync) {
+          // nothing to sync this time
+          nextSync = Clock::now() + syncInterval;
+        }
+        deadline = std::min(deadline, nextSync);
+      }
+      if (deadline == Clock::time_point::max()) {
+        bgCv_.wait(lock, hasWork);
+      } else {
+        bgCv_.wait_until(lock, deadline, hasWork);
+      }
+    }
+  }
+}
+
+void DBImpl::startMergeThread() {
+  if (options_.readOnly) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mergeMutex_);
+    mergeRunning_ = true;
+  }
+  mergeThread_ = thread::NamedThread("bitcask-merge", &DBImpl::mergeWork, this);
+}
+
+void DBImpl::stopMergeThread() {
+  {
+    std::lock_guard<std::mutex> lock(mergeMutex_);
+    mergeStopping_ = true;
+    mergeRunning_ = false;
+  }
+  {
+    // Wake up a merge waiting for the files to be retired
+    std::lock_guard<std::mutex> lock(bgMutex_);
+  }
+  bgDoneCv_.notify_all();
+  mergeCv_.notify_all();
+  mergeDoneCv_.notify_all();
+  if (mergeThread_.joinable()) {
+    mergeThread_.join();
+  }
+}
+
+void DBImpl::mergeWork() {
+  bool autoMerge = options_.mergeMinDeadRatio > 0;
+  auto interval = std::chrono::milliseconds(FLAGS_merge_check_interval_ms);
+  auto requested = [this] { return mergeStopping_ || mergesRequested_ > mergesDone_; };
+  std::unique_lock<std::mutex> lock(mergeMutex_);
+  while (true) {
+    if (autoMerge) {
+      mergeCv_.wait_for(lock, interval, requested);
+    } else {
+      mergeCv_.wait(lock, requested);
+    }
+    if (mergeStopping_) {
+      break;
+    }
+    if (mergesRequested_ == mergesDone_) {
+      // Time to merge the files worth it, if any
+      lock.unlock();
+      auto status = mergeFiles(false);
+      if (!status.ok()) {
+        FLOG_ERROR("Failed to merge data files automatically: {}", status.toString());
+      }
+      lock.lock();
+      continue;
+    }
+    // One merge does for all the merges asked for so far
+    auto target = mergesRequested_;
+    lock.unlock();
+    auto status = mergeFiles(true);
+    if (!status.ok()) {
+      FLOG_ERROR("Failed to merge data files: {}", status.toString());
+    }
+    lock.lock();
+    mergesDone_ = target;
+    mergeStatus_ = status;
+    mergeDoneCv_.notify_all();
+  }
+}
+
+Status DBImpl::mergeFiles(bool all) {
+  auto status = removeMergedFiles();
+  if (!status.ok()) {
+    FLOG_WARN(
+        "{} merged data files are still left: {}", mergedFilesLeft_.size(), status.toString());
+  }
+  if (all) {
+    // Let the files rolled out so far be retired first, they're merged once they're read only
+    FileID rolled = writtenPosition().fileId_;
+    std::unique_lock<std::mutex> lock(bgMutex_);
+    bgDoneCv_.wait(lock, [this, rolled] {
+      return retiredFiles_.empty() || retiredFiles_.front().first > rolled || mergeStopping_;
+    });
+  }
+  std::vector<std::pair<FileID, std::shared_ptr<DataFile>>> files;
+  FileID firstFileId = 0;
+  FileID oldestKept = 0;
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    oldestKept = activeFileId_;
+    // The merged files left are replayed on open too
+    if (!mergedFilesLeft_.empty()) {
+      oldestKept = std::min(oldestKept, *mergedFilesLeft_.begin());
+    }
+    std::unordered_set<FileID> retiring;
+    {
+      std::lock_guard<std::mutex> bgLock(bgMutex_);
+      for (const auto& [fileId, file] : retiredFiles_) {
+        retiring.insert(fileId);
+        oldestKept = std::min(oldestKept, fileId);
+      }
+    }
+    auto minAgeMs = static_cast<int64_t>(options_.mergeMinFileAgeSec) * 1000;
+    for (const auto& [fileId, file] : oldDataFiles_) {
+      if (retiring.count(fileId)) {
+        continue;
+      }
+      if (all || space_.mergeable(fileId, options_.mergeMinDeadRatio, minAgeMs)) {
+        files.emplace_back(fileId, file);
+      } else {
+        oldestKept = std::min(oldestKept, fileId);
+      }
+    }
+    if (files.empty()) {
+      return Status::OK();
+    }
+    std::sort(files.begin(), files.end(), [](const auto& l, const auto& r) {
+      return l.first < r.first;
+    });
+    // The merged records fit in as many files as they come from
+    firstFileId = activeFileId_ + 1;
+    status = rollActiveFile(files.size());
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  FLOG_INFO("Merging {} data files from {} into data files from {}",
+            files.size(),
+            files.front().first,
+            firstFileId);
+
+  // Wait for the writes appended before the roll to update the index. Writers hold the lock of the
+  // stripe of their key from the append to the index update.
+  for (auto& keyLock : keyLocks_) {
+    std::lock_guard<std::mutex> lock(keyLock);
+  }
 
-  if (options_.syncOnPut) {
-    auto status = sync();
+  status = writeMergedFiles(files, firstFileId, files.size(), oldestKept);
+  if (!status.ok()) {
+    return status;
+  }
+
+  // Drop the merged files, and remove them once the readers which may still use them have left
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    for (const auto& [fileId, file] : files) {
+      oldDataFiles_.erase(fileId);
+      allFileIds_.erase(std::find(allFileIds_.begin(), allFileIds_.end(), fileId));
+    }
+    publishFileTable();
+  }
+  for (auto& [fileId, file] : files) {
+    file.reset();
+  }
+  fileTable_.synchronize();
+  for (const auto& [fileId, file] : files) {
+    mergedFilesLeft_.insert(fileId);
+  }
+  merges_++;
+  FLOG_INFO("Merged {} data files", files.size());
+  // A tombstone of a newer file may hide a record of an older one, so the files are removed in id
+  // order and the ones left after a failure are only removed once the older ones are
+  return removeMergedFiles();
+}
+
+Status DBImpl::writeMergedFiles(
+    const std::vector<std::pair<FileID, std::shared_ptr<DataFile>>>& files,
+    FileID firstFileId,
+    FileID numReserved,
+    FileID oldestKept) {
+  // The merged file being written, the records copied to it, and where they come from
+  FileID fileId = firstFileId;
+  std::unique_ptr<DataFile> file;
+  std::vector<HintEntry> entries;
+  std::vector<LogPos> sources;
+
+  // Publish the merged file, and move the index to it
+  auto finishFile = [&]() -> Status {
+    auto status = file->flushWriteBuffer();
+    if (status.ok()) {
+      status = file->syncData();
+    }
+    auto end = file->getCurrentFileSize();
+    file.reset();
+    if (!status.ok()) {
+      removeDataFile(fileId);
+      return status;
+    }
+    status = HintFile::write(dbname_, fileId, entries, end);
+    if (!status.ok()) {
+      // Not fatal, the merged file is scanned instead on open
+      FLOG_WARN("Failed to write the hint file of data file {}: {}", fileId, status.toString());
+    }
+    std::shared_ptr<DataFile> mergedFile = newDataFile(fileId, true);
+    status = mergedFile->openDataFile();
     if (!status.ok()) {
+      removeDataFile(fileId);
+      return status;
+    }
+    {
+      std::unique_lock<std::shared_mutex> lock(mutex_);
+      oldDataFiles_.emplace(fileId, std::move(mergedFile));
+      allFileIds_.insert(std::upper_bound(allFileIds_.begin(), allFileIds_.end(), fileId),
+                         fileId);
+      publishFileTable();
+    }
+    size_t moved = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+      if (entries[i].logType_ != LogType::WRITE) {
+        continue;
+      }
+      const auto& entry = entries[i];
+      auto logPos = std::make_shared<LogPos>(fileId, entry.valueSize_, entry.pos_, entry.tstamp_);
+      // The key keeps its new record if it's been written meanwhile
+      if (index_->compareAndPut(entry.key_, sources[i], std::move(logPos)).ok()) {
+        moved++;
+      }
+    }
+    FVLOG1("Merged {} records into data file {}, {} still live", entries.size(), fileId, moved);
+    entries.clear();
+    sources.clear();
+    fileId++;
+    return Status::OK();
+  };
+
+  for (const auto& [sourceId, source] : files) {
+    DataFileScanner scanner(source.get(), 0, FLAGS_scan_chunk_size, IOPriority::kLow);
+    Status status;
+    while ((status = scanner.next()).ok()) {
+      if (mergeStopping_) {
+        break;
+      }
+      const auto& header = scanner.header();
+      if (header.logType_ == LogType::BATCH || header.logType_ == LogType::PADDING) {
+        // The records of the batch follow, they are merged on their own
+        continue;
+      }
+      auto key = scanner.key();
+      auto logPos = index_->get(key);
+      if (header.logType_ == LogType::WRITE) {
+        // Only the record the key is at is live
+        if (!logPos.ok() || logPos.value()->fileId_ != sourceId ||
+            logPos.value()->pos_ != scanner.offset()) {
+          continue;
+        }
+      } else if (logPos.ok() || sourceId < oldestKept) {
+        // A tombstone is only needed while the key is deleted and older files are left out
+        continue;
+      }
+
+      auto record = scanner.record();
+      if (file && file->getCurrentFileSize() + record.size() > options_.maxFileSize) {
+        status = finishFile();
+        if (!status.ok()) {
+          return status;
+        }
+      }
+      if (!file) {
+        if (fileId >= firstFileId + numReserved) {
+          return Status::ERROR(Status::Code::kOverLimit, "Merged records over the reserved files");
+        }
+        file = newDataFile(fileId, false);
+        file->setRateLimiter(rateLimiter_.get(), IOPriority::kLow);
+        status = file->openDataFile();
+        if (!status.ok()) {
+          file.reset();
+          return status;
+        }
+        // Written in chunks as large as the ones the records are read in
+        file->enableWriteBuffer(FLAGS_scan_chunk_size);
+      }
+      auto ret = file->writeBuffer(record.data(), record.size());
+      if (!ret.ok()) {
+        file.reset();
+        removeDataFile(fileId);
+        return ret.status();
+      }
+      space_.append(fileId, record.size());
+      entries.push_back(
+          {key, header.logType_, header.valueSize_, ret.value(), header.tstamp_});
+      sources.emplace_back(sourceId, header.valueSize_, scanner.offset(), header.tstamp_);
+    }
+    if (mergeStopping_) {
+      // The merged files published so far stay, and so do all the files merged
+      if (file) {
+        file.reset();
+        removeDataFile(fileId);
+      }
+      return Status::ERROR(Status::Code::kError, "Merge stopped");
+    }
+    if (status.code() != Status::Code::kEOF) {
+      if (file) {
+        file.reset();
+        removeDataFile(fileId);
+      }
       return status;
     }
   }
-  return std::move(ret).value();
+  if (file) {
+    return finishFile();
+  }
+  return Status::OK();
 }
 
-StatusOr<std::string> DBImpl::getValueByLogPos(std::shared_ptr<LogPos>&& logPos) {
-  // read from disk
-  StatusOr<std::unique_ptr<LogRecord>> logRet;
-  if (logPos->fileId_ == activeFileId_) {
-    logRet = activeFile_->readLogRecord(logPos->pos_, logPos->valueSize_);
-  } else {
-    if (oldDataFiles_.find(logPos->fileId_) == oldDataFiles_.end()) {
-      FLOG_ERROR("Data file not found: {}", logPos->fileId_);
-      return Status::ERROR(Status::Code::kNoSuchFile, "data file not found.");
+void DBImpl::recordWrite(size_t size) {
+  auto bytesWritten = bytesWritten_ += size;
+  if (syncPolicy_ == SyncPolicy::kBytes && bytesWritten - bytesSynced_ >= options_.syncBytes) {
+    std::lock_guard<std::mutex> lock(bgMutex_);
+    bgCv_.notify_all();
+  }
+}
+
+Status DBImpl::syncFiles() {
+  std::lock_guard<std::mutex> syncLock(syncMutex_);
+  std::vector<DataFile*> files;
+  WritePosition position;
+  uint64_t bytesWritten = 0;
+  {
+    // Hold mutex_ exclusively, so that all writes up to the end of the active file are done
+    std::unique_lock<std::shared_mutex> fileLock(mutex_);
+    // The active file is absent if open failed half way.
+    if (!activeFile_) {
+      return Status::OK();
+    }
+    {
+      // Rolled out files are not synced until they are retired
+      std::lock_guard<std::mutex> lock(bgMutex_);
+      for (auto& retiredFile : retiredFiles_) {
+        files.emplace_back(retiredFile.second);
+      }
+    }
+    files.emplace_back(activeFile_.get());
+    position = endPosition();
+    bytesWritten = bytesWritten_;
+    // Write out the buffered bytes, so that the sync covers them
+    auto status = activeFile_->flushWriteBuffer();
+    if (!status.ok()) {
+      return status;
+    }
+  }
+
+  for (auto* file : files) {
+    auto status = file->syncData();
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  advanceDurablePosition(position, bytesWritten);
+  return Status::OK();
+}
+
+void DBImpl::advanceDurablePosition(WritePosition position, uint64_t bytesSynced) {
+  std::lock_guard<std::mutex> lock(durableMutex_);
+  if (durablePosition_ < position) {
+    durablePosition_ = position;
+  }
+  if (bytesSynced_ < bytesSynced) {
+    bytesSynced_ = bytesSynced;
+  }
+}
+
+namespace {
+
+void setCachedValue(std::shared_ptr<const std::string>&& cached, std::string* value) {
+  value->assign(*cached);
+}
+
+// Pin the value to the cached string, which stays alive after it's evicted
+void setCachedValue(std::shared_ptr<const std::string>&& cached, PinnableValue* value) {
+  const auto* data = cached->data();
+  auto size = cached->size();
+  value->pin(data, size, std::move(cached));
+}
+
+}  // namespace
+
+template <typename Value>
+Status DBImpl::getValue(const KeyType& key, Value* value) {
+  std::shared_ptr<LogPos> last;
+  while (true) {
+    // search the index
+    auto ret = index_->get(key);
+    if (!ret.ok()) {
+      return ret.status();
+    }
+    auto logPos = std::move(ret).value();
+    // read from disk
+    auto status = readValue(*logPos, value);
+    // A key which hasn't moved since the last try is really missing its data file
+    if (status.code() != Status::Code::kNoSuchFile || (last && last->sameRecord(*logPos))) {
+      return status;
+    }
+    last = std::move(logPos);
+  }
+}
+
+template <typename Value>
+Status DBImpl::readValue(const LogPos& logPos, Value* value) {
+  if (!valueCache_) {
+    return readValueFromFile(logPos, value);
+  }
+  CacheKey cacheKey{logPos.fileId_, logPos.pos_};
+  auto cached = valueCache_->lookup(cacheKey);
+  if (!cached) {
+    auto read = std::make_shared<std::string>();
+    auto status = readValueFromFile(logPos, read.get());
+    if (!status.ok()) {
+      return status;
     }
-    logRet = oldDataFiles_.at(logPos->fileId_)->readLogRecord(logPos->pos_, logPos->valueSize_);
+    cached = std::move(read);
+    valueCache_->insert(cacheKey, cached);
   }
+  setCachedValue(std::move(cached), value);
+  return Status::OK();
+}
 
-  if (!logRet.ok()) {
-    return logRet.status();
+template <typename Value>
+Status DBImpl::readValueFromFile(const LogPos& logPos, Value* value) {
+  // The data file is not closed until we leave. A value pinned to a mapping outlives the file.
+  VersionedFileTable::Reader files(fileTable_);
+  auto* dataFile = files->find(logPos.fileId_);
+  if (!dataFile) {
+    // It may have been merged away since the lookup
+    FVLOG1("Data file not found: {}", logPos.fileId_);
+    return Status::ERROR(Status::Code::kNoSuchFile, "data file not found.");
   }
-  return std::move(logRet).value()->getValue();
+  return dataFile->readValue(logPos.pos_, logPos.valueSize_, value);
 }
 
 Status DBImpl::fold(std::function<void(const KeyType&, const std::string&)>&& func) {
+  // The data files rolled out before the fold started are complete, and scanned sequentially.
+  // Their records still in the index are passed to func.
+  FileID activeFileId;
+  std::vector<std::pair<FileID, std::shared_ptr<DataFile>>> files;
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    activeFileId = activeFileId_;
+    VersionedFileTable::Reader reader(fileTable_);
+    files = reader->files();
+  }
+  for (const auto& [fileId, file] : files) {
+    if (fileId >= activeFileId) {
+      break;
+    }
+    DataFileScanner scanner(file.get());
+    Status status;
+    while ((status = scanner.next(false)).ok()) {
+      if (scanner.header().logType_ != LogType::WRITE) {
+        continue;
+      }
+      auto logPos = index_->get(scanner.key());
+      if (logPos.ok() && logPos.value()->fileId_ == fileId &&
+          logPos.value()->pos_ == scanner.offset()) {
+        status = DataFile::verifyRecord(scanner.record().data(), scanner.header().valueSize_);
+        if (!status.ok()) {
+          return status;
+        }
+        func(scanner.key(), scanner.value());
+      }
+    }
+    if (status.code() != Status::Code::kEOF) {
+      return status;
+    }
+  }
+
+  // The active file may have writes in progress, its records are read one by one through the
+  // index instead, along with those of the files rolled out since
   auto iterator = index_->createIterator();
+  // reused for all values
+  std::string value;
   while (auto res = iterator->next()) {
-    auto valueRet = getValueByLogPos(std::move(res->logPos));
-    if (!valueRet.ok()) {
-      return valueRet.status();
+    if (res->logPos->fileId_ < activeFileId) {
+      continue;
+    }
+    auto status = readValue(*res->logPos, &value);
+    if (!status.ok()) {
+      return status;
     }
-    func(res->key, valueRet.value());
+    func(res->key, value);
   }
   return Status::OK();
 }
 
+Status DBImpl::scan(const Range& range,
+                    std::function<bool(const KeyType&, const std::string&)>&& func) {
+  DBIterator iterator(this);
+  for (iterator.seek(range.start); iterator.valid() && iterator.key() < range.limit;
+       iterator.next()) {
+    if (!func(iterator.key(), iterator.value())) {
+      break;
+    }
+  }
+  return iterator.status();
+}
+
+std::unique_ptr<Iterator> DBImpl::newIterator() {
+  return std::make_unique<DBIterator>(this);
+}
+
 bool DBImpl::checkValue(const std::string& value) {
   return value.size() <= FLAGS_max_value_size;
 }
@@ -8,15 +8,34 @@
 #include "bitcask/Types.h"
 #include "db/DataFile.h"
 #include "db/FileLock.h"
+#include "db/FileTable.h"
+#include "db/HintFile.h"
 #include "db/Index.h"
+#include "db/IndexSnapshot.h"
+#include "db/SpaceTracker.h"
+#include "db/ValueCache.h"
+#include "utils/NamedThread.h"
+#include "utils/RateLimiter.h"
 
 DECLARE_uint64(max_value_size);
 DECLARE_uint64(initial_index_size);
+DECLARE_uint64(group_commit_max_bytes);
+DECLARE_uint64(multiget_merge_gap);
+DECLARE_uint32(index_load_threads);
+DECLARE_bool(index_snapshot);
+DECLARE_uint32(merge_check_interval_ms);
 
 namespace bitcask {
 
 class DBImpl : public DB {
   FRIEND_TEST(DBImplTest, PutExceedingFileLimitTest);
+  FRIEND_TEST(DBImplTest, WriteBufferTest);
+  FRIEND_TEST(DBImplTest, DirectIOTest);
+  FRIEND_TEST(DBImplTest, PrecreateNextFileTest);
+  FRIEND_TEST(DBImplTest, IndexSnapshotTest);
+  FRIEND_TEST(DBImplTest, MergeTest);
+  FRIEND_TEST(DBImplTest, FailedWriteTest);
+  FRIEND_TEST(DBImplTest, FailedRollTest);
 
  public:
   DBImpl(const std::string& dbname, const Options& options);
@@ -29,26 +48,50 @@ class DBImpl : public DB {
   // Retrieve a value by key from a Bitcask datastore
   StatusOr<std::string> get(const KeyType& key) override;
 
+  Status get(const KeyType& key, PinnableValue* value) override;
+
+  Status get(const KeyType& key, std::string* value) override;
+
+  std::vector<StatusOr<std::string>> multiGet(const std::vector<KeyType>& keys) override;
+
   // Store a key and value in a Bitcask datastore.
   Status put(const KeyType& key, const std::string& value) override;
 
   // Delete a key from a Bitcask datastore
   Status deleteKey(const KeyType& key) override;
 
+  // Apply all updates in the batch atomically.
+  Status write(const WriteBatch& batch) override;
+
   // List all keys in a Bitcask datastore
   StatusOr<std::vector<KeyType>> listKeys() override;
 
   // Apply func to all key and value in the db. Currently we only support read. No in place update
-  // of values.
+  // of values. The old data files are scanned sequentially with a DataFileScanner, and only the
+  // values of the active file are read through the index. A key written or merged during the fold
+  // may be applied twice.
   Status fold(std::function<void(const KeyType&, const std::string&)>&& func);
 
-  // merge the datafiles in the db
+  Status scan(const Range& range,
+              std::function<bool(const KeyType&, const std::string&)>&& func) override;
+
+  std::unique_ptr<Iterator> newIterator() override;
+
+  // Merge the old data files of the db, on the merge thread, and wait for it to be done. name is
+  // not used, it's always the db itself which is merged. Reads and writes go on during the merge.
   Status merge(const std::string& name) override;
 
   // Force any writes to sync to disk
   Status sync() override;
 
-  // Close a Bitcask data store and flush all pending writes (if any) to disk.
+  WritePosition writtenPosition() const override;
+
+  WritePosition durablePosition() const override;
+
+  Stats stats() const override;
+
+  // Close a Bitcask data store and flush all pending writes (if any) to disk. The index is then
+  // written to its snapshot if FLAGS_index_snapshot, for the next open to load it.
   Status close() override;
 
  private:
@@ -57,35 +100,294 @@ class DBImpl : public DB {
   // protected by the file lock and there can't be race condition on this.
   Status openAllDataFiles();
 
-  // construct in memory index from all data files
+  // construct in memory index from all data files, loaded in parallel by FLAGS_index_load_threads
+  // threads with loadDataFile, and applied to the index in file order. If FLAGS_index_snapshot and
+  // the snapshot of the index matches the data files, it's loaded instead, and only the records
+  // written after it are loaded from the data files.
   // This function should only be called in open. It does not require additional lock as it's
   // protected by the file lock and there can't be race condition on this.
   Status constructIndex();
 
-  // Internally manage active datafile and append logRecord.
+  // Load the updates of the index made by the records of a data file from start into updates, the
+  // last one of each key in the file, with a null location for a delete. They are read from the
+  // hint file of an old data file if it has one and the whole file is loaded, otherwise the data
+  // file is scanned, and the missing hint file is written. A torn tail of the active file is
+  // truncated. Safe to call for different files in parallel.
+  Status loadDataFile(FileID fileId,
+                      FileOffset start,
+                      std::unordered_map<KeyType, std::shared_ptr<LogPos>>* updates);
+
+  // Load the index from its snapshot, if it covers the data files as they are: the same files up to
+  // the position of the snapshot, with none of their records lost. Return the position, after which
+  // the records are to be loaded from the data files. This function should only be called in open.
+  StatusOr<WritePosition> loadIndexSnapshot();
+
+  // Write the snapshot of the index, covering all data files up to their end. The db must not be
+  // written meanwhile. A failure is only logged.
+  void writeIndexSnapshot();
+
+  // Internally manage active datafile and append encoded log records in iovs as a whole.
   // It needs to read the current offset inside active file to determine whether the incoming write
   // will exceed the max file limit. If so, create a new active file. This function is called inside
   // put, so there can be race condition. Need to synchronize on the operations on activeFile_.
-  StatusOr<FileOffset> appendLogRecord(std::unique_ptr<LogRecord>&& logRecod);
+  // Unless appends are buffered, direct or group committed, writers reserve their range of the
+  // active file and write it in parallel under a shared lock of mutex_. Only rolls take it
+  // exclusively.
+  // Return the id of the data file and the offset where the first byte landed.
+  StatusOr<std::pair<FileID, FileOffset>> appendBuffers(struct iovec* iovs, int iovCnt);
+
+  // Encode a log record into an on-stack header and append it along with the value straight from
+  // the caller's buffer, so that no allocation or copy of the value is needed.
+  StatusOr<std::shared_ptr<LogPos>> appendRecord(const KeyType& key,
+                                                 const std::string& value,
+                                                 LogType logType);
+
+  // A write waiting in the group commit queue. The leader fills in the result and wakes it up.
+  struct Writer {
+    Writer(struct iovec* iovs, int iovCnt) : iovs_(iovs), iovCnt_(iovCnt) {
+      for (int i = 0; i < iovCnt; i++) {
+        size_ += iovs[i].iov_len;
+      }
+    }
+
+    struct iovec* iovs_;
+    int iovCnt_;
+    size_t size_{0};
+    Status status_;
+    FileID fileId_{0};
+    FileOffset offset_{0};
+    bool done_{false};
+    std::condition_variable cv_;
+  };
+
+  // Append buffers durably with group commit. Concurrent writers queue up in writers_. The writer
+  // at the front becomes the leader: it takes a group of queued buffers, writes them with one
+  // pwritev, syncs the data file once, and wakes up all followers in the group.
+  Status groupCommit(Writer* writer);
+
+  // Write a group of writers to the active file and sync it. Require holding mutex_.
+  Status writeGroup(const std::vector<Writer*>& group);
+
+  // Scan the log records of a data file from start with a DataFileScanner, and append the
+  // updates of the index they make to entries, in order. The records of a batch are only listed
+  // once the whole batch has been checked. The scan stops at the end of the records, or at a torn
+  // record at the end of the file.
+  // A torn batch is only expected at the end of the active file, and is an error otherwise.
+  // Return the offset where the scan stopped. The file is read as I/O of the given priority.
+  StatusOr<FileOffset> scanDataFile(FileID fileId,
+                                    DataFile* file,
+                                    bool active,
+                                    FileOffset start,
+                                    std::vector<HintEntry>* entries,
+                                    IOPriority priority = IOPriority::kHigh);
+
+  // Scan an immutable data file and write its hint file. A failure is only logged.
+  void writeHintFile(FileID fileId, DataFile* file);
+
+  // Remove a data file and its hint file, if they are there, the hint file first. Return an error,
+  // after logging it, if either could not be removed.
+  Status removeDataFile(FileID fileId);
+
+  // Remove the merged files left by a merge which failed to remove them, in id order. Stop at the
+  // first one which still can't be removed. Called by the merge thread.
+  Status removeMergedFiles();
+
+  // Retire the active data file to the old data files and swap in the next one, pre-created by the
+  // background thread if it's there. The retired file stays readable as it is, until the background
+  // thread has synced it and reopened it read only. The numReserved ids after the active one are
+  // skipped, for the files written by a merge. Require holding mutex_.
+  Status rollActiveFile(FileID numReserved = 0);
+
+  // Sync the retired data file at the front of retiredFiles_, replace it in oldDataFiles_ by a read
+  // only one, write its hint file, and remove it from retiredFiles_. It's closed once the readers
+  // still using it have left. Require not holding mutex_ or bgMutex_.
+  Status retireFile(FileID fileId, DataFile* file);
 
-  // Retrieve values by LogPos
-  StatusOr<std::string> getValueByLogPos(std::shared_ptr<LogPos>&& logPos);
+  // Open the active data file, and set up its write buffer.
+  Status openActiveFile();
+
+  // Create and open a writable data file, with its write buffer set up and its space preallocated
+  // up to options_.maxFileSize.
+  StatusOr<std::unique_ptr<DataFile>> openWritableFile(FileID fileId);
+
+  // Publish a snapshot of the active and old data files to readers. Require holding mutex_
+  // exclusively, or being in open.
+  void publishFileTable();
+
+  // Create an empty index of options_.indexType
+  std::unique_ptr<Index> newIndex() const;
+
+  // Create a data file doing its I/O through options_.ioBackend, with direct I/O if
+  // options_.useDirectIO. The file is not opened yet.
+  std::unique_ptr<DataFile> newDataFile(FileID fileId, bool readOnly);
+
+  // Start and stop the background thread managing data files. It pre-creates the data file of the
+  // next roll, retires the rolled out files, and flushes the write buffer of the active file every
+  // options_.writeBufferFlushIntervalMs. What's left to do when it's stopped is done inline, and
+  // the unused pre-created file is removed.
+  void startBackgroundThread();
+  void stopBackgroundThread();
+  void backgroundWork();
+
+  // Start and stop the merge thread, which runs the merges asked for by merge() one at a time, and
+  // the automatic merges every FLAGS_merge_check_interval_ms if options_.mergeMinDeadRatio is set.
+  // A merge in progress is cut short when it's stopped.
+  void startMergeThread();
+  void stopMergeThread();
+  void mergeWork();
+
+  // Merge all old data files, once the files rolled out so far are retired, or only the ones worth
+  // it by options_.mergeMinDeadRatio and options_.mergeMinFileAgeSec. The active file is rolled
+  // first, past the ids of the merged files, which are reserved for the files written by the
+  // merge, so that the records written from then on replay after the merged ones. The records of
+  // the merged files still in the index are copied to new files along with their hint files, and
+  // the index is moved to them with compareAndPut, so that a key written meanwhile keeps its new
+  // record. Tombstones are copied too while older files are left out of the merge. The merged
+  // files are removed once no reader can see them any more. A read of a key with a location taken
+  // before looks the key up again, see readValues. Called by the merge thread.
+  Status mergeFiles(bool all);
+
+  // Write the records still live of the merged files to the files reserved for the merge, from
+  // firstFileId. Each merged file is published and the index moved to it as soon as it's complete.
+  // Tombstones are kept in files after oldestKept, the oldest file not merged.
+  Status writeMergedFiles(const std::vector<std::pair<FileID, std::shared_ptr<DataFile>>>& files,
+                          FileID firstFileId,
+                          FileID numReserved,
+                          FileID oldestKept);
+
+  // Record a write of size bytes, and wake up the background thread if a sync is due by
+  // SyncPolicy::kBytes.
+  void recordWrite(size_t size);
+
+  // The end of the active file. Require holding mutex_.
+  WritePosition endPosition() const;
+
+  // Stripe of the key in keyLocks_
+  size_t keyStripe(const KeyType& key) const {
+    return static_cast<uint32_t>(key) % kKeyLockStripes;
+  }
+
+  // Sync the active file and the rolled out files not retired yet, without blocking writers during
+  // the sync, and advance the durable position to what was written before.
+  Status syncFiles();
+
+  // Advance the durable position to position, up to which bytesSynced bytes have been written.
+  void advanceDurablePosition(WritePosition position, uint64_t bytesSynced);
+
+  // Look up key in the index, and read its value into value, a PinnableValue or a std::string. If
+  // the data file of the key has been merged away since the lookup, the key is looked up again.
+  template <typename Value>
+  Status getValue(const KeyType& key, Value* value);
+
+  // Read the value at logPos into value, a PinnableValue or a std::string, through the value cache
+  // if it's enabled
+  template <typename Value>
+  Status readValue(const LogPos& logPos, Value* value);
+
+  // Read the value at logPos from the data file it's in
+  template <typename Value>
+  Status readValueFromFile(const LogPos& logPos, Value* value);
+
+  // Read the values at logPoses, through the value cache if it's enabled. The reads of all values
+  // not cached are issued together, in file order, with nearby records merged into one read. An
+  // error in logPoses is returned as is. Results are in the order of logPoses.
+  std::vector<StatusOr<std::string>> readValues(
+      const std::vector<StatusOr<std::shared_ptr<LogPos>>>& logPoses);
+
+  // Same as above for the values of keys at logPoses. The keys whose data file has been merged away
+  // since they were looked up are looked up and read again.
+  std::vector<StatusOr<std::string>> readValues(
+      const std::vector<KeyType>& keys,
+      std::vector<StatusOr<std::shared_ptr<LogPos>>> logPoses);
 
   bool checkValue(const std::string& value);
 
   std::unique_ptr<FileLock> fileLock_{nullptr};
+  // Whether the db has been opened and not closed yet
+  std::atomic<bool> opened_{false};
   FileID activeFileId_{0};
   std::vector<FileID> allFileIds_;
-  std::unique_ptr<DataFile> activeFile_{nullptr};
-  std::unordered_map<FileID, std::unique_ptr<DataFile>> oldDataFiles_;
+  // Shared by the I/O of all data files, null if background I/O is not limited. Declared before
+  // the files, which may still write on destruction.
+  std::unique_ptr<RateLimiter> rateLimiter_{nullptr};
+  // The data files are shared with the snapshots of fileTable_, and closed once they are out of all
+  // of them. Protected by mutex_, readers go through fileTable_ instead.
+  std::shared_ptr<DataFile> activeFile_{nullptr};
+  std::unordered_map<FileID, std::shared_ptr<DataFile>> oldDataFiles_;
+  // Snapshots of the data files for lock free reads, published on every change of the files
+  VersionedFileTable fileTable_;
+  // Live and dead bytes of the data files, kept up to date by index_
+  SpaceTracker space_;
   std::unique_ptr<Index> index_{nullptr};
+  // null if disabled
+  std::unique_ptr<ValueCache> valueCache_{nullptr};
 
   mutable std::shared_mutex mutex_;
 
+  // Writes of the same key are serialized from the append to the index update, so that the index
+  // ends up with the record appended last, as a replay of the data files would.
+  static constexpr size_t kKeyLockStripes = 256;
+  std::array<std::mutex, kKeyLockStripes> keyLocks_;
+
+  // group commit queue, protected by writersMutex_
+  std::mutex writersMutex_;
+  std::deque<Writer*> writers_;
+  // iovecs of a group commit, reused across groups. Protected by mutex_.
+  std::vector<struct iovec> groupIovs_;
+
+  thread::NamedThread bgThread_;
+  // Protects the background work below. Acquired after mutex_ if both are needed.
+  std::mutex bgMutex_;
+  // wakes up the background thread
+  std::condition_variable bgCv_;
+  // signals the background work done
+  std::condition_variable bgDoneCv_;
+  bool bgRunning_{false};
+  bool bgStopping_{false};
+  // The data file pre-created for the next roll, if it's ready, and its id
+  std::unique_ptr<DataFile> nextFile_;
+  FileID nextFileId_{0};
+  bool creatingNextFile_{false};
+  // Rolled out data files waiting to be retired, in roll order. They are owned by oldDataFiles_.
+  std::deque<std::pair<FileID, DataFile*>> retiredFiles_;
+
+  thread::NamedThread mergeThread_;
+  // Protects the merge requests below. Not held during a merge.
+  std::mutex mergeMutex_;
+  // wakes up the merge thread
+  std::condition_variable mergeCv_;
+  // signals a merge done
+  std::condition_variable mergeDoneCv_;
+  bool mergeRunning_{false};
+  // Checked by a merge in progress too
+  std::atomic<bool> mergeStopping_{false};
+  // Merges asked for and done so far, and the status of the last one done
+  uint64_t mergesRequested_{0};
+  uint64_t mergesDone_{0};
+  Status mergeStatus_;
+  // Merges which have merged files, automatic ones included
+  std::atomic<uint64_t> merges_{0};
+  // Merged files still on disk, in id order. Their tombstones may still be needed to hide the
+  // records of the older ones on open. Only used by the merge thread.
+  std::set<FileID> mergedFilesLeft_;
+
+  // Serializes syncs out of mutex_. A retired file is only replaced while holding it, so that the
+  // data files being synced stay alive. Acquired before mutex_.
+  std::mutex syncMutex_;
+  // Total bytes written, and synced, since open
+  std::atomic<uint64_t> bytesWritten_{0};
+  std::atomic<uint64_t> bytesSynced_{0};
+  mutable std::mutex durableMutex_;
+  WritePosition durablePosition_;
+
   friend class DB;
+  friend class DBIterator;
 
   const Options options_;
   const std::string dbname_;
+  const SyncPolicy syncPolicy_;
+  // Whether writers reserve ranges of the active file and write them in parallel
+  const bool concurrentAppends_;
 
   const std::string fileLockName_ = "LOCK";
 };
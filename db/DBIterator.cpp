@@ -0,0 +1,170 @@
+#include "db/DBIterator.h"
+
+DEFINE_uint32(iterator_batch_size,
+              64,
+              "Number of keys an iterator loads at once, reading their values together");
+
+namespace bitcask {
+
+DBIterator::DBIterator(DBImpl* db)
+    : db_(db), orderedIndex_(dynamic_cast<const OrderedIndex*>(db->index_.get())) {}
+
+bool DBIterator::valid() const {
+  return pos_ < keys_.size();
+}
+
+void DBIterator::seekToFirst() {
+  load(std::numeric_limits<KeyType>::min(), true);
+}
+
+void DBIterator::seekToLast() {
+  load(std::numeric_limits<KeyType>::max(), false);
+}
+
+void DBIterator::seek(const KeyType& target) {
+  load(target, true);
+}
+
+void DBIterator::seekForPrev(const KeyType& target) {
+  load(target, false);
+}
+
+void DBIterator::next() {
+  assert(valid());
+  auto key = keys_[pos_];
+  if (forward_ && (++pos_ < keys_.size() || !more_)) {
+    return;
+  }
+  if (key == std::numeric_limits<KeyType>::max()) {
+    clear();
+    return;
+  }
+  load(key + 1, true);
+}
+
+void DBIterator::prev() {
+  assert(valid());
+  auto key = keys_[pos_];
+  if (!forward_ && (++pos_ < keys_.size() || !more_)) {
+    return;
+  }
+  if (key == std::numeric_limits<KeyType>::min()) {
+    clear();
+    return;
+  }
+  load(key - 1, false);
+}
+
+KeyType DBIterator::key() const {
+  assert(valid());
+  return keys_[pos_];
+}
+
+const std::string& DBIterator::value() const {
+  assert(valid());
+  return values_[pos_];
+}
+
+Status DBIterator::status() const {
+  return status_;
+}
+
+void DBIterator::load(KeyType key, bool forward) {
+  clear();
+  forward_ = forward;
+  status_ = Status::OK();
+  // A chunk whose keys were all removed since they were collected is skipped, as it would end the
+  // iteration otherwise
+  while (loadChunk(key, forward)) {
+    key = forward ? key + 1 : key - 1;
+  }
+}
+
+bool DBIterator::loadChunk(KeyType& key, bool forward) {
+  std::vector<Index::IterRes> entries;
+  more_ = collect(key, forward, std::max<uint32_t>(1, FLAGS_iterator_batch_size), &entries);
+  if (!status_.ok() || entries.empty()) {
+    more_ = false;
+    return false;
+  }
+  if (afterCollect_) {
+    afterCollect_();
+  }
+
+  std::vector<KeyType> keys;
+  std::vector<StatusOr<std::shared_ptr<LogPos>>> logPoses;
+  keys.reserve(entries.size());
+  logPoses.reserve(entries.size());
+  for (const auto& entry : entries) {
+    keys.emplace_back(entry.key);
+    logPoses.emplace_back(entry.logPos);
+  }
+  auto values = db_->readValues(keys, std::move(logPoses));
+  keys_.reserve(entries.size());
+  values_.reserve(entries.size());
+  for (size_t i = 0; i < entries.size(); i++) {
+    if (!values[i].ok() && values[i].status().code() == Status::Code::kNotFound) {
+      // removed since it was collected
+      continue;
+    }
+    if (!values[i].ok()) {
+      status_ = values[i].status();
+      clear();
+      more_ = false;
+      return false;
+    }
+    keys_.emplace_back(entries[i].key);
+    values_.emplace_back(std::move(values[i]).value());
+  }
+  key = entries.back().key;
+  auto last = forward ? std::numeric_limits<KeyType>::max() : std::numeric_limits<KeyType>::min();
+  if (keys_.empty() && more_ && key == last) {
+    more_ = false;
+  }
+  return keys_.empty() && more_;
+}
+
+bool DBIterator::collect(KeyType key,
+                         bool forward,
+                         size_t maxCount,
+                         std::vector<Index::IterRes>* entries) {
+  if (orderedIndex_) {
+    orderedIndex_->collect(key, forward, maxCount, entries);
+    return entries->size() == maxCount;
+  }
+
+  if (!keysCopied_) {
+    auto keys = db_->index_->listKeys();
+    if (!keys.ok()) {
+      status_ = keys.status();
+      return false;
+    }
+    sortedKeys_ = std::move(keys).value();
+    std::sort(sortedKeys_.begin(), sortedKeys_.end());
+    keysCopied_ = true;
+  }
+  auto collectFrom = [&](auto it, auto end) {
+    for (; it != end && entries->size() < maxCount; ++it) {
+      auto logPos = db_->index_->get(*it);
+      if (logPos.ok()) {
+        entries->push_back({*it, std::move(logPos).value()});
+      }
+    }
+  };
+  if (forward) {
+    collectFrom(std::lower_bound(sortedKeys_.begin(), sortedKeys_.end(), key), sortedKeys_.end());
+  } else {
+    collectFrom(std::make_reverse_iterator(
+                    std::upper_bound(sortedKeys_.begin(), sortedKeys_.end(), key)),
+                sortedKeys_.rend());
+  }
+  return entries->size() == maxCount;
+}
+
+void DBIterator::clear() {
+  keys_.clear();
+  values_.clear();
+  pos_ = 0;
+}
+
+}  // namespace bitcask
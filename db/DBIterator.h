@@ -0,0 +1,83 @@
+#ifndef DB_DB_ITERATOR_H_
+#define DB_DB_ITERATOR_H_
+
+#include <gtest/gtest_prod.h>
+
+#include "bitcask/Iterator.h"
+#include "db/DBImpl.h"
+#include "db/OrderedIndex.h"
+
+DECLARE_uint32(iterator_batch_size);
+
+namespace bitcask {
+
+// DBIterator loads the keys of the db a chunk of FLAGS_iterator_batch_size at a time, in the
+// direction it's moving, and reads the values of a chunk together with DBImpl::readValues. A
+// chunk is loaded from the next key after the last one when the iterator moves out of it.
+//
+// With an OrderedIndex, chunks are collected from the tree. With other indexes, a sorted copy of
+// all keys is taken on the first seek, and the keys removed since are skipped.
+class DBIterator : public Iterator {
+  FRIEND_TEST(DBImplTest, IteratorRemovedChunkTest);
+
+ public:
+  explicit DBIterator(DBImpl* db);
+
+  bool valid() const override;
+
+  void seekToFirst() override;
+
+  void seekToLast() override;
+
+  void seek(const KeyType& target) override;
+
+  void seekForPrev(const KeyType& target) override;
+
+  void next() override;
+
+  void prev() override;
+
+  KeyType key() const override;
+
+  const std::string& value() const override;
+
+  Status status() const override;
+
+ private:
+  // Load the chunk of keys from key, in order if forward or in reverse order otherwise, and
+  // position at its first key
+  void load(KeyType key, bool forward);
+
+  // Load one chunk from key. Return true if all of its keys were removed since they were collected
+  // and more may follow, with key set to the last one collected.
+  bool loadChunk(KeyType& key, bool forward);
+
+  // Append to entries up to maxCount keys along with their locations, as OrderedIndex::collect
+  // does. Return whether there may be more keys after them.
+  bool collect(KeyType key, bool forward, size_t maxCount, std::vector<Index::IterRes>* entries);
+
+  void clear();
+
+  DBImpl* db_;
+  // null if the index of the db is not ordered
+  const OrderedIndex* orderedIndex_;
+  // The sorted copy of all keys, if the index is not ordered
+  std::vector<KeyType> sortedKeys_;
+  bool keysCopied_{false};
+
+  // The current chunk, in the order it's iterated
+  std::vector<KeyType> keys_;
+  std::vector<std::string> values_;
+  size_t pos_{0};
+  bool forward_{true};
+  // Whether there may be more keys after the chunk
+  bool more_{false};
+  Status status_;
+
+  // Called between collecting the keys of a chunk and reading their values, by tests
+  std::function<void()> afterCollect_;
+};
+
+}  // namespace bitcask
+
+#endif  // DB_DB_ITERATOR_H_
@@ -2,13 +2,69 @@
 
 #include "utils/Crc.h"
 #include "utils/Helper.h"
+#include "utils/WallClock.h"
 
 namespace bitcask {
 
-DataFile::DataFile(const std::string dirPath, const uint32_t fileId, bool readOnly) {
+namespace {
+
+int64_t alignDown(int64_t n) {
+  return n / kDirectIOAlignment * kDirectIOAlignment;
+}
+
+int64_t alignUp(int64_t n) {
+  return alignDown(n + kDirectIOAlignment - 1);
+}
+
+// Check the crc of a record given as the first headerSize bytes, and the rest of it, which need not
+// follow them in memory.
+Status verifyCrc(const char* header, size_t headerSize, const char* rest, size_t restSize) {
+  uint32_t retrievedCRC = 0;
+  std::memcpy(&retrievedCRC, header, sizeof(retrievedCRC));
+  auto calculatedCRC = LogRecord::computeCrc(header, headerSize, rest, restSize);
+  if (calculatedCRC != retrievedCRC) {
+    FLOG_ERROR(
+        "CRC validation failed. Crc of read data: {}. Should be {}.", calculatedCRC, retrievedCRC);
+    return Status::ERROR(Status::Code::kError, "CRC validation failed");
+  }
+  return Status::OK();
+}
+
+// Check the crc of a record contiguous in memory
+Status verifyRecordCrc(const char* record, size_t valueSize) {
+  return verifyCrc(record, kLogHeaderAndKeySize, record + kLogHeaderAndKeySize, valueSize);
+}
+
+// Charges a read of a value to the rate limiter as foreground I/O, with its latency, when it's done
+class ForegroundRead {
+ public:
+  ForegroundRead(RateLimiter* limiter, size_t bytes)
+      : limiter_(limiter),
+        bytes_(bytes),
+        startUs_(limiter ? time::WallClock::fastNowInMicroSec() : 0) {}
+
+  ~ForegroundRead() {
+    if (limiter_) {
+      limiter_->recordForeground(bytes_, time::WallClock::fastNowInMicroSec() - startUs_);
+    }
+  }
+
+ private:
+  RateLimiter* limiter_;
+  size_t bytes_;
+  int64_t startUs_;
+};
+
+}  // namespace
+
+DataFile::DataFile(const std::string dirPath,
+                   const uint32_t fileId,
+                   bool readOnly,
+                   bool directIO) {
   fileName_ = fmt::format("{}/{}.data", dirPath, fileId);
   curWriteOffset_ = 0;
   readOnly_ = readOnly;
+  directIO_ = directIO;
   fileId_ = fileId;
 }
 
@@ -16,10 +72,12 @@ Status DataFile::openDataFile() {
   // std::unique_lock<std::shared_mutex> fileLock(fileMutex_);
   if (readOnly_) {
     FLOG_INFO("Open data file {} in read only mode.", fileName_);
-    fd_ = open(fileName_.c_str(), O_RDONLY, 0444);
+    fd_ = open(fileName_.c_str(), O_RDONLY | (directIO_ ? O_DIRECT : 0), 0444);
   } else {
     FLOG_INFO("Open data file {} in read write mode.", fileName_);
-    fd_ = open(fileName_.c_str(), O_CREAT | O_RDWR | O_APPEND, 0644);
+    // No O_APPEND: all writes are positional, either to rewrite the tail block of direct I/O, or to
+    // the ranges reserved by concurrent writers.
+    fd_ = open(fileName_.c_str(), O_CREAT | O_RDWR | (directIO_ ? O_DIRECT : 0), 0644);
     off_t fileSize = lseek(fd_, 0, SEEK_END);
     if (fileSize == (off_t)-1) {
       FLOG_ERROR("open data file error: {}", std::string(strerror(errno)));
@@ -27,6 +85,19 @@ Status DataFile::openDataFile() {
                            "Error seeking file: " + std::string(strerror(errno)));
     }
     curWriteOffset_ = fileSize;
+    if (directIO_) {
+      std::unique_lock<std::shared_mutex> lock(bufferMutex_);
+      auto status = allocateWriteBufferLocked(kDirectIOStagingSize);
+      if (status.ok()) {
+        status = loadTailBlockLocked();
+      }
+      if (!status.ok()) {
+        close(fd_);
+        fd_ = -1;
+        return status;
+      }
+      writeThrough_ = true;
+    }
   }
 
   if (fd_ == -1) {
@@ -35,13 +106,73 @@ Status DataFile::openDataFile() {
                          "Error opening file: " + std::string(strerror(errno)));
   } else {
     FVLOG1("[DataFile] Opened data file {} with file descriptor: {}", fileId_, fd_);
+    if (readOnly_) {
+      // The size never changes
+      off_t fileSize = lseek(fd_, 0, SEEK_END);
+      if (fileSize == (off_t)-1) {
+        FLOG_ERROR("open data file error: {}", std::string(strerror(errno)));
+        close(fd_);
+        fd_ = -1;
+        return Status::ERROR(Status::Code::kOpenFileError,
+                             "Error seeking file: " + std::string(strerror(errno)));
+      }
+      curWriteOffset_ = fileSize;
+    }
+    if (readOnly_ && mmapReads_ && !directIO_) {
+      mapFile();
+    }
     return Status::OK();
   }
 }
 
+void DataFile::mapFile() {
+  struct stat st;
+  if (fstat(fd_, &st) == -1) {
+    FLOG_WARN("Failed to stat data file {}, not mapped: {}", fileId_, std::string(strerror(errno)));
+    return;
+  }
+  if (st.st_size == 0) {
+    // nothing to map, every read is past the end anyway
+    return;
+  }
+  void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd_, 0);
+  if (addr == MAP_FAILED) {
+    FLOG_WARN("Failed to map data file {}: {}", fileId_, std::string(strerror(errno)));
+    return;
+  }
+  mmapBase_ = static_cast<char*>(addr);
+  mmapSize_ = st.st_size;
+  mapping_ = std::shared_ptr<const void>(
+      addr, [size = mmapSize_](const void* p) { munmap(const_cast<void*>(p), size); });
+  // Point lookups by key don't benefit from readahead
+  adviseAccess(MADV_RANDOM);
+  FVLOG1("[DataFile] Mapped {} bytes of data file {}", mmapSize_, fileId_);
+}
+
+void DataFile::adviseAccess(int advice) {
+  if (mmapBase_ && madvise(mmapBase_, mmapSize_, advice) == -1) {
+    FLOG_WARN(
+        "madvise {} on data file {} failed: {}", advice, fileId_, std::string(strerror(errno)));
+  }
+}
+
 Status DataFile::closeDataFile() {
   // std::unique_lock<std::shared_mutex> fileLock(fileMutex_);
   if (fd_ != -1) {
+    auto status = flushWriteBuffer();
+    if (!status.ok()) {
+      FLOG_ERROR("Failed to flush write buffer of data file {}: {}", fileId_, status.toString());
+    }
+    // Trim the padding of the tail block and the unused preallocated space
+    if (!readOnly_ && (directIO_ || preallocated_) && ftruncate(fd_, curWriteOffset_) == -1) {
+      FLOG_ERROR("Failed to trim data file {}: {}", fileId_, std::string(strerror(errno)));
+    }
+    if (mmapBase_) {
+      // Values pinned to the mapping keep it alive
+      mapping_.reset();
+      mmapBase_ = nullptr;
+      mmapSize_ = 0;
+    }
     FVLOG1("[DataFile] Closing data file {} with fd: {}", fileId_, fd_);
     close(fd_);
     fd_ = -1;
@@ -53,6 +184,10 @@ Status DataFile::closeDataFile() {
 }
 
 StatusOr<std::unique_ptr<LogRecord>> DataFile::readLogRecord(FileOffset pos) {
+  if (mmapBase_) {
+    return readMappedLogRecord(pos, -1);
+  }
+
   // reader header first
   char headerBuf[kLogHeaderSize];
   auto status = readNBytes(pos, kLogHeaderSize, headerBuf);
@@ -68,8 +203,13 @@ StatusOr<std::unique_ptr<LogRecord>> DataFile::readLogRecord(FileOffset pos) {
          header->keySize_,
          header->valueSize_);
 
+  // Keys are never empty, so a zeroed header is the padding of a direct I/O write which was not
+  // trimmed, e.g. after a crash. Nothing follows it.
+  if (header->keySize_ == 0 && header->crc_ == 0 && header->tstamp_ == 0) {
+    return Status::ERROR(Status::Code::kEOF, "EOF");
+  }
+
   auto valueSize = header->valueSize_;
-  auto retrievedCRC = header->crc_;
   auto kvSize = sizeof(KeyType) + valueSize;
 
   // Read key and value
@@ -84,23 +224,19 @@ StatusOr<std::unique_ptr<LogRecord>> DataFile::readLogRecord(FileOffset pos) {
   auto logRecord = std::make_unique<LogRecord>(std::move(header));
   logRecord->loadKVFromBuf(kvBuf, sizeof(KeyType), valueSize);
 
-  // Reconstruct the encoded data for CRC calculation
-  size_t sizeWithoutCRC = kLogHeaderSize - sizeof(retrievedCRC) + kvSize;
-  char data[sizeWithoutCRC];
-  std::memcpy(data, headerBuf + sizeof(retrievedCRC), kLogHeaderSize - sizeof(retrievedCRC));
-  std::memcpy(data + kLogHeaderSize - sizeof(retrievedCRC), kvBuf, kvSize);
-
-  uint32_t calculatedCRC = crc::crc32(data, sizeWithoutCRC);
-  if (calculatedCRC != retrievedCRC) {
-    FLOG_ERROR(
-        "CRC validation failed. Crc of read data: {}. Should be {}.", calculatedCRC, retrievedCRC);
-    return Status::ERROR(Status::Code::kError, "CRC validation failed");
+  status = verifyCrc(headerBuf, kLogHeaderSize, kvBuf, kvSize);
+  if (!status.ok()) {
+    return status;
   }
 
   return logRecord;
 }
 
 StatusOr<std::unique_ptr<LogRecord>> DataFile::readLogRecord(FileOffset pos, uint16_t valueSize) {
+  if (mmapBase_) {
+    return readMappedLogRecord(pos, valueSize);
+  }
+
   // reader header first
   size_t recordSize = kLogHeaderSize + sizeof(KeyType) + valueSize;
   char logBuf[recordSize];
@@ -119,46 +255,178 @@ StatusOr<std::unique_ptr<LogRecord>> DataFile::readLogRecord(FileOffset pos, uin
          header->keySize_,
          header->valueSize_);
 
-  auto retrievedCRC = header->crc_;
   auto logRecord = std::make_unique<LogRecord>(std::move(header));
   logRecord->loadKVFromBuf(logBuf + kLogHeaderSize, sizeof(KeyType), valueSize);
 
-  // Reconstruct the encoded data for CRC calculation
-  size_t sizeWithoutCRC = recordSize - sizeof(retrievedCRC);
-  char data[sizeWithoutCRC];
-  std::memcpy(data, logBuf + sizeof(retrievedCRC), recordSize - sizeof(retrievedCRC));
+  status = verifyCrc(logBuf, kLogHeaderSize, logBuf + kLogHeaderSize, recordSize - kLogHeaderSize);
+  if (!status.ok()) {
+    return status;
+  }
 
-  uint32_t calculatedCRC = crc::crc32(data, sizeWithoutCRC);
-  if (calculatedCRC != retrievedCRC) {
-    FLOG_ERROR(
-        "CRC validation failed. Crc of read data: {}. Should be {}.", calculatedCRC, retrievedCRC);
-    return Status::ERROR(Status::Code::kError, "CRC validation failed");
+  return logRecord;
+}
+
+StatusOr<std::unique_ptr<LogRecord>> DataFile::readMappedLogRecord(FileOffset pos,
+                                                                   int32_t valueSize) {
+  if (pos < 0 || pos + kLogHeaderSize > mmapSize_) {
+    return Status::ERROR(Status::Code::kEOF, "EOF");
+  }
+  const char* record = mmapBase_ + pos;
+  auto header = LogRecord::decodeLogRecordHeader(record);
+  if (header->keySize_ == 0 && header->crc_ == 0 && header->tstamp_ == 0) {
+    return Status::ERROR(Status::Code::kEOF, "EOF");
+  }
+  if (valueSize < 0) {
+    valueSize = header->valueSize_;
+  }
+  size_t recordSize = kLogHeaderSize + sizeof(KeyType) + valueSize;
+  if (pos + recordSize > mmapSize_) {
+    return Status::ERROR(Status::Code::kEOF, "EOF");
   }
 
+  // The record is contiguous in the mapping, so the crc is computed in place
+  auto status =
+      verifyCrc(record, kLogHeaderSize, record + kLogHeaderSize, recordSize - kLogHeaderSize);
+  if (!status.ok()) {
+    return status;
+  }
+
+  auto logRecord = std::make_unique<LogRecord>(std::move(header));
+  logRecord->loadKVFromBuf(record + kLogHeaderSize, sizeof(KeyType), valueSize);
   return logRecord;
 }
 
+Status DataFile::readValue(FileOffset pos, uint16_t valueSize, PinnableValue* value) {
+  size_t recordSize = kLogHeaderAndKeySize + valueSize;
+  if (mmapBase_) {
+    if (pos < 0 || pos + recordSize > mmapSize_) {
+      return Status::ERROR(Status::Code::kEOF, "EOF");
+    }
+    const char* record = mmapBase_ + pos;
+    auto status = verifyRecordCrc(record, valueSize);
+    if (!status.ok()) {
+      return status;
+    }
+    value->pin(record + kLogHeaderAndKeySize, valueSize, mapping_);
+    return Status::OK();
+  }
+
+  ForegroundRead charge(rateLimiter_, recordSize);
+  auto* buf = value->buffer();
+  buf->resize(recordSize);
+  auto status = readNBytes(pos, recordSize, buf->data());
+  if (!status.ok()) {
+    return status;
+  }
+  status = verifyRecordCrc(buf->data(), valueSize);
+  if (!status.ok()) {
+    return status;
+  }
+  value->setFromBuffer(kLogHeaderAndKeySize, valueSize);
+  return Status::OK();
+}
+
+Status DataFile::readValue(FileOffset pos, uint16_t valueSize, std::string* value) {
+  if (mmapBase_) {
+    if (pos < 0 || pos + kLogHeaderAndKeySize + valueSize > mmapSize_) {
+      return Status::ERROR(Status::Code::kEOF, "EOF");
+    }
+    const char* record = mmapBase_ + pos;
+    auto status = verifyRecordCrc(record, valueSize);
+    if (!status.ok()) {
+      return status;
+    }
+    value->assign(record + kLogHeaderAndKeySize, valueSize);
+    return Status::OK();
+  }
+
+  ForegroundRead charge(rateLimiter_, kLogHeaderAndKeySize + valueSize);
+  if (buffer_ || directIO_) {
+    // The record may be in the write buffer, or is read in aligned blocks anyway. Read it as a
+    // whole and move the value in place.
+    value->resize(kLogHeaderAndKeySize + valueSize);
+    auto status = readNBytes(pos, value->size(), value->data());
+    if (status.ok()) {
+      status = verifyRecordCrc(value->data(), valueSize);
+    }
+    if (!status.ok()) {
+      return status;
+    }
+    value->erase(0, kLogHeaderAndKeySize);
+    return Status::OK();
+  }
+
+  char headerAndKey[kLogHeaderAndKeySize];
+  value->resize(valueSize);
+  struct iovec iovs[2] = {{headerAndKey, kLogHeaderAndKeySize}, {value->data(), valueSize}};
+  auto status = io_->readv(fd_, iovs, 2, pos, kLogHeaderAndKeySize + valueSize);
+  if (!status.ok()) {
+    return status;
+  }
+  return verifyCrc(headerAndKey, kLogHeaderAndKeySize, value->data(), valueSize);
+}
+
 Status DataFile::readNBytes(int64_t offset, int64_t size, char* buf) {
-  size_t totalRead = 0;
-  while (totalRead < size) {
-    auto bytesRead = pread(fd_, buf + totalRead, size - totalRead, offset + totalRead);
-    if (bytesRead == -1) {
-      if (errno == EINTR) {
-        continue;
-      } else {
-        FLOG_ERROR("Read failure: {}", std::string(strerror(errno)));
-        return Status::ERROR(Status::Code::kError, "Read failure: " + std::string(strerror(errno)));
-      }
-    } else if (bytesRead == 0) {
+  if (mmapBase_) {
+    if (offset < 0 || offset + size > static_cast<int64_t>(mmapSize_)) {
       return Status::ERROR(Status::Code::kEOF, "EOF");
     }
-    totalRead += bytesRead;
+    std::memcpy(buf, mmapBase_ + offset, size);
+    return Status::OK();
+  }
+  if (buffer_) {
+    std::shared_lock<std::shared_mutex> lock(bufferMutex_);
+    if (offset + size > bufferOffset_) {
+      // (part of) the bytes are still in the write buffer
+      if (offset + size > bufferOffset_ + static_cast<int64_t>(bufferSize_)) {
+        return Status::ERROR(Status::Code::kEOF, "EOF");
+      }
+      auto fileSize = std::max<int64_t>(0, bufferOffset_ - offset);
+      if (fileSize > 0) {
+        auto status = preadAll(offset, fileSize, buf);
+        if (!status.ok()) {
+          return status;
+        }
+      }
+      std::memcpy(
+          buf + fileSize, buffer_.get() + (offset + fileSize - bufferOffset_), size - fileSize);
+      return Status::OK();
+    }
+  }
+  return preadAll(offset, size, buf);
+}
+
+Status DataFile::preadAll(int64_t offset, int64_t size, char* buf) {
+  auto status = directIO_ ? preadDirect(offset, size, buf) : io_->read(fd_, buf, size, offset);
+  if (!status.ok()) {
+    return status;
   }
 
   FVLOG3("reading {} bytes from {}: {}", size, offset, hexify(buf, size));
   return Status::OK();
 }
 
+Status DataFile::preadDirect(int64_t offset, int64_t size, char* buf) {
+  auto windowOffset = alignDown(offset);
+  auto windowSize = alignUp(offset + size) - windowOffset;
+  void* window = nullptr;
+  if (posix_memalign(&window, kDirectIOAlignment, windowSize) != 0) {
+    return Status::ERROR(Status::Code::kError, "Failed to allocate direct I/O read buffer");
+  }
+  std::unique_ptr<char, FreeDeleter> windowGuard(static_cast<char*>(window));
+
+  // The last block may be short, as the file is trimmed to its logical size on close
+  auto ret = io_->readSome(fd_, windowGuard.get(), windowSize, windowOffset);
+  if (!ret.ok()) {
+    return ret.status();
+  }
+  if (static_cast<int64_t>(ret.value()) < offset + size - windowOffset) {
+    return Status::ERROR(Status::Code::kEOF, "EOF");
+  }
+  std::memcpy(buf, windowGuard.get() + (offset - windowOffset), size);
+  return Status::OK();
+}
+
 StatusOr<FileOffset> DataFile::writeLogRecord(std::unique_ptr<LogRecord>&& log) {
   FVLOG2("[DataFile] Writing to data file: {}", fileId_);
 
@@ -168,24 +436,307 @@ StatusOr<FileOffset> DataFile::writeLogRecord(std::unique_ptr<LogRecord>&& log)
   char* buf = log->getEncodedBuffer();
   size_t totalSize = log->getTotalSize();
   FVLOG3("log to write: {}", hexify(buf, totalSize));
-  FileOffset recordPos = 0;
-  // std::unique_lock<std::shared_mutex> fileLock(fileMutex_);
-  size_t bytesWritten = 0;
-  while (bytesWritten < totalSize) {
-    ssize_t result =
-        pwrite(fd_, buf + bytesWritten, totalSize - bytesWritten, curWriteOffset_ + bytesWritten);
-    if (result == -1) {
-      FLOG_ERROR("Write failure: {}", std::string(strerror(errno)));
-      return Status::ERROR(Status::Code::kError, "Write failure" + std::string(strerror(errno)));
+  return writeBuffer(buf, totalSize);
+}
+
+StatusOr<FileOffset> DataFile::writeLogRecords(const std::vector<LogRecord*>& logs) {
+  FVLOG2("[DataFile] Writing {} log records to data file: {}", logs.size(), fileId_);
+
+  std::vector<struct iovec> iovs;
+  iovs.reserve(logs.size());
+  for (auto* log : logs) {
+    log->encode();
+    iovs.push_back({log->getEncodedBuffer(), log->getTotalSize()});
+  }
+  return writeBuffers(iovs);
+}
+
+StatusOr<FileOffset> DataFile::writeBuffer(const char* buf, size_t size) {
+  struct iovec iov = {const_cast<char*>(buf), size};
+  return writeBuffers(&iov, 1);
+}
+
+StatusOr<FileOffset> DataFile::writeBuffers(struct iovec* iovs, int iovCnt) {
+  size_t totalSize = 0;
+  for (int i = 0; i < iovCnt; i++) {
+    totalSize += iovs[i].iov_len;
+  }
+
+  Status status;
+  if (buffer_) {
+    std::unique_lock<std::shared_mutex> lock(bufferMutex_);
+    status = appendToWriteBuffer(iovs, iovCnt, totalSize);
+    if (status.ok() && writeThrough_) {
+      status = flushWriteBufferLocked();
     }
-    bytesWritten += result;
+  } else {
+    status = pwriteAll(iovs, iovCnt, curWriteOffset_, totalSize);
+  }
+  if (!status.ok()) {
+    return status;
   }
 
-  recordPos = curWriteOffset_;
+  FileOffset recordPos = curWriteOffset_;
   curWriteOffset_ += totalSize;
   return recordPos;
 }
 
+FileOffset DataFile::reserve(size_t size, size_t limit) {
+  DCHECK(!buffer_);
+  auto offset = curWriteOffset_.load();
+  do {
+    if (failed_ || (offset > 0 && offset + size > limit)) {
+      return -1;
+    }
+  } while (!curWriteOffset_.compare_exchange_weak(offset, offset + size));
+  return offset;
+}
+
+Status DataFile::writeBuffersAt(struct iovec* iovs,
+                                int iovCnt,
+                                FileOffset offset,
+                                size_t totalSize) {
+  return pwriteAll(iovs, iovCnt, offset, totalSize);
+}
+
+Status DataFile::padAt(FileOffset offset, size_t size) {
+  DCHECK_GE(size, kLogHeaderAndKeySize);
+  constexpr size_t kMaxRecordSize = kLogHeaderAndKeySize + UINT16_MAX;
+  std::string buf(size, '\0');
+  auto tstamp = time::WallClock::fastNowInMicroSec();
+  size_t pos = 0;
+  while (pos < size) {
+    auto recordSize = std::min(size - pos, kMaxRecordSize);
+    if (size - pos - recordSize > 0 && size - pos - recordSize < kLogHeaderAndKeySize) {
+      // Leave enough for a last record
+      recordSize -= kLogHeaderAndKeySize;
+    }
+    auto valueSize = static_cast<uint16_t>(recordSize - kLogHeaderAndKeySize);
+    LogRecord::encodeHeader(
+        &buf[pos], 0, &buf[pos + kLogHeaderAndKeySize], valueSize, LogType::PADDING, tstamp);
+    pos += recordSize;
+  }
+  struct iovec iov = {buf.data(), size};
+  return pwriteAll(&iov, 1, offset, size);
+}
+
+Status DataFile::pwriteAll(struct iovec* iovs, int iovCnt, FileOffset offset, size_t totalSize) {
+  if (rateLimiter_) {
+    rateLimiter_->request(totalSize, writePriority_);
+  }
+  return io_->writev(fd_, iovs, iovCnt, offset, totalSize);
+}
+
+void DataFile::enableWriteBuffer(size_t capacity) {
+  std::unique_lock<std::shared_mutex> lock(bufferMutex_);
+  if (directIO_) {
+    auto status = allocateWriteBufferLocked(capacity);
+    if (!status.ok()) {
+      FLOG_ERROR("Failed to resize staging buffer to {} bytes: {}", capacity, status.toString());
+      return;
+    }
+    writeThrough_ = false;
+    return;
+  }
+  // Aligned to the page size, so that flushes are page aligned copies
+  void* buf = nullptr;
+  if (posix_memalign(&buf, kWriteBufferAlignment, capacity) != 0) {
+    FLOG_ERROR("Failed to allocate write buffer of {} bytes, write through instead", capacity);
+    return;
+  }
+  buffer_.reset(static_cast<char*>(buf));
+  bufferCapacity_ = capacity;
+  bufferSize_ = 0;
+  bufferOffset_ = curWriteOffset_;
+}
+
+Status DataFile::allocateWriteBufferLocked(size_t capacity) {
+  // Only whole blocks are written, so the buffer is made of whole blocks
+  capacity = alignUp(std::max<int64_t>(capacity, kDirectIOAlignment));
+  auto status = flushWriteBufferLocked();
+  if (!status.ok()) {
+    return status;
+  }
+  void* buf = nullptr;
+  if (posix_memalign(&buf, kDirectIOAlignment, capacity) != 0) {
+    return Status::ERROR(Status::Code::kError, "Failed to allocate direct I/O staging buffer");
+  }
+  if (buffer_) {
+    // the carried over tail block
+    std::memcpy(buf, buffer_.get(), bufferSize_);
+  } else {
+    bufferOffset_ = curWriteOffset_;
+  }
+  buffer_.reset(static_cast<char*>(buf));
+  bufferCapacity_ = capacity;
+  return Status::OK();
+}
+
+Status DataFile::loadTailBlockLocked() {
+  bufferOffset_ = alignDown(curWriteOffset_);
+  bufferSize_ = curWriteOffset_ - bufferOffset_;
+  flushedSize_ = bufferSize_;
+  if (bufferSize_ == 0) {
+    return Status::OK();
+  }
+  auto ret = io_->readSome(fd_, buffer_.get(), kDirectIOAlignment, bufferOffset_);
+  if (!ret.ok()) {
+    return ret.status();
+  }
+  if (ret.value() < bufferSize_) {
+    return Status::ERROR(Status::Code::kEOF, "EOF");
+  }
+  return Status::OK();
+}
+
+Status DataFile::appendToWriteBuffer(struct iovec* iovs, int iovCnt, size_t totalSize) {
+  if (directIO_) {
+    // Everything goes through the staging buffer, which is written out whenever it's full
+    for (int i = 0; i < iovCnt; i++) {
+      auto* data = static_cast<const char*>(iovs[i].iov_base);
+      size_t len = iovs[i].iov_len;
+      while (len > 0) {
+        if (bufferSize_ == bufferCapacity_) {
+          auto status = flushWriteBufferLocked();
+          if (!status.ok()) {
+            return status;
+          }
+        }
+        auto n = std::min(len, bufferCapacity_ - bufferSize_);
+        std::memcpy(buffer_.get() + bufferSize_, data, n);
+        bufferSize_ += n;
+        data += n;
+        len -= n;
+      }
+    }
+    return Status::OK();
+  }
+  if (bufferSize_ + totalSize > bufferCapacity_) {
+    auto status = flushWriteBufferLocked();
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  if (totalSize > bufferCapacity_) {
+    // too large to buffer, write it through
+    auto status = pwriteAll(iovs, iovCnt, bufferOffset_, totalSize);
+    if (!status.ok()) {
+      return status;
+    }
+    bufferOffset_ += totalSize;
+    return Status::OK();
+  }
+  for (int i = 0; i < iovCnt; i++) {
+    std::memcpy(buffer_.get() + bufferSize_, iovs[i].iov_base, iovs[i].iov_len);
+    bufferSize_ += iovs[i].iov_len;
+  }
+  return Status::OK();
+}
+
+Status DataFile::flushWriteBuffer() {
+  if (!buffer_) {
+    return Status::OK();
+  }
+  std::unique_lock<std::shared_mutex> lock(bufferMutex_);
+  return flushWriteBufferLocked();
+}
+
+Status DataFile::flushWriteBufferLocked() {
+  if (bufferSize_ == flushedSize_) {
+    return Status::OK();
+  }
+  FVLOG2("[DataFile] Flushing {} bytes of write buffer to data file: {}", bufferSize_, fileId_);
+  if (directIO_) {
+    // Write whole blocks, zeroing the padding of the tail block, and carry the tail block over to
+    // be rewritten by the next flush.
+    size_t writeSize = alignUp(bufferSize_);
+    std::memset(buffer_.get() + bufferSize_, 0, writeSize - bufferSize_);
+    struct iovec iov = {buffer_.get(), writeSize};
+    auto status = pwriteAll(&iov, 1, bufferOffset_, writeSize);
+    if (!status.ok()) {
+      return status;
+    }
+    size_t fullSize = alignDown(bufferSize_);
+    size_t tailSize = bufferSize_ - fullSize;
+    if (fullSize > 0) {
+      std::memmove(buffer_.get(), buffer_.get() + fullSize, tailSize);
+      bufferOffset_ += fullSize;
+    }
+    bufferSize_ = tailSize;
+    flushedSize_ = tailSize;
+    return Status::OK();
+  }
+  struct iovec iov = {buffer_.get(), bufferSize_};
+  auto status = pwriteAll(&iov, 1, bufferOffset_, bufferSize_);
+  if (!status.ok()) {
+    return status;
+  }
+  bufferOffset_ += bufferSize_;
+  bufferSize_ = 0;
+  return Status::OK();
+}
+
+Status DataFile::read(FileOffset offset, size_t size, char* buf, IOPriority priority) {
+  if (rateLimiter_ && !mmapBase_) {
+    rateLimiter_->request(size, priority);
+  }
+  return readNBytes(offset, size, buf);
+}
+
+Status DataFile::readOrDefer(FileOffset offset,
+                             size_t size,
+                             char* buf,
+                             std::vector<IOBackend::ReadRequest>* deferred) {
+  if (mmapBase_ || directIO_) {
+    return readNBytes(offset, size, buf);
+  }
+  if (buffer_) {
+    std::shared_lock<std::shared_mutex> lock(bufferMutex_);
+    if (offset + static_cast<FileOffset>(size) > bufferOffset_) {
+      // Only bytes before bufferOffset_ are in the file, which are never written again
+      lock.unlock();
+      return readNBytes(offset, size, buf);
+    }
+  }
+  deferred->push_back({fd_, buf, size, offset, Status::OK()});
+  return Status::OK();
+}
+
+Status DataFile::verifyRecord(const char* record, uint16_t valueSize) {
+  return verifyRecordCrc(record, valueSize);
+}
+
+Status DataFile::truncate(FileOffset offset) {
+  auto status = flushWriteBuffer();
+  if (!status.ok()) {
+    return status;
+  }
+  if (ftruncate(fd_, offset) == -1) {
+    FLOG_ERROR("Truncate failure: {}", std::string(strerror(errno)));
+    return Status::ERROR(Status::Code::kError, "Truncate failure: " + std::string(strerror(errno)));
+  }
+  curWriteOffset_ = offset;
+  if (directIO_ && buffer_) {
+    std::unique_lock<std::shared_mutex> lock(bufferMutex_);
+    return loadTailBlockLocked();
+  }
+  bufferOffset_ = offset;
+  return Status::OK();
+}
+
+Status DataFile::preallocate(size_t size) {
+  if (fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, size) == -1) {
+    if (errno == EOPNOTSUPP) {
+      FVLOG1("[DataFile] Preallocation is not supported for data file {}", fileId_);
+      return Status::OK();
+    }
+    return Status::ERROR(Status::Code::kError,
+                         "Error preallocating file: " + std::string(strerror(errno)));
+  }
+  preallocated_ = true;
+  return Status::OK();
+}
+
 Status DataFile::flush() {
   // std::unique_lock<std::shared_mutex> fileLock(fileMutex_);
   if (fd_ == -1) {
@@ -193,12 +744,26 @@ Status DataFile::flush() {
                          "Error flushing file: file descriptor is invalid");
   }
 
-  if (fsync(fd_) == -1) {
-    return Status::ERROR(Status::Code::kError,
-                         "Error flushing file: " + std::string(strerror(errno)));
+  auto status = flushWriteBuffer();
+  if (!status.ok()) {
+    return status;
   }
 
-  return Status::OK();
+  return io_->sync(fd_, false);
+}
+
+Status DataFile::syncData() {
+  if (fd_ == -1) {
+    return Status::ERROR(Status::Code::kNoSuchFile,
+                         "Error syncing file: file descriptor is invalid");
+  }
+
+  auto status = flushWriteBuffer();
+  if (!status.ok()) {
+    return status;
+  }
+
+  return io_->sync(fd_, true);
 }
 
 int64_t DataFile::getCurrentFileSize() {
@@ -1,18 +1,40 @@
 #ifndef DB_DATAFILE_H_
 #define DB_DATAFILE_H_
 
+#include <sys/mman.h>
+#include <sys/uio.h>
+
 #include "bitcask/Base.h"
+#include "bitcask/PinnableValue.h"
 #include "bitcask/StatusOr.h"
 #include "bitcask/Types.h"
+#include "db/IOBackend.h"
 #include "db/LogRecord.h"
+#include "utils/RateLimiter.h"
 
 namespace bitcask {
 
+static const size_t kWriteBufferAlignment = 4096;
+
+// Block size of the file offsets, sizes and buffers of direct I/O
+static const size_t kDirectIOAlignment = 4096;
+
+// Default size of the staging buffer of direct I/O appends
+static const size_t kDirectIOStagingSize = 64 * 1024;
+
 class DataFile {
  public:
   DataFile() = default;
 
-  DataFile(const std::string dirPath, const uint32_t fileId, bool readOnly = false);
+  // With directIO, the file is opened with O_DIRECT. Appends are staged in an aligned buffer and
+  // written out in whole blocks, the partially filled tail block being carried over and rewritten
+  // by the next write. Reads fetch the aligned blocks around the bytes asked for. The padding after
+  // the last record is trimmed on close, and is zeroed so that a zeroed header marks the end of
+  // data after a crash.
+  DataFile(const std::string dirPath,
+           const uint32_t fileId,
+           bool readOnly = false,
+           bool directIO = false);
 
   Status openDataFile();
 
@@ -24,13 +46,118 @@ class DataFile {
   // read a LogRecord from datafile with knowledge of value size
   StatusOr<std::unique_ptr<LogRecord>> readLogRecord(FileOffset pos, uint16_t valueSize);
 
+  // Read the value of the log record at pos, and check the crc of the record. The value is pinned
+  // to the mapping if the file is mapped, otherwise the record is read into the buffer of value.
+  Status readValue(FileOffset pos, uint16_t valueSize, PinnableValue* value);
+
+  // Read the value of the log record at pos into value, reusing its capacity. The header is read
+  // aside, and the value right into place.
+  Status readValue(FileOffset pos, uint16_t valueSize, std::string* value);
+
   // encode the log and write the buffer to datafile
   // return the position of this log record
   StatusOr<FileOffset> writeLogRecord(std::unique_ptr<LogRecord>&& log);
 
+  // encode all logs and write them back to back with a single pwritev
+  // return the position of the first log record
+  StatusOr<FileOffset> writeLogRecords(const std::vector<LogRecord*>& logs);
+
+  // write already encoded log records to datafile
+  // return the position of the first byte written
+  StatusOr<FileOffset> writeBuffer(const char* buf, size_t size);
+
+  // write already encoded log records in iovs back to back with pwritev. iovs are consumed.
+  // return the position of the first byte written
+  StatusOr<FileOffset> writeBuffers(struct iovec* iovs, int iovCnt);
+
+  StatusOr<FileOffset> writeBuffers(std::vector<struct iovec>& iovs) {
+    return writeBuffers(iovs.data(), static_cast<int>(iovs.size()));
+  }
+
+  // Reserve size bytes at the end of the file for a write, as long as the file stays within limit
+  // bytes. A record larger than limit is still given an empty file. Concurrent writers reserve
+  // distinct ranges, and write them in parallel with writeBuffersAt. Not for buffered files.
+  // return the offset reserved, or -1 if the file is full
+  FileOffset reserve(size_t size, size_t limit);
+
+  // write already encoded log records in iovs to the range reserved at offset. iovs are consumed.
+  Status writeBuffersAt(struct iovec* iovs, int iovCnt, FileOffset offset, size_t totalSize);
+
+  // Fill the range of size bytes reserved at offset with PADDING records, after its write failed.
+  // Otherwise the range is a hole of zeros, where a scan stops as at the end of the file, and the
+  // records written after it would be lost on open. size is at least kLogHeaderAndKeySize, the
+  // size of the smallest record.
+  Status padAt(FileOffset offset, size_t size);
+
+  // Stop reserving ranges of the file, e.g. after a range could be neither written nor padded, so
+  // that the writers roll it out
+  void markFailed() {
+    failed_ = true;
+  }
+
+  bool failed() const {
+    return failed_;
+  }
+
+  // read size bytes at offset into buf, as I/O of the given priority for the rate limiter
+  Status read(FileOffset offset, size_t size, char* buf, IOPriority priority = IOPriority::kHigh);
+
+  // Read size bytes at offset into buf right away if they are in memory, i.e. mapped or in the
+  // write buffer, or if they need aligned reads. Otherwise append a read request to deferred, for
+  // the caller to issue along with others through IOBackend::readBatch while the file is still
+  // open.
+  Status readOrDefer(FileOffset offset,
+                     size_t size,
+                     char* buf,
+                     std::vector<IOBackend::ReadRequest>* deferred);
+
+  // Check the crc of the encoded log record in record, whose value is valueSize bytes
+  static Status verifyRecord(const char* record, uint16_t valueSize);
+
+  // Buffer appends in an in-process write buffer of the given capacity, and write them out in large
+  // writes when the buffer is full, or when it's flushed explicitly. Records still in the buffer
+  // are served from it by reads. Only for the active data file. With direct I/O, the staging buffer
+  // is resized instead, and appends are no longer written through.
+  void enableWriteBuffer(size_t capacity);
+
+  // write out everything in the write buffer, if any
+  Status flushWriteBuffer();
+
+  // do the file I/O through the given backend instead of the default posix one
+  void setIOBackend(IOBackend* io) {
+    io_ = io;
+  }
+
+  // Charge the I/O of the file to limiter: the reads of values as foreground I/O, the reads of read
+  // as I/O of the priority they're given, and the writes as I/O of writePriority, e.g. kLow for the
+  // files written by a merge. Reads from the mapping are not charged.
+  void setRateLimiter(RateLimiter* limiter, IOPriority writePriority = IOPriority::kHigh) {
+    rateLimiter_ = limiter;
+    writePriority_ = writePriority;
+  }
+
+  // Map the file into memory when it's opened read only, and serve reads from the mapping. The
+  // mapping is advised for random access. Falls back to reads through io_ if it can't be mapped.
+  void setMmapReads(bool mmapReads) {
+    mmapReads_ = mmapReads;
+  }
+
+  // give the kernel an madvise hint about the coming accesses to the mapping, if it's mapped
+  void adviseAccess(int advice);
+
+  // drop everything after offset, e.g. a torn write at the end of the file
+  Status truncate(FileOffset offset);
+
+  // allocate disk space for the first size bytes of the file without changing the file size, so
+  // that appends don't allocate blocks. What's left unused is released on close.
+  Status preallocate(size_t size);
+
   // force the filesystem to sync all writes from buffer cache to disk
   Status flush();
 
+  // like flush, but only sync the file data and the metadata needed to read it back (fdatasync)
+  Status syncData();
+
   // get the current data file size
   int64_t getCurrentFileSize();
 
@@ -38,30 +165,95 @@ class DataFile {
 
   ~DataFile() {
     if (fd_ != -1) {
-      close(fd_);
-      fd_ = -1;
+      closeDataFile();
     }
   }
 
  private:
+  // read from the write buffer if the bytes are still there, otherwise from the file
   Status readNBytes(int64_t offset, int64_t size, char* buf);
 
+  Status preadAll(int64_t offset, int64_t size, char* buf);
+
+  // read the aligned blocks around [offset, offset + size) and copy the bytes asked for to buf
+  Status preadDirect(int64_t offset, int64_t size, char* buf);
+
+  // map the whole file read only. The file stays unmapped on failure.
+  void mapFile();
+
+  // decode a LogRecord right from the mapping. The value size is read from the header if it's
+  // negative.
+  StatusOr<std::unique_ptr<LogRecord>> readMappedLogRecord(FileOffset pos, int32_t valueSize);
+
+  // write all bytes in iovs at offset, retrying on partial writes
+  Status pwriteAll(struct iovec* iovs, int iovCnt, FileOffset offset, size_t totalSize);
+
+  // copy the iovs to the write buffer. Require holding bufferMutex_.
+  Status appendToWriteBuffer(struct iovec* iovs, int iovCnt, size_t totalSize);
+
+  // Require holding bufferMutex_.
+  Status flushWriteBufferLocked();
+
+  // Direct I/O only. Allocate the staging buffer with the given capacity, keeping what's in the old
+  // buffer. Require holding bufferMutex_.
+  Status allocateWriteBufferLocked(size_t capacity);
+
+  // Direct I/O only. Load the bytes of the tail block before curWriteOffset_ into the staging
+  // buffer, so that the next write rewrites the whole block. Require holding bufferMutex_.
+  Status loadTailBlockLocked();
+
   FileID fileId_{0};
-  FileOffset curWriteOffset_{0};
+  // Reserved by concurrent writers, see reserve
+  std::atomic<FileOffset> curWriteOffset_{0};
+  std::atomic<bool> failed_{false};
   std::string fileName_;
   bool readOnly_{false};
+  bool directIO_{false};
+  bool preallocated_{false};
+  bool mmapReads_{false};
+
+  // The read only mapping of the file, if it's mapped. The file never changes once it's mapped.
+  // mapping_ unmaps it once the file is closed and no value is pinned to it any more.
+  char* mmapBase_{nullptr};
+  size_t mmapSize_{0};
+  std::shared_ptr<const void> mapping_;
 
   // OS fd when it's open
   // Race condition:
-  // (1) open and anything else. openDataFile is called in db->open() and appendLogRecord.
+  // (1) open and anything else. openDataFile is called in db->open() and appendBuffers.
   // db->open() is always called first, and then read or write, no possibility of race condition.
-  // appendLogRecord has a lock to serialize the close, open, and write. No concurrent access to fds
-  // during appendLogRecord. (2) close and anything. closeDataFile is called in appendLogRecord
-  // only, which is protected by lock. (3) concurrent write: impossible. appendLogRecord is
+  // appendBuffers has a lock to serialize the close, open, and write. No concurrent access to fds
+  // during appendBuffers. (2) close and anything. The db closes a data file only when it's
+  // destroyed, once no writer holds it and no reader of the file table can see it any more, see
+  // VersionedFileTable. (3) concurrent write: impossible. appendBuffers is
   // serialized. (4) concurrent read and write. When we read a key, we are reading the underlying
   // datafile via offset. Since the data is written in append only mode, the data at the offset
   // won't be modified. So there is no race condition.
   int fd_{-1};
+
+  IOBackend* io_{IOBackend::get(IOBackendType::kPosix)};
+
+  // null if the I/O is not limited
+  RateLimiter* rateLimiter_{nullptr};
+  IOPriority writePriority_{IOPriority::kHigh};
+
+  // The write buffer holds the bytes in [bufferOffset_, curWriteOffset_) which are not written out
+  // to the file yet. Appends are serialized by the caller, reads are not, so bufferMutex_ protects
+  // the buffer against concurrent reads. With direct I/O, bufferOffset_ is block aligned, and the
+  // first flushedSize_ bytes, i.e. the carried over tail block, are already in the file. Appends
+  // are written through unless enableWriteBuffer is called.
+  struct FreeDeleter {
+    void operator()(char* p) const {
+      free(p);
+    }
+  };
+  std::unique_ptr<char, FreeDeleter> buffer_{nullptr};
+  size_t bufferCapacity_{0};
+  size_t bufferSize_{0};
+  FileOffset bufferOffset_{0};
+  size_t flushedSize_{0};
+  bool writeThrough_{false};
+  mutable std::shared_mutex bufferMutex_;
 };
 
 }  // namespace bitcask
@@ -0,0 +1,100 @@
+#include "db/DataFileScanner.h"
+
+DEFINE_uint64(scan_chunk_size,
+              4 * 1024 * 1024,
+              "Bytes read at once by the sequential scans of data files");
+
+namespace bitcask {
+
+DataFileScanner::DataFileScanner(DataFile* file,
+                                 FileOffset start,
+                                 size_t chunkSize,
+                                 IOPriority priority)
+    : file_(file),
+      chunkSize_(std::max<size_t>(chunkSize, kLogHeaderSize)),
+      priority_(priority),
+      fileSize_(file->getCurrentFileSize()),
+      dataOffset_(start),
+      offset_(start),
+      nextOffset_(start) {
+  for (auto& buf : bufs_) {
+    buf = std::make_unique<char[]>(kMaxRecordSize + chunkSize_);
+  }
+  data_ = bufs_[cur_].get() + kMaxRecordSize;
+  readAhead();
+}
+
+DataFileScanner::~DataFileScanner() {
+  if (readAhead_.valid()) {
+    readAhead_.wait();
+  }
+}
+
+void DataFileScanner::readAhead() {
+  auto offset = dataOffset_ + static_cast<FileOffset>(dataSize_);
+  if (offset >= fileSize_) {
+    readAheadSize_ = 0;
+    return;
+  }
+  readAheadSize_ = std::min<size_t>(chunkSize_, fileSize_ - offset);
+  char* buf = bufs_[1 - cur_].get() + kMaxRecordSize;
+  readAhead_ = std::async(
+      std::launch::async,
+      [file = file_, offset, buf, size = readAheadSize_, priority = priority_] {
+        return file->read(offset, size, buf, priority);
+      });
+}
+
+Status DataFileScanner::fill(size_t size) {
+  while (offset_ + static_cast<FileOffset>(size) >
+         dataOffset_ + static_cast<FileOffset>(dataSize_)) {
+    if (readAheadSize_ == 0) {
+      return Status::ERROR(Status::Code::kEOF, "EOF");
+    }
+    auto status = readAhead_.get();
+    if (!status.ok()) {
+      readAheadSize_ = 0;
+      return status;
+    }
+    // Move what's left of the current buffer, a part of the current record, right before the chunk
+    // read ahead. It's always less than a record.
+    size_t left = dataOffset_ + dataSize_ - offset_;
+    char* chunk = bufs_[1 - cur_].get() + kMaxRecordSize;
+    std::memcpy(chunk - left, data_ + (offset_ - dataOffset_), left);
+    cur_ = 1 - cur_;
+    data_ = chunk - left;
+    dataOffset_ = offset_;
+    dataSize_ = left + readAheadSize_;
+    readAhead();
+  }
+  record_ = data_ + (offset_ - dataOffset_);
+  return Status::OK();
+}
+
+Status DataFileScanner::next(bool verifyCrc) {
+  offset_ = nextOffset_;
+  auto status = fill(kLogHeaderSize);
+  if (!status.ok()) {
+    return status;
+  }
+  LogRecord::decodeHeaderTo(record_, &header_);
+  // Keys are never empty, so a zeroed header is the padding of a direct I/O write which was not
+  // trimmed, e.g. after a crash. Nothing follows it.
+  if (header_.keySize_ == 0 && header_.crc_ == 0 && header_.tstamp_ == 0) {
+    return Status::ERROR(Status::Code::kEOF, "EOF");
+  }
+  status = fill(size());
+  if (!status.ok()) {
+    return status;
+  }
+  if (verifyCrc) {
+    status = DataFile::verifyRecord(record_, header_.valueSize_);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  nextOffset_ = end();
+  return Status::OK();
+}
+
+}  // namespace bitcask
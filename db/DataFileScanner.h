@@ -0,0 +1,114 @@
+#ifndef DB_DATAFILESCANNER_H_
+#define DB_DATAFILESCANNER_H_
+
+#include <future>
+
+#include "db/DataFile.h"
+
+DECLARE_uint64(scan_chunk_size);
+
+namespace bitcask {
+
+// DataFileScanner reads the log records of a data file in order, from its start to its end, with
+// large reads of FLAGS_scan_chunk_size bytes rather than one or two reads per record. Two buffers
+// are used in turn: the next chunk is read ahead in the background while the records of the current
+// one are decoded in place. A record spanning two chunks is moved to the front of the next one.
+// Values are only copied out when asked for.
+//
+// The records must not be written during the scan, e.g. of a data file which has been rolled out.
+// The scan starts at a record boundary, the start of the file by default, and stops at the size the
+// file had when the scanner was created. The chunks are read as I/O of the given priority, e.g.
+// kLow for a merge, throttled by the rate limiter of the file if it has one.
+class DataFileScanner {
+ public:
+  explicit DataFileScanner(DataFile* file,
+                           FileOffset start = 0,
+                           size_t chunkSize = FLAGS_scan_chunk_size,
+                           IOPriority priority = IOPriority::kHigh);
+
+  // Wait for the read ahead in flight, if any
+  ~DataFileScanner();
+
+  DataFileScanner(const DataFileScanner&) = delete;
+  DataFileScanner& operator=(const DataFileScanner&) = delete;
+
+  // Move to the next record, the first one on the first call. Return kEOF past the last record: at
+  // the end of the file, at a torn record at the end of the file, or at the zeroed padding of
+  // direct I/O. Return an error if a read fails, or if the record fails its crc check unless
+  // verifyCrc is false, e.g. for the records of a batch, which are checked as a whole.
+  Status next(bool verifyCrc = true);
+
+  // Offset of the current record in the file. The current record is only valid once next() has
+  // returned OK.
+  FileOffset offset() const {
+    return offset_;
+  }
+
+  // Offset right after the current record
+  FileOffset end() const {
+    return offset_ + static_cast<FileOffset>(size());
+  }
+
+  const LogRecordHeader& header() const {
+    return header_;
+  }
+
+  KeyType key() const {
+    KeyType key;
+    std::memcpy(&key, record_ + kLogHeaderSize, sizeof(key));
+    return key;
+  }
+
+  // The whole encoded record, valid until the next call to next()
+  std::string_view record() const {
+    return {record_, size()};
+  }
+
+  // A copy of the value
+  std::string value() const {
+    return std::string(record_ + kLogHeaderAndKeySize, header_.valueSize_);
+  }
+
+ private:
+  // Size of the largest log record
+  static constexpr size_t kMaxRecordSize = kLogHeaderAndKeySize + UINT16_MAX;
+
+  size_t size() const {
+    return kLogHeaderAndKeySize + header_.valueSize_;
+  }
+
+  // Make sure that the size bytes from the current record are in the current buffer, moving to the
+  // next chunk if needed. Return kEOF if the file ends before.
+  Status fill(size_t size);
+
+  // Start reading the chunk after the current buffer into the other buffer, if the file goes on
+  void readAhead();
+
+  DataFile* file_;
+  const size_t chunkSize_;
+  const IOPriority priority_;
+  const FileOffset fileSize_;
+
+  // A chunk is read after the first kMaxRecordSize bytes of a buffer, where the part of a record
+  // left at the end of the previous chunk is moved
+  std::unique_ptr<char[]> bufs_[2];
+  int cur_{0};
+  // The current buffer holds the bytes [dataOffset_, dataOffset_ + dataSize_) of the file, at data_
+  const char* data_{nullptr};
+  FileOffset dataOffset_{0};
+  size_t dataSize_{0};
+
+  // The read ahead in flight, if any, and its size
+  std::future<Status> readAhead_;
+  size_t readAheadSize_{0};
+
+  // The current record, and the offset of the next one
+  FileOffset offset_{0};
+  const char* record_{nullptr};
+  LogRecordHeader header_;
+  FileOffset nextOffset_{0};
+};
+
+}  // namespace bitcask
+
+#endif  // DB_DATAFILESCANNER_H_
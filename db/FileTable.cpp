@@ -0,0 +1,123 @@
+#include "db/FileTable.h"
+
+namespace bitcask {
+
+namespace {
+
+// The reader slot of the calling thread. Threads are spread over the slots round robin, so that
+// readers of different threads rarely share a cache line.
+size_t readerSlotOfThisThread(size_t numSlots) {
+  static std::atomic<size_t> nextSlot{0};
+  thread_local size_t slot = nextSlot.fetch_add(1, std::memory_order_relaxed);
+  return slot % numSlots;
+}
+
+}  // namespace
+
+FileTable::FileTable(const std::vector<std::pair<FileID, std::shared_ptr<DataFile>>>& files) {
+  if (files.empty()) {
+    return;
+  }
+  auto [minIt, maxIt] = std::minmax_element(
+      files.begin(), files.end(), [](const auto& l, const auto& r) { return l.first < r.first; });
+  firstFileId_ = minIt->first;
+  files_.resize(maxIt->first - firstFileId_ + 1);
+  for (const auto& [fileId, file] : files) {
+    files_[fileId - firstFileId_] = file;
+  }
+  size_ = files.size();
+}
+
+std::vector<std::pair<FileID, std::shared_ptr<DataFile>>> FileTable::files() const {
+  std::vector<std::pair<FileID, std::shared_ptr<DataFile>>> files;
+  files.reserve(size_);
+  for (size_t i = 0; i < files_.size(); i++) {
+    if (files_[i]) {
+      files.emplace_back(firstFileId_ + i, files_[i]);
+    }
+  }
+  return files;
+}
+
+VersionedFileTable::Reader::Reader(const VersionedFileTable& table) {
+  auto& slot = table.slots_[readerSlotOfThisThread(kReaderSlots)];
+  // Register in the current epoch. If the epoch advanced meanwhile, the publisher may have missed
+  // us, so register again in the new one.
+  while (true) {
+    auto epoch = table.epoch_.load();
+    readers_ = &slot.readers_[epoch & 1];
+    readers_->fetch_add(1);
+    if (table.epoch_.load() == epoch) {
+      break;
+    }
+    readers_->fetch_sub(1);
+  }
+  table_ = table.current_.load();
+}
+
+VersionedFileTable::Reader::~Reader() {
+  readers_->fetch_sub(1);
+}
+
+VersionedFileTable::VersionedFileTable()
+    : current_(new FileTable(std::vector<std::pair<FileID, std::shared_ptr<DataFile>>>())) {}
+
+VersionedFileTable::~VersionedFileTable() {
+  delete current_.load();
+}
+
+void VersionedFileTable::publish(std::unique_ptr<const FileTable> table) {
+  std::unique_ptr<const FileTable> previous(current_.exchange(table.release()));
+  std::lock_guard<std::mutex> lock(retiredMutex_);
+  retired_.emplace_back(epoch_.load(), std::move(previous));
+  reclaimLocked();
+}
+
+bool VersionedFileTable::reclaim() {
+  std::lock_guard<std::mutex> lock(retiredMutex_);
+  return reclaimLocked();
+}
+
+void VersionedFileTable::synchronize() {
+  std::unique_lock<std::mutex> lock(retiredMutex_);
+  while (!reclaimLocked()) {
+    lock.unlock();
+    std::this_thread::yield();
+    lock.lock();
+  }
+}
+
+size_t VersionedFileTable::numRetired() const {
+  std::lock_guard<std::mutex> lock(retiredMutex_);
+  return retired_.size();
+}
+
+int64_t VersionedFileTable::numReaders(size_t parity) const {
+  int64_t readers = 0;
+  for (const auto& slot : slots_) {
+    readers += slot.readers_[parity].load();
+  }
+  return readers;
+}
+
+bool VersionedFileTable::reclaimLocked() {
+  // Two advances at most are needed for the latest retired snapshot to be reclaimed
+  for (int i = 0; i < 2 && !retired_.empty(); i++) {
+    auto epoch = epoch_.load();
+    if (retired_.back().first + 2 <= epoch) {
+      break;
+    }
+    // The readers of the previous epoch share the parity of the next one
+    if (numReaders((epoch + 1) & 1) != 0) {
+      break;
+    }
+    epoch_.store(epoch + 1);
+  }
+  auto epoch = epoch_.load();
+  while (!retired_.empty() && retired_.front().first + 2 <= epoch) {
+    retired_.pop_front();
+  }
+  return retired_.empty();
+}
+
+}  // namespace bitcask
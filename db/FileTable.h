@@ -0,0 +1,123 @@
+#ifndef DB_FILETABLE_H_
+#define DB_FILETABLE_H_
+
+#include "bitcask/Base.h"
+#include "bitcask/Types.h"
+#include "db/DataFile.h"
+
+namespace bitcask {
+
+// FileTable is an immutable snapshot of the open data files by file id. File ids are dense, so a
+// file is found by indexing an array rather than by a hash lookup. The snapshot shares the
+// ownership of its files: a file replaced in or dropped from the newer snapshots is closed once the
+// last snapshot holding it is reclaimed.
+class FileTable {
+ public:
+  explicit FileTable(const std::vector<std::pair<FileID, std::shared_ptr<DataFile>>>& files);
+
+  FileTable(const FileTable&) = delete;
+  FileTable& operator=(const FileTable&) = delete;
+
+  // The data file of fileId, or nullptr if it's not in the snapshot
+  DataFile* find(FileID fileId) const {
+    if (fileId < firstFileId_ || fileId - firstFileId_ >= files_.size()) {
+      return nullptr;
+    }
+    return files_[fileId - firstFileId_].get();
+  }
+
+  // Number of files in the snapshot
+  size_t size() const {
+    return size_;
+  }
+
+  // All files of the snapshot in file id order. They stay open as long as they are held, even once
+  // the snapshot is reclaimed.
+  std::vector<std::pair<FileID, std::shared_ptr<DataFile>>> files() const;
+
+ private:
+  FileID firstFileId_{0};
+  // by fileId - firstFileId_, null for the ids not in the snapshot
+  std::vector<std::shared_ptr<DataFile>> files_;
+  size_t size_{0};
+};
+
+// VersionedFileTable publishes FileTable snapshots to lock free readers, in the style of RCU.
+//
+// A reader registers itself in the current epoch, in one of a few cache line sized reader slots
+// picked by thread, then loads the current snapshot. It uses the snapshot without any lock until it
+// leaves. Publishing a snapshot swaps it in atomically and retires the previous one, tagged with
+// the epoch at the time. The epoch only advances once all readers of the epoch before have left,
+// so a snapshot retired in epoch e can't be seen by any reader once the epoch reaches e + 2, and is
+// reclaimed then. Reclaiming never waits for readers, except in synchronize.
+class VersionedFileTable {
+ public:
+  // A registered reader of the current snapshot, until it's destroyed
+  class Reader {
+   public:
+    explicit Reader(const VersionedFileTable& table);
+    ~Reader();
+
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    const FileTable* operator->() const {
+      return table_;
+    }
+
+   private:
+    std::atomic<int64_t>* readers_{nullptr};
+    const FileTable* table_{nullptr};
+  };
+
+  VersionedFileTable();
+
+  // Require no reader left
+  ~VersionedFileTable();
+
+  VersionedFileTable(const VersionedFileTable&) = delete;
+  VersionedFileTable& operator=(const VersionedFileTable&) = delete;
+
+  // Publish table as the current snapshot, retire the previous one, and reclaim the retired
+  // snapshots no reader can see any more. Publishers are serialized by the caller.
+  void publish(std::unique_ptr<const FileTable> table);
+
+  // Reclaim the retired snapshots no reader can see any more, without waiting for readers.
+  // Return whether all retired snapshots are reclaimed.
+  bool reclaim();
+
+  // Wait until all snapshots retired so far are reclaimed, i.e. until the readers that may see them
+  // have left.
+  void synchronize();
+
+  // Number of retired snapshots not reclaimed yet
+  size_t numRetired() const;
+
+ private:
+  static constexpr size_t kReaderSlots = 64;
+
+  // Readers registered in the epochs of each parity. Readers of the epochs before the previous one
+  // have all left, so the parity tells the current epoch from the previous one.
+  struct alignas(64) ReaderSlot {
+    std::atomic<int64_t> readers_[2] = {{0}, {0}};
+  };
+
+  // Readers registered in the epochs of parity
+  int64_t numReaders(size_t parity) const;
+
+  // Advance the epoch if all readers of the previous epoch have left, and reclaim the retired
+  // snapshots no reader can see any more. Require holding retiredMutex_.
+  bool reclaimLocked();
+
+  std::atomic<const FileTable*> current_{nullptr};
+  std::atomic<uint64_t> epoch_{0};
+  mutable std::array<ReaderSlot, kReaderSlots> slots_;
+
+  mutable std::mutex retiredMutex_;
+  // Retired snapshots and the epoch they were retired in, oldest first
+  std::deque<std::pair<uint64_t, std::unique_ptr<const FileTable>>> retired_;
+};
+
+}  // namespace bitcask
+
+#endif  // DB_FILETABLE_H_
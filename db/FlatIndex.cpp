@@ -0,0 +1,351 @@
+#include "db/FlatIndex.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace bitcask {
+
+namespace {
+
+// Control bytes of the slots which are not full. Both have the high bit set, full slots don't.
+constexpr int8_t kEmpty = -128;
+constexpr int8_t kDeleted = -2;
+
+// The control bytes of a group of slots, matched all at once
+class Group {
+ public:
+#if defined(__SSE2__)
+  explicit Group(const int8_t* ctrl)
+      : ctrl_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))) {}
+
+  // bit i is set if slot i has the control byte h2
+  uint32_t match(int8_t h2) const {
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl_)));
+  }
+
+  uint32_t matchEmpty() const {
+    return match(kEmpty);
+  }
+
+  uint32_t matchEmptyOrDeleted() const {
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), ctrl_)));
+  }
+
+ private:
+  __m128i ctrl_;
+#else
+  explicit Group(const int8_t* ctrl) : ctrl_(ctrl) {}
+
+  uint32_t match(int8_t h2) const {
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; i++) {
+      bits |= static_cast<uint32_t>(ctrl_[i] == h2) << i;
+    }
+    return bits;
+  }
+
+  uint32_t matchEmpty() const {
+    return match(kEmpty);
+  }
+
+  uint32_t matchEmptyOrDeleted() const {
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; i++) {
+      bits |= static_cast<uint32_t>(ctrl_[i] < -1) << i;
+    }
+    return bits;
+  }
+
+ private:
+  const int8_t* ctrl_;
+#endif
+};
+
+// The 7 bits of the hash kept in the control byte
+int8_t h2(uint64_t hash) {
+  return static_cast<int8_t>(hash & 0x7F);
+}
+
+Status notFound() {
+  return Status::ERROR(Status::Code::kNotFound, "Key not found");
+}
+
+}  // namespace
+
+FlatIndex::FlatIndex(size_t initialSize) {
+  if (initialSize > 0) {
+    // The table grows once it's 7/8 full
+    size_t capacity = kGroupSize;
+    while (capacity / 8 * 7 < initialSize) {
+      capacity *= 2;
+    }
+    resizeLocked(capacity);
+  }
+}
+
+uint64_t FlatIndex::hash(KeyType key) {
+  // The finalizer of MurmurHash3, so that keys which are close to each other, or multiples of a
+  // power of 2, spread over the whole table
+  uint64_t x = static_cast<uint32_t>(key);
+  x ^= x >> 33;
+  x *= 0xFF51AFD7ED558CCDULL;
+  x ^= x >> 33;
+  x *= 0xC4CEB9FE1A85EC53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+std::shared_ptr<LogPos> FlatIndex::toLogPos(const Slot& slot) {
+  auto pos = static_cast<FileOffset>(slot.posLow_) |
+             (static_cast<FileOffset>(slot.posHigh_) << 32);
+  return std::make_shared<LogPos>(slot.fileId_, slot.valueSize_, pos, 0);
+}
+
+int64_t FlatIndex::findLocked(KeyType key, uint64_t hash) const {
+  if (capacity_ == 0) {
+    return -1;
+  }
+  auto mask = capacity_ - 1;
+  auto pos = (hash >> 7) & mask;
+  for (size_t i = 1;; i++) {
+    Group group(ctrl_.get() + pos);
+    for (auto bits = group.match(h2(hash)); bits != 0; bits &= bits - 1) {
+      auto slot = (pos + __builtin_ctz(bits)) & mask;
+      if (slots_[slot].key_ == key) {
+        return static_cast<int64_t>(slot);
+      }
+    }
+    // A key is never inserted past an empty slot of its probe sequence
+    if (group.matchEmpty() != 0) {
+      return -1;
+    }
+    pos = (pos + kGroupSize * i) & mask;
+  }
+}
+
+size_t FlatIndex::findFreeLocked(uint64_t hash) const {
+  auto mask = capacity_ - 1;
+  auto pos = (hash >> 7) & mask;
+  for (size_t i = 1;; i++) {
+    auto bits = Group(ctrl_.get() + pos).matchEmptyOrDeleted();
+    if (bits != 0) {
+      return (pos + __builtin_ctz(bits)) & mask;
+    }
+    pos = (pos + kGroupSize * i) & mask;
+  }
+}
+
+void FlatIndex::setCtrl(size_t slot, int8_t ctrl) {
+  ctrl_[slot] = ctrl;
+  if (slot < kGroupSize) {
+    ctrl_[capacity_ + slot] = ctrl;
+  }
+}
+
+void FlatIndex::putLocked(KeyType key, const LogPos& logPos) {
+  auto h = hash(key);
+  auto slot = findLocked(key, h);
+  if (slot < 0) {
+    if (capacity_ == 0) {
+      reserveOneLocked();
+    }
+    auto free = findFreeLocked(h);
+    if (ctrl_[free] == kEmpty && growthLeft_ == 0) {
+      reserveOneLocked();
+      free = findFreeLocked(h);
+    }
+    if (ctrl_[free] == kDeleted) {
+      deleted_--;
+    } else {
+      growthLeft_--;
+    }
+    setCtrl(free, h2(h));
+    size_++;
+    slot = static_cast<int64_t>(free);
+    track(nullptr, &logPos);
+  } else {
+    const auto& old = slots_[slot];
+    LogPos oldPos(old.fileId_, old.valueSize_, 0, 0);
+    track(&oldPos, &logPos);
+  }
+  auto& entry = slots_[slot];
+  entry.key_ = key;
+  entry.fileId_ = logPos.fileId_;
+  entry.posLow_ = static_cast<uint32_t>(logPos.pos_);
+  entry.posHigh_ = static_cast<uint8_t>(logPos.pos_ >> 32);
+  entry.valueSize_ = logPos.valueSize_;
+}
+
+bool FlatIndex::removeLocked(KeyType key) {
+  auto slot = findLocked(key, hash(key));
+  if (slot < 0) {
+    return false;
+  }
+  const auto& old = slots_[slot];
+  LogPos oldPos(old.fileId_, old.valueSize_, 0, 0);
+  track(&oldPos, nullptr);
+  // Leave a tombstone, so that the probe sequences going through the slot are not cut short
+  setCtrl(slot, kDeleted);
+  size_--;
+  deleted_++;
+  return true;
+}
+
+void FlatIndex::reserveOneLocked() {
+  if (capacity_ == 0) {
+    resizeLocked(kGroupSize);
+  } else if (size_ < capacity_ / 16 * 7) {
+    // Mostly tombstones, dropping them makes enough room
+    resizeLocked(capacity_);
+  } else {
+    resizeLocked(capacity_ * 2);
+  }
+}
+
+void FlatIndex::resizeLocked(size_t capacity) {
+  auto oldCtrl = std::move(ctrl_);
+  auto oldSlots = std::move(slots_);
+  auto oldCapacity = capacity_;
+
+  ctrl_ = std::make_unique<int8_t[]>(capacity + kGroupSize);
+  std::memset(ctrl_.get(), kEmpty, capacity + kGroupSize);
+  // Slots are only read once their control byte says they are full, leave them uninitialized
+  slots_.reset(new Slot[capacity]);
+  capacity_ = capacity;
+  for (size_t i = 0; i < oldCapacity; i++) {
+    if (oldCtrl[i] >= 0) {
+      auto h = hash(oldSlots[i].key_);
+      auto slot = findFreeLocked(h);
+      setCtrl(slot, h2(h));
+      slots_[slot] = oldSlots[i];
+    }
+  }
+  deleted_ = 0;
+  growthLeft_ = capacity / 8 * 7 - size_;
+}
+
+Status FlatIndex::put(const KeyType& key, std::shared_ptr<LogPos> logPos) {
+  if (logPos->pos_ >= static_cast<FileOffset>(kMaxFileSize)) {
+    return Status::ERROR(Status::Code::kOverLimit, "Offset over limit of the flat index");
+  }
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  putLocked(key, *logPos);
+  return Status::OK();
+}
+
+StatusOr<std::shared_ptr<LogPos>> FlatIndex::get(const KeyType& key) {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  auto slot = findLocked(key, hash(key));
+  if (slot < 0) {
+    return notFound();
+  }
+  return toLogPos(slots_[slot]);
+}
+
+std::vector<StatusOr<std::shared_ptr<LogPos>>> FlatIndex::multiGet(
+    const std::vector<KeyType>& keys) {
+  std::vector<StatusOr<std::shared_ptr<LogPos>>> results;
+  results.reserve(keys.size());
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  for (const auto& key : keys) {
+    auto slot = findLocked(key, hash(key));
+    if (slot < 0) {
+      results.emplace_back(notFound());
+    } else {
+      results.emplace_back(toLogPos(slots_[slot]));
+    }
+  }
+  return results;
+}
+
+Status FlatIndex::remove(const KeyType& key) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  if (!removeLocked(key)) {
+    return notFound();
+  }
+  return Status::OK();
+}
+
+Status FlatIndex::compareAndPut(const KeyType& key,
+                                const LogPos& expected,
+                                std::shared_ptr<LogPos> logPos) {
+  if (logPos->pos_ >= static_cast<FileOffset>(kMaxFileSize)) {
+    return Status::ERROR(Status::Code::kOverLimit, "Offset over limit of the flat index");
+  }
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  auto slot = findLocked(key, hash(key));
+  if (slot < 0 || !toLogPos(slots_[slot])->sameRecord(expected)) {
+    return notFound();
+  }
+  putLocked(key, *logPos);
+  return Status::OK();
+}
+
+Status FlatIndex::batchUpdate(
+    const std::vector<std::pair<KeyType, std::shared_ptr<LogPos>>>& updates) {
+  // Check all updates first, so that none is applied if one can't be
+  for (const auto& update : updates) {
+    if (update.second && update.second->pos_ >= static_cast<FileOffset>(kMaxFileSize)) {
+      return Status::ERROR(Status::Code::kOverLimit, "Offset over limit of the flat index");
+    }
+  }
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  for (const auto& [key, logPos] : updates) {
+    if (logPos) {
+      putLocked(key, *logPos);
+    } else {
+      removeLocked(key);
+    }
+  }
+  return Status::OK();
+}
+
+StatusOr<std::vector<KeyType>> FlatIndex::listKeys() {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  std::vector<KeyType> keys;
+  keys.reserve(size_);
+  for (size_t i = 0; i < capacity_; i++) {
+    if (ctrl_[i] >= 0) {
+      keys.emplace_back(slots_[i].key_);
+    }
+  }
+  return keys;
+}
+
+std::unique_ptr<Index::IterRes> FlatIndex::FlatIndexIterator::next() {
+  while (slot_ < index_.capacity_) {
+    auto slot = slot_++;
+    if (index_.ctrl_[slot] >= 0) {
+      auto res = std::make_unique<IterRes>();
+      res->key = index_.slots_[slot].key_;
+      res->logPos = toLogPos(index_.slots_[slot]);
+      return res;
+    }
+  }
+  return nullptr;
+}
+
+std::unique_ptr<Index::Iterator> FlatIndex::createIterator() {
+  return std::make_unique<FlatIndexIterator>(*this);
+}
+
+size_t FlatIndex::size() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return size_;
+}
+
+size_t FlatIndex::capacity() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return capacity_;
+}
+
+size_t FlatIndex::memoryUsage() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  if (capacity_ == 0) {
+    return 0;
+  }
+  return capacity_ * sizeof(Slot) + capacity_ + kGroupSize;
+}
+
+}  // namespace bitcask
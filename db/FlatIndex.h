@@ -0,0 +1,138 @@
+#ifndef DB_FLATINDEX_H_
+#define DB_FLATINDEX_H_
+
+#include "db/Index.h"
+
+namespace bitcask {
+
+// FlatIndex is a compact hash index: an open addressing table in the style of the Swiss tables,
+// with the location of the record stored inline in the slot instead of in a node and a LogPos of
+// its own. A slot takes 16 bytes plus one control byte, where HashIndex takes a hash node, a
+// shared_ptr control block and a LogPos per key.
+//
+// Each slot has a control byte telling whether it's empty, deleted, or full, and if it's full 7
+// bits of the hash of its key. Lookups scan the control bytes of a group of 16 slots at once with
+// SSE2, and only compare the keys of the slots whose 7 bits match. Groups are probed
+// quadratically, and the table grows once it's 7/8 full, tombstones included.
+//
+// Only what reads need is kept: the file id, the offset, which must be below 2^40, and the value
+// size. The timestamp of the record is not, so the LogPos handed out has a tstamp_ of 0. The
+// table is protected by a single reader writer lock.
+class FlatIndex : public Index {
+ public:
+  // Offsets are stored in 40 bits, so the data files can't be any larger
+  static constexpr size_t kMaxFileSize = size_t(1) << 40;
+
+  FlatIndex() : FlatIndex(0) {}
+
+  // Reserve room for initialSize keys
+  explicit FlatIndex(size_t initialSize);
+
+  ~FlatIndex() override = default;
+
+  Status put(const KeyType& key, std::shared_ptr<LogPos> logPos) override;
+
+  StatusOr<std::shared_ptr<LogPos>> get(const KeyType& key) override;
+
+  std::vector<StatusOr<std::shared_ptr<LogPos>>> multiGet(
+      const std::vector<KeyType>& keys) override;
+
+  Status remove(const KeyType& key) override;
+
+  Status compareAndPut(const KeyType& key,
+                       const LogPos& expected,
+                       std::shared_ptr<LogPos> logPos) override;
+
+  Status batchUpdate(
+      const std::vector<std::pair<KeyType, std::shared_ptr<LogPos>>>& updates) override;
+
+  StatusOr<std::vector<KeyType>> listKeys() override;
+
+  class FlatIndexIterator : public Iterator {
+   public:
+    // Hold a shared lock of the index until the iterator is destroyed, no writes are allowed
+    // during iteration.
+    explicit FlatIndexIterator(const FlatIndex& flatIndex) : index_(flatIndex) {
+      index_.mutex_.lock_shared();
+    }
+
+    ~FlatIndexIterator() override {
+      index_.mutex_.unlock_shared();
+    }
+
+    std::unique_ptr<IterRes> next() override;
+
+   private:
+    const FlatIndex& index_;
+    size_t slot_{0};
+  };
+
+  std::unique_ptr<Iterator> createIterator() override;
+
+  // Number of keys
+  size_t size() const;
+
+  // Number of slots
+  size_t capacity() const;
+
+  // Bytes taken by the slots and the control bytes
+  size_t memoryUsage() const;
+
+  FlatIndex& operator=(const FlatIndex&) = delete;
+
+ private:
+  static constexpr size_t kGroupSize = 16;
+
+  // The location of a record packed in 16 bytes
+  struct Slot {
+    KeyType key_;
+    FileID fileId_;
+    uint32_t posLow_;
+    uint16_t valueSize_;
+    uint8_t posHigh_;
+  };
+  static_assert(sizeof(Slot) == 16, "slots are 16 bytes");
+
+  static uint64_t hash(KeyType key);
+
+  // The slot of key, or -1 if it's not there. Require holding mutex_.
+  int64_t findLocked(KeyType key, uint64_t hash) const;
+
+  // Insert or update key. Require holding mutex_ exclusively.
+  void putLocked(KeyType key, const LogPos& logPos);
+
+  // Require holding mutex_ exclusively
+  bool removeLocked(KeyType key);
+
+  // The first empty or deleted slot of the probe sequence of hash. Require holding mutex_.
+  size_t findFreeLocked(uint64_t hash) const;
+
+  // Set the control byte of slot, and its clone past the end for the slots of the first group
+  void setCtrl(size_t slot, int8_t ctrl);
+
+  // Rehash all keys into a table of capacity slots. Require holding mutex_ exclusively.
+  void resizeLocked(size_t capacity);
+
+  // Make room for one more key, by dropping the tombstones or growing the table. Require holding
+  // mutex_ exclusively.
+  void reserveOneLocked();
+
+  static std::shared_ptr<LogPos> toLogPos(const Slot& slot);
+
+  // capacity_ + kGroupSize control bytes, the last kGroupSize cloning the first ones, so that a
+  // group can be loaded at any slot without wrapping around. A full slot has the 7 low bits of the
+  // hash of its key, with the high bit clear.
+  std::unique_ptr<int8_t[]> ctrl_;
+  std::unique_ptr<Slot[]> slots_;
+  // A power of 2, at least kGroupSize
+  size_t capacity_{0};
+  size_t size_{0};
+  size_t deleted_{0};
+  // Number of keys which can still be inserted into empty slots before the table is resized
+  size_t growthLeft_{0};
+  mutable std::shared_mutex mutex_;
+};
+
+}  // namespace bitcask
+
+#endif  // DB_FLATINDEX_H_
@@ -8,7 +8,9 @@ HashIndex::HashIndex(size_t initialSize) {
 
 Status HashIndex::put(const KeyType& key, std::shared_ptr<LogPos> logPos) {
   std::unique_lock<std::shared_mutex> lock(mutex_);
-  indexMap_[key] = std::move(logPos);
+  auto& slot = indexMap_[key];
+  track(slot.get(), logPos.get());
+  slot = std::move(logPos);
   return Status::OK();
 }
 
@@ -22,10 +24,27 @@ StatusOr<std::shared_ptr<LogPos>> HashIndex::get(const KeyType& key) {
   }
 }
 
+std::vector<StatusOr<std::shared_ptr<LogPos>>> HashIndex::multiGet(
+    const std::vector<KeyType>& keys) {
+  std::vector<StatusOr<std::shared_ptr<LogPos>>> results;
+  results.reserve(keys.size());
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  for (const auto& key : keys) {
+    auto it = indexMap_.find(key);
+    if (it != indexMap_.end()) {
+      results.emplace_back(it->second);
+    } else {
+      results.emplace_back(Status::ERROR(Status::Code::kNotFound, "Key not found"));
+    }
+  }
+  return results;
+}
+
 Status HashIndex::remove(const KeyType& key) {
   std::unique_lock<std::shared_mutex> lock(mutex_);
   auto it = indexMap_.find(key);
   if (it != indexMap_.end()) {
+    track(it->second.get(), nullptr);
     indexMap_.erase(it);
     return Status::OK();
   } else {
@@ -33,6 +52,38 @@ Status HashIndex::remove(const KeyType& key) {
   }
 }
 
+Status HashIndex::compareAndPut(const KeyType& key,
+                                const LogPos& expected,
+                                std::shared_ptr<LogPos> logPos) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  auto it = indexMap_.find(key);
+  if (it == indexMap_.end() || !it->second->sameRecord(expected)) {
+    return Status::ERROR(Status::Code::kNotFound, "Key not found");
+  }
+  track(it->second.get(), logPos.get());
+  it->second = std::move(logPos);
+  return Status::OK();
+}
+
+Status HashIndex::batchUpdate(
+    const std::vector<std::pair<KeyType, std::shared_ptr<LogPos>>>& updates) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  for (const auto& [key, logPos] : updates) {
+    if (logPos) {
+      auto& slot = indexMap_[key];
+      track(slot.get(), logPos.get());
+      slot = logPos;
+    } else {
+      auto it = indexMap_.find(key);
+      if (it != indexMap_.end()) {
+        track(it->second.get(), nullptr);
+        indexMap_.erase(it);
+      }
+    }
+  }
+  return Status::OK();
+}
+
 StatusOr<std::vector<KeyType>> HashIndex::listKeys() {
   std::shared_lock<std::shared_mutex> lock(mutex_);
   std::vector<KeyType> keys;
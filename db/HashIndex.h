@@ -16,8 +16,18 @@ class HashIndex : public Index {
 
   StatusOr<std::shared_ptr<LogPos>> get(const KeyType& key) override;
 
+  std::vector<StatusOr<std::shared_ptr<LogPos>>> multiGet(
+      const std::vector<KeyType>& keys) override;
+
   Status remove(const KeyType& key) override;
 
+  Status compareAndPut(const KeyType& key,
+                       const LogPos& expected,
+                       std::shared_ptr<LogPos> logPos) override;
+
+  Status batchUpdate(
+      const std::vector<std::pair<KeyType, std::shared_ptr<LogPos>>>& updates) override;
+
   StatusOr<std::vector<KeyType>> listKeys() override;
 
   class HashIndexIterator : public Iterator {
@@ -0,0 +1,146 @@
+#include "db/HintFile.h"
+
+#include "utils/Crc.h"
+
+namespace bitcask {
+
+namespace {
+
+Status ioError(const std::string& what, const std::string& fileName) {
+  auto message = fmt::format("{} {}: {}", what, fileName, strerror(errno));
+  FLOG_ERROR("{}", message);
+  return Status::ERROR(Status::Code::kError, message);
+}
+
+Status corrupted(const std::string& fileName) {
+  return Status::ERROR(Status::Code::kError, "Corrupted hint file " + fileName);
+}
+
+}  // namespace
+
+std::string HintFile::fileName(const std::string& dbname, FileID fileId) {
+  return fmt::format("{}/{}.hint", dbname, fileId);
+}
+
+Status HintFile::write(const std::string& dbname,
+                       FileID fileId,
+                       const std::vector<HintEntry>& entries,
+                       FileOffset dataEnd) {
+  std::string buf(entries.size() * kHintEntrySize + kHintTrailerSize, '\0');
+  char* p = buf.data();
+  for (const auto& entry : entries) {
+    std::memcpy(p, &entry.tstamp_, sizeof(entry.tstamp_));
+    p += sizeof(entry.tstamp_);
+    std::memcpy(p, &entry.logType_, sizeof(entry.logType_));
+    p += sizeof(entry.logType_);
+    std::memcpy(p, &entry.valueSize_, sizeof(entry.valueSize_));
+    p += sizeof(entry.valueSize_);
+    std::memcpy(p, &entry.pos_, sizeof(entry.pos_));
+    p += sizeof(entry.pos_);
+    std::memcpy(p, &entry.key_, sizeof(entry.key_));
+    p += sizeof(entry.key_);
+  }
+  std::memcpy(p, &dataEnd, sizeof(dataEnd));
+  p += sizeof(dataEnd);
+  uint32_t crc = crc::crc32c(buf.data(), p - buf.data());
+  std::memcpy(p, &crc, sizeof(crc));
+
+  auto name = fileName(dbname, fileId);
+  auto tmpName = name + ".tmp";
+  int fd = open(tmpName.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+  if (fd == -1) {
+    return ioError("Failed to create hint file", tmpName);
+  }
+  size_t written = 0;
+  while (written < buf.size()) {
+    auto ret = ::write(fd, buf.data() + written, buf.size() - written);
+    if (ret == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      auto status = ioError("Failed to write hint file", tmpName);
+      close(fd);
+      return status;
+    }
+    written += ret;
+  }
+  if (fdatasync(fd) == -1) {
+    auto status = ioError("Failed to sync hint file", tmpName);
+    close(fd);
+    return status;
+  }
+  close(fd);
+  if (rename(tmpName.c_str(), name.c_str()) == -1) {
+    return ioError("Failed to rename hint file", tmpName);
+  }
+  FVLOG1("Wrote hint file {} with {} entries", name, entries.size());
+  return Status::OK();
+}
+
+StatusOr<std::vector<HintEntry>> HintFile::read(const std::string& dbname,
+                                                FileID fileId,
+                                                size_t dataSize) {
+  auto name = fileName(dbname, fileId);
+  int fd = open(name.c_str(), O_RDONLY);
+  if (fd == -1) {
+    if (errno == ENOENT) {
+      return Status::ERROR(Status::Code::kNoSuchFile, "No hint file " + name);
+    }
+    return ioError("Failed to open hint file", name);
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    auto status = ioError("Failed to stat hint file", name);
+    close(fd);
+    return status;
+  }
+  std::string buf(st.st_size, '\0');
+  size_t done = 0;
+  while (done < buf.size()) {
+    auto ret = ::read(fd, buf.data() + done, buf.size() - done);
+    if (ret == -1 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      auto status = ret == 0 ? corrupted(name) : ioError("Failed to read hint file", name);
+      close(fd);
+      return status;
+    }
+    done += ret;
+  }
+  close(fd);
+
+  if (buf.size() < kHintTrailerSize || (buf.size() - kHintTrailerSize) % kHintEntrySize != 0) {
+    return corrupted(name);
+  }
+  const char* trailer = buf.data() + buf.size() - kHintTrailerSize;
+  FileOffset dataEnd = 0;
+  uint32_t crc = 0;
+  std::memcpy(&dataEnd, trailer, sizeof(dataEnd));
+  std::memcpy(&crc, trailer + sizeof(dataEnd), sizeof(crc));
+  if (crc != crc::crc32c(buf.data(), buf.size() - sizeof(crc))) {
+    return corrupted(name);
+  }
+  // The data file lost records listed in the hint file
+  if (dataEnd < 0 || static_cast<size_t>(dataEnd) > dataSize) {
+    return Status::ERROR(Status::Code::kError, "Hint file doesn't match its data file: " + name);
+  }
+
+  std::vector<HintEntry> entries((buf.size() - kHintTrailerSize) / kHintEntrySize);
+  const char* p = buf.data();
+  for (auto& entry : entries) {
+    std::memcpy(&entry.tstamp_, p, sizeof(entry.tstamp_));
+    p += sizeof(entry.tstamp_);
+    std::memcpy(&entry.logType_, p, sizeof(entry.logType_));
+    p += sizeof(entry.logType_);
+    std::memcpy(&entry.valueSize_, p, sizeof(entry.valueSize_));
+    p += sizeof(entry.valueSize_);
+    std::memcpy(&entry.pos_, p, sizeof(entry.pos_));
+    p += sizeof(entry.pos_);
+    std::memcpy(&entry.key_, p, sizeof(entry.key_));
+    p += sizeof(entry.key_);
+  }
+  return entries;
+}
+
+}  // namespace bitcask
@@ -0,0 +1,55 @@
+#ifndef DB_HINTFILE_H_
+#define DB_HINTFILE_H_
+
+#include "bitcask/Base.h"
+#include "bitcask/StatusOr.h"
+#include "bitcask/Types.h"
+#include "db/LogRecord.h"
+
+namespace bitcask {
+
+// An update of the index made by a log record: a WRITE of key at pos, or a DELETE of key
+struct HintEntry {
+  KeyType key_;
+  LogType logType_;
+  uint16_t valueSize_;
+  FileOffset pos_;
+  int64_t tstamp_;
+};
+
+// Size of an encoded hint entry
+// tstamp | LogType | valueSize | pos | key
+static const size_t kHintEntrySize =
+    sizeof(int64_t) + sizeof(LogType) + sizeof(uint16_t) + sizeof(FileOffset) + sizeof(KeyType);
+
+// Size of the trailer of a hint file
+// dataEnd | crc
+static const size_t kHintTrailerSize = sizeof(FileOffset) + sizeof(uint32_t);
+
+// A hint file lists the updates of the index made by the records of an immutable data file, in
+// order, without their values, so that the index is rebuilt from it without reading the data file.
+// The records of batches are listed as plain writes and deletes, as only complete batches are.
+// It's named after its data file, e.g. 3.hint for 3.data, and ends with a trailer holding the end
+// of the records in the data file and the crc32c of everything before the crc.
+class HintFile {
+ public:
+  static std::string fileName(const std::string& dbname, FileID fileId);
+
+  // Write the hint file of data file fileId, whose records end at dataEnd. It's written to a
+  // temporary file, synced, and renamed into place, so that a hint file is always complete.
+  static Status write(const std::string& dbname,
+                      FileID fileId,
+                      const std::vector<HintEntry>& entries,
+                      FileOffset dataEnd);
+
+  // Read the entries of the hint file of data file fileId, which is dataSize bytes. Return
+  // kNoSuchFile if there is no hint file, and kError if it's corrupted or doesn't match the data
+  // file.
+  static StatusOr<std::vector<HintEntry>> read(const std::string& dbname,
+                                               FileID fileId,
+                                               size_t dataSize);
+};
+
+}  // namespace bitcask
+
+#endif  // DB_HINTFILE_H_
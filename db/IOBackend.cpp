@@ -0,0 +1,669 @@
+#include "db/IOBackend.h"
+
+#include <limits.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+DEFINE_uint32(io_uring_entries, 64, "Number of submission queue entries of each io_uring");
+DEFINE_uint32(io_uring_spin_us,
+              0,
+              "Microseconds to busy poll the io_uring completion queue before waiting in kernel");
+
+namespace bitcask {
+
+namespace {
+
+// advance iovs by n bytes already transferred. Return the index of the first iovec left.
+int advanceIovs(struct iovec* iovs, int iovCnt, int iovIdx, size_t n) {
+  while (iovIdx < iovCnt && n >= iovs[iovIdx].iov_len) {
+    n -= iovs[iovIdx].iov_len;
+    iovIdx++;
+  }
+  if (n > 0) {
+    iovs[iovIdx].iov_base = static_cast<char*>(iovs[iovIdx].iov_base) + n;
+    iovs[iovIdx].iov_len -= n;
+  }
+  return iovIdx;
+}
+
+Status readError(int err) {
+  FLOG_ERROR("Read failure: {}", std::string(strerror(err)));
+  return Status::ERROR(Status::Code::kError, "Read failure: " + std::string(strerror(err)));
+}
+
+Status writeError(int err) {
+  FLOG_ERROR("Write failure: {}", std::string(strerror(err)));
+  return Status::ERROR(Status::Code::kError, "Write failure" + std::string(strerror(err)));
+}
+
+// A write which made no progress, which would otherwise be retried forever
+Status noProgressError() {
+  FLOG_ERROR("Write failure: no bytes written");
+  return Status::ERROR(Status::Code::kError, "Write failure: no bytes written");
+}
+
+// The submission queue of an io_uring is full, which means completions were lost
+Status ringFullError() {
+  return Status::ERROR(Status::Code::kError, "io_uring submission queue full");
+}
+
+Status syncError(int err) {
+  return Status::ERROR(Status::Code::kError, "Error syncing file: " + std::string(strerror(err)));
+}
+
+}  // namespace
+
+IOBackend* IOBackend::get(IOBackendType type) {
+  static PosixIOBackend posix;
+  static IoUringIOBackend ioUring;
+  if (type == IOBackendType::kIoUring) {
+    static bool ioUringSupported = IoUringIOBackend::supported();
+    if (ioUringSupported) {
+      return &ioUring;
+    }
+  }
+  return &posix;
+}
+
+Status PosixIOBackend::read(int fd, char* buf, size_t size, FileOffset offset) {
+  auto ret = readSome(fd, buf, size, offset);
+  if (!ret.ok()) {
+    return ret.status();
+  }
+  if (ret.value() < size) {
+    return Status::ERROR(Status::Code::kEOF, "EOF");
+  }
+  return Status::OK();
+}
+
+StatusOr<size_t> PosixIOBackend::readSome(int fd, char* buf, size_t size, FileOffset offset) {
+  size_t totalRead = 0;
+  while (totalRead < size) {
+    auto bytesRead = pread(fd, buf + totalRead, size - totalRead, offset + totalRead);
+    if (bytesRead == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return readError(errno);
+    } else if (bytesRead == 0) {
+      break;
+    }
+    totalRead += bytesRead;
+  }
+  return totalRead;
+}
+
+Status PosixIOBackend::readv(
+    int fd, struct iovec* iovs, int iovCnt, FileOffset offset, size_t totalSize) {
+  size_t bytesRead = 0;
+  int iovIdx = 0;
+  while (bytesRead < totalSize) {
+    ssize_t result =
+        preadv(fd, &iovs[iovIdx], std::min(iovCnt - iovIdx, IOV_MAX), offset + bytesRead);
+    if (result == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return readError(errno);
+    } else if (result == 0) {
+      return Status::ERROR(Status::Code::kEOF, "EOF");
+    }
+    bytesRead += result;
+    iovIdx = advanceIovs(iovs, iovCnt, iovIdx, result);
+  }
+  return Status::OK();
+}
+
+Status PosixIOBackend::writev(
+    int fd, struct iovec* iovs, int iovCnt, FileOffset offset, size_t totalSize) {
+  // pwritev may write partially and takes at most IOV_MAX buffers per call, so keep advancing
+  // through the iovecs until everything is on disk.
+  size_t bytesWritten = 0;
+  int iovIdx = 0;
+  while (bytesWritten < totalSize) {
+    ssize_t result =
+        pwritev(fd, &iovs[iovIdx], std::min(iovCnt - iovIdx, IOV_MAX), offset + bytesWritten);
+    if (result == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return writeError(errno);
+    } else if (result == 0) {
+      return noProgressError();
+    }
+    bytesWritten += result;
+    iovIdx = advanceIovs(iovs, iovCnt, iovIdx, result);
+  }
+  return Status::OK();
+}
+
+Status PosixIOBackend::sync(int fd, bool dataOnly) {
+  if ((dataOnly ? fdatasync(fd) : fsync(fd)) == -1) {
+    return syncError(errno);
+  }
+  return Status::OK();
+}
+
+void PosixIOBackend::readBatch(std::vector<ReadRequest>& requests) {
+  for (auto& request : requests) {
+    request.status_ = read(request.fd_, request.buf_, request.size_, request.offset_);
+  }
+}
+
+// A minimal io_uring: the rings mmapped from the kernel and the bookkeeping of their heads and
+// tails. Only used by its owner thread.
+class IoUringIOBackend::Ring {
+ public:
+  Ring() = default;
+  Ring(const Ring&) = delete;
+  Ring& operator=(const Ring&) = delete;
+
+  ~Ring() {
+    if (sqes_ != nullptr) {
+      munmap(sqes_, sqesSize_);
+    }
+    if (cqRing_ != nullptr && cqRing_ != sqRing_) {
+      munmap(cqRing_, cqRingSize_);
+    }
+    if (sqRing_ != nullptr) {
+      munmap(sqRing_, sqRingSize_);
+    }
+    if (fd_ != -1) {
+      close(fd_);
+    }
+  }
+
+  Status init(unsigned entries) {
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd_ < 0) {
+      fd_ = -1;
+      return Status::ERROR(Status::Code::kError,
+                           "io_uring_setup failure: " + std::string(strerror(errno)));
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap) {
+      sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+    sqRing_ = mmap(nullptr,
+                   sqRingSize_,
+                   PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE,
+                   fd_,
+                   IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) {
+      sqRing_ = nullptr;
+      return mmapError();
+    }
+    if (singleMmap) {
+      cqRing_ = sqRing_;
+    } else {
+      cqRing_ = mmap(nullptr,
+                     cqRingSize_,
+                     PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE,
+                     fd_,
+                     IORING_OFF_CQ_RING);
+      if (cqRing_ == MAP_FAILED) {
+        cqRing_ = nullptr;
+        return mmapError();
+      }
+    }
+    sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr,
+                      sqesSize_,
+                      PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE,
+                      fd_,
+                      IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      return mmapError();
+    }
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+    auto* sq = static_cast<char*>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqEntries_ = params.sq_entries;
+    sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    auto* cq = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    localTail_ = *sqTail_;
+    submittedTail_ = localTail_;
+    return Status::OK();
+  }
+
+  // Whether the kernel supports all the opcodes. Kernels without IORING_REGISTER_PROBE (before
+  // 5.6) don't support IORING_OP_READ either.
+  bool supportsOps(std::initializer_list<uint8_t> ops) {
+    constexpr unsigned kMaxOps = 256;
+    size_t size = sizeof(struct io_uring_probe) + kMaxOps * sizeof(struct io_uring_probe_op);
+    std::vector<char> buf(size, 0);
+    auto* probe = reinterpret_cast<struct io_uring_probe*>(buf.data());
+    if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, kMaxOps) < 0) {
+      return false;
+    }
+    for (auto op : ops) {
+      if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Get a zeroed sqe to fill in, or nullptr if the submission queue is full
+  struct io_uring_sqe* getSqe() {
+    auto head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (localTail_ - head >= sqEntries_ || inflight_ >= sqEntries_) {
+      return nullptr;
+    }
+    auto idx = localTail_ & sqMask_;
+    sqArray_[idx] = idx;
+    localTail_++;
+    inflight_++;
+    auto* sqe = &sqes_[idx];
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+  }
+
+  // Submit the filled sqes, and wait until at least one completion is available. On failure, all
+  // sqes in flight are waited for and their completions dropped, so that the kernel no longer
+  // writes to the buffers of the caller once it returns.
+  Status submitAndWait() {
+    auto status = trySubmitAndWait();
+    if (!status.ok()) {
+      drain();
+    }
+    return status;
+  }
+
+  // Whether sqes may still be in flight after a failure to wait for them. The ring must not be
+  // used any more.
+  bool broken() const {
+    return broken_;
+  }
+
+  // Call func(userData, res) on each available completion
+  template <typename F>
+  void reap(F&& func) {
+    auto head = *cqHead_;
+    auto tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      auto& cqe = cqes_[head & cqMask_];
+      func(cqe.user_data, cqe.res);
+      head++;
+      inflight_--;
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+  }
+
+ private:
+  Status trySubmitAndWait() {
+    __atomic_store_n(sqTail_, localTail_, __ATOMIC_RELEASE);
+    unsigned toSubmit = localTail_ - submittedTail_;
+    submittedTail_ = localTail_;
+
+    if (FLAGS_io_uring_spin_us > 0) {
+      // submit without waiting, then poll the completion queue for a while
+      if (toSubmit > 0) {
+        auto status = enter(toSubmit, 0, 0);
+        if (!status.ok()) {
+          return status;
+        }
+      }
+      auto deadline =
+          std::chrono::steady_clock::now() + std::chrono::microseconds(FLAGS_io_uring_spin_us);
+      while (std::chrono::steady_clock::now() < deadline) {
+        if (hasCompletion()) {
+          return Status::OK();
+        }
+      }
+      toSubmit = 0;
+    }
+    if (hasCompletion()) {
+      return toSubmit > 0 ? enter(toSubmit, 0, 0) : Status::OK();
+    }
+    return enter(toSubmit, 1, IORING_ENTER_GETEVENTS);
+  }
+
+  // Wait for all sqes in flight, submitting the ones the kernel has not consumed yet, and drop
+  // their completions. The ring is broken if the kernel can't be waited for.
+  void drain() {
+    reap([](uint64_t, int) {});
+    int attempts = 0;
+    while (inflight_ > 0) {
+      unsigned unconsumed = localTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+      if (enter(unconsumed, 1, IORING_ENTER_GETEVENTS).ok()) {
+        attempts = 0;
+      } else if (errno == EAGAIN || errno == EBUSY) {
+        // Out of resources for now
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      } else if (++attempts > 3) {
+        FLOG_ERROR("Failed to wait for {} io_uring completions, stop using the ring", inflight_);
+        broken_ = true;
+        return;
+      }
+      reap([](uint64_t, int) {});
+    }
+  }
+
+  bool hasCompletion() const {
+    return *cqHead_ != __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+  }
+
+  Status enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    while (syscall(__NR_io_uring_enter, fd_, toSubmit, minComplete, flags, nullptr, 0) < 0) {
+      if (errno == EINTR) {
+        // all sqes have been consumed if the call was interrupted while waiting
+        toSubmit = 0;
+        continue;
+      }
+      // errno is kept for the caller
+      int err = errno;
+      auto status = Status::ERROR(Status::Code::kError,
+                                  "io_uring_enter failure: " + std::string(strerror(err)));
+      errno = err;
+      return status;
+    }
+    return Status::OK();
+  }
+
+  Status mmapError() {
+    return Status::ERROR(Status::Code::kError,
+                         "io_uring mmap failure: " + std::string(strerror(errno)));
+  }
+
+  int fd_{-1};
+  void* sqRing_{nullptr};
+  size_t sqRingSize_{0};
+  void* cqRing_{nullptr};
+  size_t cqRingSize_{0};
+  struct io_uring_sqe* sqes_{nullptr};
+  size_t sqesSize_{0};
+
+  unsigned* sqHead_{nullptr};
+  unsigned* sqTail_{nullptr};
+  unsigned sqMask_{0};
+  unsigned sqEntries_{0};
+  unsigned* sqArray_{nullptr};
+  unsigned* cqHead_{nullptr};
+  unsigned* cqTail_{nullptr};
+  unsigned cqMask_{0};
+  struct io_uring_cqe* cqes_{nullptr};
+
+  // sqes filled so far, and sqes published to the kernel
+  unsigned localTail_{0};
+  unsigned submittedTail_{0};
+  // sqes submitted whose completion is not reaped yet. Bounded by sqEntries_ so that the completion
+  // queue never overflows.
+  unsigned inflight_{0};
+  bool broken_{false};
+};
+
+bool IoUringIOBackend::supported() {
+  Ring ring;
+  auto status = ring.init(1);
+  if (!status.ok()) {
+    FLOG_WARN("io_uring is not available, fall back to posix I/O: {}", status.toString());
+    return false;
+  }
+  if (!ring.supportsOps({IORING_OP_READ, IORING_OP_READV, IORING_OP_WRITEV, IORING_OP_FSYNC})) {
+    FLOG_WARN("io_uring does not support the operations needed, fall back to posix I/O");
+    return false;
+  }
+  return true;
+}
+
+IoUringIOBackend::Ring* IoUringIOBackend::threadRing() {
+  static thread_local std::unique_ptr<Ring> ring;
+  static thread_local bool failed = false;
+  if (!ring && !failed) {
+    auto newRing = std::make_unique<Ring>();
+    auto status = newRing->init(FLAGS_io_uring_entries);
+    if (!status.ok()) {
+      FLOG_ERROR("Failed to set up io_uring for thread, fall back to posix I/O: {}",
+                 status.toString());
+      failed = true;
+    } else {
+      ring = std::move(newRing);
+    }
+  }
+  // A broken ring is kept, as the kernel may still complete its sqes, but no longer used
+  return ring && !ring->broken() ? ring.get() : nullptr;
+}
+
+Status IoUringIOBackend::read(int fd, char* buf, size_t size, FileOffset offset) {
+  std::vector<ReadRequest> requests{{fd, buf, size, offset, Status::OK()}};
+  readBatch(requests);
+  return requests[0].status_;
+}
+
+StatusOr<size_t> IoUringIOBackend::readSome(int fd, char* buf, size_t size, FileOffset offset) {
+  auto* ring = threadRing();
+  if (ring == nullptr) {
+    return IOBackend::get(IOBackendType::kPosix)->readSome(fd, buf, size, offset);
+  }
+
+  size_t totalRead = 0;
+  while (totalRead < size) {
+    auto* sqe = ring->getSqe();
+    if (sqe == nullptr) {
+      return ringFullError();
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf + totalRead);
+    sqe->len = static_cast<uint32_t>(size - totalRead);
+    sqe->off = offset + totalRead;
+    auto status = ring->submitAndWait();
+    if (!status.ok()) {
+      return status;
+    }
+    int result = 0;
+    ring->reap([&](uint64_t, int res) { result = res; });
+    if (result < 0) {
+      if (result == -EINTR || result == -EAGAIN) {
+        continue;
+      }
+      return readError(-result);
+    } else if (result == 0) {
+      break;
+    }
+    totalRead += result;
+  }
+  return totalRead;
+}
+
+Status IoUringIOBackend::readv(
+    int fd, struct iovec* iovs, int iovCnt, FileOffset offset, size_t totalSize) {
+  auto* ring = threadRing();
+  if (ring == nullptr) {
+    return IOBackend::get(IOBackendType::kPosix)->readv(fd, iovs, iovCnt, offset, totalSize);
+  }
+
+  size_t bytesRead = 0;
+  int iovIdx = 0;
+  while (bytesRead < totalSize) {
+    auto* sqe = ring->getSqe();
+    if (sqe == nullptr) {
+      return ringFullError();
+    }
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&iovs[iovIdx]);
+    sqe->len = std::min(iovCnt - iovIdx, IOV_MAX);
+    sqe->off = offset + bytesRead;
+    auto status = ring->submitAndWait();
+    if (!status.ok()) {
+      return status;
+    }
+    int result = 0;
+    ring->reap([&](uint64_t, int res) { result = res; });
+    if (result < 0) {
+      if (result == -EINTR || result == -EAGAIN) {
+        continue;
+      }
+      return readError(-result);
+    } else if (result == 0) {
+      return Status::ERROR(Status::Code::kEOF, "EOF");
+    }
+    bytesRead += result;
+    iovIdx = advanceIovs(iovs, iovCnt, iovIdx, result);
+  }
+  return Status::OK();
+}
+
+void IoUringIOBackend::readBatch(std::vector<ReadRequest>& requests) {
+  auto* ring = threadRing();
+  if (ring == nullptr) {
+    IOBackend::get(IOBackendType::kPosix)->readBatch(requests);
+    return;
+  }
+
+  // Reads are submitted as many as the ring takes at once. Short reads are resubmitted for the
+  // rest.
+  std::vector<size_t> bytesRead(requests.size(), 0);
+  std::deque<size_t> todo;
+  for (size_t i = 0; i < requests.size(); i++) {
+    requests[i].status_ = Status::OK();
+    if (requests[i].size_ > 0) {
+      todo.push_back(i);
+    }
+  }
+  size_t inflight = 0;
+  while (!todo.empty() || inflight > 0) {
+    while (!todo.empty()) {
+      auto* sqe = ring->getSqe();
+      if (sqe == nullptr) {
+        break;
+      }
+      auto i = todo.front();
+      todo.pop_front();
+      auto& request = requests[i];
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = request.fd_;
+      sqe->addr = reinterpret_cast<uint64_t>(request.buf_ + bytesRead[i]);
+      sqe->len = static_cast<uint32_t>(request.size_ - bytesRead[i]);
+      sqe->off = request.offset_ + bytesRead[i];
+      sqe->user_data = i;
+      inflight++;
+    }
+    if (inflight == 0) {
+      // Nothing to wait for, the ring is full of sqes of no one
+      for (auto i : todo) {
+        requests[i].status_ = ringFullError();
+      }
+      return;
+    }
+
+    auto status = ring->submitAndWait();
+    if (!status.ok()) {
+      // The reads in flight were waited for and dropped, fail whatever is not done yet.
+      for (size_t i = 0; i < requests.size(); i++) {
+        if (requests[i].status_.ok() && bytesRead[i] < requests[i].size_) {
+          requests[i].status_ = status;
+        }
+      }
+      return;
+    }
+
+    ring->reap([&](uint64_t i, int res) {
+      inflight--;
+      auto& request = requests[i];
+      if (res < 0) {
+        if (res == -EINTR || res == -EAGAIN) {
+          todo.push_back(i);
+        } else {
+          request.status_ = readError(-res);
+        }
+      } else if (res == 0) {
+        request.status_ = Status::ERROR(Status::Code::kEOF, "EOF");
+      } else {
+        bytesRead[i] += res;
+        if (bytesRead[i] < request.size_) {
+          todo.push_back(i);
+        }
+      }
+    });
+  }
+}
+
+Status IoUringIOBackend::writev(
+    int fd, struct iovec* iovs, int iovCnt, FileOffset offset, size_t totalSize) {
+  auto* ring = threadRing();
+  if (ring == nullptr) {
+    return IOBackend::get(IOBackendType::kPosix)->writev(fd, iovs, iovCnt, offset, totalSize);
+  }
+
+  size_t bytesWritten = 0;
+  int iovIdx = 0;
+  while (bytesWritten < totalSize) {
+    auto* sqe = ring->getSqe();
+    if (sqe == nullptr) {
+      return ringFullError();
+    }
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&iovs[iovIdx]);
+    sqe->len = std::min(iovCnt - iovIdx, IOV_MAX);
+    sqe->off = offset + bytesWritten;
+    auto status = ring->submitAndWait();
+    if (!status.ok()) {
+      return status;
+    }
+    int result = 0;
+    ring->reap([&](uint64_t, int res) { result = res; });
+    if (result < 0) {
+      if (result == -EINTR || result == -EAGAIN) {
+        continue;
+      }
+      return writeError(-result);
+    } else if (result == 0) {
+      return noProgressError();
+    }
+    bytesWritten += result;
+    iovIdx = advanceIovs(iovs, iovCnt, iovIdx, result);
+  }
+  return Status::OK();
+}
+
+Status IoUringIOBackend::sync(int fd, bool dataOnly) {
+  auto* ring = threadRing();
+  if (ring == nullptr) {
+    return IOBackend::get(IOBackendType::kPosix)->sync(fd, dataOnly);
+  }
+
+  while (true) {
+    auto* sqe = ring->getSqe();
+    if (sqe == nullptr) {
+      return ringFullError();
+    }
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fd = fd;
+    sqe->fsync_flags = dataOnly ? IORING_FSYNC_DATASYNC : 0;
+    auto status = ring->submitAndWait();
+    if (!status.ok()) {
+      return status;
+    }
+    int result = 0;
+    ring->reap([&](uint64_t, int res) { result = res; });
+    if (result == -EINTR) {
+      continue;
+    }
+    if (result < 0) {
+      return syncError(-result);
+    }
+    return Status::OK();
+  }
+}
+
+}  // namespace bitcask
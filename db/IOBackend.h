@@ -0,0 +1,102 @@
+#ifndef DB_IOBACKEND_H_
+#define DB_IOBACKEND_H_
+
+#include <sys/uio.h>
+
+#include "bitcask/Base.h"
+#include "bitcask/Options.h"
+#include "bitcask/StatusOr.h"
+#include "bitcask/Types.h"
+
+DECLARE_uint32(io_uring_entries);
+DECLARE_uint32(io_uring_spin_us);
+
+namespace bitcask {
+
+// IOBackend does the positional I/O of data files. All calls transfer the full size, retrying on
+// partial I/O, and return kEOF when a read hits the end of the file.
+class IOBackend {
+ public:
+  virtual ~IOBackend() = default;
+
+  virtual Status read(int fd, char* buf, size_t size, FileOffset offset) = 0;
+
+  // Read up to size bytes, stopping at the end of the file. Return the number of bytes read.
+  virtual StatusOr<size_t> readSome(int fd, char* buf, size_t size, FileOffset offset) = 0;
+
+  // Read totalSize bytes at offset scattered into iovs. iovs are consumed.
+  virtual Status readv(
+      int fd, struct iovec* iovs, int iovCnt, FileOffset offset, size_t totalSize) = 0;
+
+  // iovs are consumed
+  virtual Status writev(
+      int fd, struct iovec* iovs, int iovCnt, FileOffset offset, size_t totalSize) = 0;
+
+  // sync the file. Only sync the data and the metadata needed to read it back if dataOnly is set.
+  virtual Status sync(int fd, bool dataOnly) = 0;
+
+  struct ReadRequest {
+    int fd_;
+    char* buf_;
+    size_t size_;
+    FileOffset offset_;
+    Status status_;
+  };
+
+  // Issue all reads at once and wait for all of them. The result of each read is in its status_.
+  virtual void readBatch(std::vector<ReadRequest>& requests) = 0;
+
+  // Get the backend of the given type. Backends are process wide singletons. If io_uring is not
+  // supported by the kernel, the posix backend is returned instead.
+  static IOBackend* get(IOBackendType type);
+};
+
+// Blocking pread/preadv/pwritev/fsync
+class PosixIOBackend : public IOBackend {
+ public:
+  Status read(int fd, char* buf, size_t size, FileOffset offset) override;
+
+  StatusOr<size_t> readSome(int fd, char* buf, size_t size, FileOffset offset) override;
+
+  Status readv(
+      int fd, struct iovec* iovs, int iovCnt, FileOffset offset, size_t totalSize) override;
+
+  Status writev(
+      int fd, struct iovec* iovs, int iovCnt, FileOffset offset, size_t totalSize) override;
+
+  Status sync(int fd, bool dataOnly) override;
+
+  void readBatch(std::vector<ReadRequest>& requests) override;
+};
+
+// io_uring without liburing. Each thread submits to its own ring, so that no locking or extra
+// thread is needed: a call fills sqes for all its I/O, submits them with a single io_uring_enter,
+// and reaps the completions, optionally spinning on the completion queue for FLAGS_io_uring_spin_us
+// before going to sleep in the kernel.
+class IoUringIOBackend : public IOBackend {
+ public:
+  // Tell if io_uring works on this kernel
+  static bool supported();
+
+  Status read(int fd, char* buf, size_t size, FileOffset offset) override;
+
+  StatusOr<size_t> readSome(int fd, char* buf, size_t size, FileOffset offset) override;
+
+  Status readv(
+      int fd, struct iovec* iovs, int iovCnt, FileOffset offset, size_t totalSize) override;
+
+  Status writev(
+      int fd, struct iovec* iovs, int iovCnt, FileOffset offset, size_t totalSize) override;
+
+  Status sync(int fd, bool dataOnly) override;
+
+  void readBatch(std::vector<ReadRequest>& requests) override;
+
+ private:
+  class Ring;
+  static Ring* threadRing();
+};
+
+}  // namespace bitcask
+
+#endif  // DB_IOBACKEND_H_
@@ -4,6 +4,7 @@
 #include "bitcask/Base.h"
 #include "bitcask/StatusOr.h"
 #include "bitcask/Types.h"
+#include "db/SpaceTracker.h"
 
 namespace bitcask {
 
@@ -15,6 +16,11 @@ struct LogPos {
 
   LogPos(const FileID& fileId, const uint16_t& valueSize, const int64_t& pos, const int64_t& tstamp)
       : fileId_(fileId), valueSize_(valueSize), pos_(pos), tstamp_(tstamp) {}
+
+  // Whether both are the location of the same record
+  bool sameRecord(const LogPos& other) const {
+    return fileId_ == other.fileId_ && pos_ == other.pos_;
+  }
 };
 
 class Index {
@@ -24,8 +30,23 @@ class Index {
   virtual Status put(const KeyType& key, std::shared_ptr<LogPos> logPos) = 0;
   virtual StatusOr<std::shared_ptr<LogPos>> get(const KeyType& key) = 0;
 
+  // Look up all keys at once. Results are in the order of keys.
+  virtual std::vector<StatusOr<std::shared_ptr<LogPos>>> multiGet(
+      const std::vector<KeyType>& keys) = 0;
+
   virtual Status remove(const KeyType& key) = 0;
 
+  // Move key to logPos only if it's still at expected, i.e. the same record, as a merge does when
+  // it has copied the record. Return kNotFound if key has been written or removed meanwhile.
+  virtual Status compareAndPut(const KeyType& key,
+                               const LogPos& expected,
+                               std::shared_ptr<LogPos> logPos) = 0;
+
+  // Apply a group of updates at once, so that readers observe either none or all of them. A null
+  // logPos removes the key. Updates are applied in order.
+  virtual Status batchUpdate(
+      const std::vector<std::pair<KeyType, std::shared_ptr<LogPos>>>& updates) = 0;
+
   virtual StatusOr<std::vector<KeyType>> listKeys() = 0;
 
   struct IterRes {
@@ -41,9 +62,33 @@ class Index {
 
   virtual std::unique_ptr<Iterator> createIterator() = 0;
 
+  // Keep the live bytes of the data files up to date in tracker as keys are put and removed. Set
+  // before the index is used.
+  void setSpaceTracker(SpaceTracker* tracker) {
+    tracker_ = tracker;
+  }
+
   Index& operator=(const Index&) = delete;
 
   virtual ~Index() = default;
+
+ protected:
+  // A key moved from the record at old to the one at logPos. Either is null if the key was absent,
+  // or is removed. Called by the implementations with the key locked.
+  void track(const LogPos* old, const LogPos* logPos) {
+    if (!tracker_) {
+      return;
+    }
+    if (old) {
+      tracker_->supersede(old->fileId_, old->valueSize_);
+    }
+    if (logPos) {
+      tracker_->put(logPos->fileId_, logPos->valueSize_);
+    }
+  }
+
+ private:
+  SpaceTracker* tracker_{nullptr};
 };
 
 }  // namespace bitcask
@@ -0,0 +1,205 @@
+#include "db/IndexSnapshot.h"
+
+#include <sys/mman.h>
+
+#include "utils/Crc.h"
+
+namespace bitcask {
+
+namespace {
+
+// Entries are encoded into a buffer of this size, written when it's full
+const size_t kWriteBufferSize = 1024 * 1024;
+
+Status ioError(const std::string& what, const std::string& fileName) {
+  auto message = fmt::format("{} {}: {}", what, fileName, strerror(errno));
+  FLOG_ERROR("{}", message);
+  return Status::ERROR(Status::Code::kError, message);
+}
+
+Status corrupted(const std::string& fileName) {
+  return Status::ERROR(Status::Code::kError, "Corrupted index snapshot " + fileName);
+}
+
+template <typename T>
+char* encode(char* p, const T& value) {
+  std::memcpy(p, &value, sizeof(value));
+  return p + sizeof(value);
+}
+
+template <typename T>
+const char* decode(const char* p, T* value) {
+  std::memcpy(value, p, sizeof(*value));
+  return p + sizeof(*value);
+}
+
+Status writeAll(int fd, const std::string& fileName, const std::string& buf) {
+  size_t written = 0;
+  while (written < buf.size()) {
+    auto ret = ::write(fd, buf.data() + written, buf.size() - written);
+    if (ret == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return ioError("Failed to write index snapshot", fileName);
+    }
+    written += ret;
+  }
+  return Status::OK();
+}
+
+}  // namespace
+
+std::string IndexSnapshot::fileName(const std::string& dbname) {
+  return dbname + "/INDEX";
+}
+
+Status IndexSnapshot::write(const std::string& dbname,
+                            Index* index,
+                            const std::vector<FileID>& fileIds,
+                            WritePosition position) {
+  auto name = fileName(dbname);
+  auto tmpName = name + ".tmp";
+  int fd = ::open(tmpName.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+  if (fd == -1) {
+    return ioError("Failed to create index snapshot", tmpName);
+  }
+  auto fail = [fd](const Status& status) {
+    close(fd);
+    return status;
+  };
+
+  std::string buf;
+  buf.reserve(kWriteBufferSize);
+  uint32_t crc = 0;
+  uint64_t numEntries = 0;
+  char entry[kSnapshotEntrySize];
+  auto iterator = index->createIterator();
+  for (auto res = iterator->next(); res; res = iterator->next()) {
+    const auto& logPos = *res->logPos;
+    char* p = encode(entry, res->key);
+    p = encode(p, logPos.fileId_);
+    p = encode(p, logPos.valueSize_);
+    p = encode(p, logPos.pos_);
+    encode(p, logPos.tstamp_);
+    buf.append(entry, kSnapshotEntrySize);
+    numEntries++;
+    if (buf.size() + kSnapshotEntrySize > kWriteBufferSize) {
+      crc = crc::extend32c(crc, buf.data(), buf.size());
+      auto status = writeAll(fd, tmpName, buf);
+      if (!status.ok()) {
+        return fail(status);
+      }
+      buf.clear();
+    }
+  }
+  iterator.reset();
+
+  for (auto fileId : fileIds) {
+    buf.append(reinterpret_cast<const char*>(&fileId), sizeof(fileId));
+  }
+  char trailer[kSnapshotTrailerSize];
+  char* p = encode(trailer, numEntries);
+  p = encode(p, static_cast<uint32_t>(fileIds.size()));
+  p = encode(p, position.fileId_);
+  encode(p, position.offset_);
+  buf.append(trailer, kSnapshotTrailerSize - sizeof(crc));
+  crc = crc::extend32c(crc, buf.data(), buf.size());
+  buf.append(reinterpret_cast<const char*>(&crc), sizeof(crc));
+  auto status = writeAll(fd, tmpName, buf);
+  if (!status.ok()) {
+    return fail(status);
+  }
+
+  if (fdatasync(fd) == -1) {
+    return fail(ioError("Failed to sync index snapshot", tmpName));
+  }
+  close(fd);
+  if (rename(tmpName.c_str(), name.c_str()) == -1) {
+    return ioError("Failed to rename index snapshot", tmpName);
+  }
+  FLOG_INFO("Wrote index snapshot with {} entries at {}:{}",
+            numEntries,
+            position.fileId_,
+            position.offset_);
+  return Status::OK();
+}
+
+StatusOr<std::unique_ptr<IndexSnapshot>> IndexSnapshot::open(const std::string& dbname) {
+  auto name = fileName(dbname);
+  int fd = ::open(name.c_str(), O_RDONLY);
+  if (fd == -1) {
+    if (errno == ENOENT) {
+      return Status::ERROR(Status::Code::kNoSuchFile, "No index snapshot " + name);
+    }
+    return ioError("Failed to open index snapshot", name);
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    auto status = ioError("Failed to stat index snapshot", name);
+    close(fd);
+    return status;
+  }
+  size_t size = st.st_size;
+  if (size < kSnapshotTrailerSize) {
+    close(fd);
+    return corrupted(name);
+  }
+  // The whole snapshot is read once, in order
+  void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return ioError("Failed to map index snapshot", name);
+  }
+  madvise(data, size, MADV_SEQUENTIAL);
+  std::unique_ptr<IndexSnapshot> snapshot(new IndexSnapshot(static_cast<const char*>(data), size));
+
+  const char* trailer = snapshot->data_ + size - kSnapshotTrailerSize;
+  uint64_t numEntries = 0;
+  uint32_t numFileIds = 0;
+  uint32_t crc = 0;
+  const char* p = decode(trailer, &numEntries);
+  p = decode(p, &numFileIds);
+  p = decode(p, &snapshot->position_.fileId_);
+  p = decode(p, &snapshot->position_.offset_);
+  decode(p, &crc);
+  auto bodySize = size - kSnapshotTrailerSize;
+  if (numFileIds > bodySize / sizeof(FileID) ||
+      numEntries > bodySize / kSnapshotEntrySize ||
+      numEntries * kSnapshotEntrySize + numFileIds * sizeof(FileID) != bodySize) {
+    return corrupted(name);
+  }
+  if (crc != crc::crc32c(snapshot->data_, size - sizeof(crc))) {
+    return corrupted(name);
+  }
+  snapshot->numEntries_ = numEntries;
+  snapshot->fileIds_.resize(numFileIds);
+  p = snapshot->data_ + numEntries * kSnapshotEntrySize;
+  for (auto& fileId : snapshot->fileIds_) {
+    p = decode(p, &fileId);
+  }
+  return snapshot;
+}
+
+IndexSnapshot::~IndexSnapshot() {
+  munmap(const_cast<char*>(data_), size_);
+}
+
+void IndexSnapshot::load(Index* index) const {
+  const char* p = data_;
+  for (size_t i = 0; i < numEntries_; i++) {
+    KeyType key;
+    FileID fileId;
+    uint16_t valueSize;
+    FileOffset pos;
+    int64_t tstamp;
+    p = decode(p, &key);
+    p = decode(p, &fileId);
+    p = decode(p, &valueSize);
+    p = decode(p, &pos);
+    p = decode(p, &tstamp);
+    index->put(key, std::make_shared<LogPos>(fileId, valueSize, pos, tstamp));
+  }
+}
+
+}  // namespace bitcask
@@ -0,0 +1,78 @@
+#ifndef DB_INDEXSNAPSHOT_H_
+#define DB_INDEXSNAPSHOT_H_
+
+#include "bitcask/Base.h"
+#include "bitcask/StatusOr.h"
+#include "bitcask/Types.h"
+#include "db/Index.h"
+
+namespace bitcask {
+
+// Size of an encoded entry of an index snapshot
+// key | fileId | valueSize | pos | tstamp
+static const size_t kSnapshotEntrySize =
+    sizeof(KeyType) + sizeof(FileID) + sizeof(uint16_t) + sizeof(FileOffset) + sizeof(int64_t);
+
+// Size of the trailer of an index snapshot
+// numEntries | numFileIds | position fileId | position offset | crc
+static const size_t kSnapshotTrailerSize = sizeof(uint64_t) + sizeof(uint32_t) + sizeof(FileID) +
+                                           sizeof(FileOffset) + sizeof(uint32_t);
+
+// An index snapshot holds the locations of all keys of the index when the db was closed, so that
+// the index of a clean restart is loaded with one sequential read instead of from the data files.
+// It covers the records of the data files it lists up to a write position, and the records after it
+// are replayed on top of it. It's laid out as the entries, the ids of the data files, and a trailer
+// with the crc32c of everything before the crc.
+class IndexSnapshot {
+ public:
+  static std::string fileName(const std::string& dbname);
+
+  // Write a snapshot of index, covering the records of the data files fileIds up to position. It's
+  // written to a temporary file, synced, and renamed into place, so that a snapshot is always
+  // complete. The index must not be updated meanwhile.
+  static Status write(const std::string& dbname,
+                      Index* index,
+                      const std::vector<FileID>& fileIds,
+                      WritePosition position);
+
+  // Map and verify the snapshot of the db. Return kNoSuchFile if there is none, and kError if it's
+  // corrupted.
+  static StatusOr<std::unique_ptr<IndexSnapshot>> open(const std::string& dbname);
+
+  IndexSnapshot(const IndexSnapshot&) = delete;
+  IndexSnapshot& operator=(const IndexSnapshot&) = delete;
+
+  ~IndexSnapshot();
+
+  // The data files covered by the snapshot, in id order
+  const std::vector<FileID>& fileIds() const {
+    return fileIds_;
+  }
+
+  // The end of the records covered by the snapshot
+  WritePosition position() const {
+    return position_;
+  }
+
+  size_t numEntries() const {
+    return numEntries_;
+  }
+
+  // Put all entries into index
+  void load(Index* index) const;
+
+ private:
+  IndexSnapshot(const char* data, size_t size) : data_(data), size_(size) {}
+
+  // The mapped snapshot
+  const char* data_;
+  size_t size_;
+
+  size_t numEntries_{0};
+  std::vector<FileID> fileIds_;
+  WritePosition position_;
+};
+
+}  // namespace bitcask
+
+#endif  // DB_INDEXSNAPSHOT_H_
@@ -25,37 +25,54 @@ LogRecord::LogRecord(std::unique_ptr<LogRecordHeader> header) : header_(std::mov
 void LogRecord::encode() {
   // total size is awalys set together with buf_
   buf_ = reinterpret_cast<char*>(malloc(totalSize_));
-  // Encode the key, value, timestamp, logType into buf_ for CRC calculation
-  int index = 0;
-  std::memcpy(buf_ + index, reinterpret_cast<const char*>(&header_->crc_), sizeof(header_->crc_));
-  index += sizeof(header_->crc_);
-  std::memcpy(
-      buf_ + index, reinterpret_cast<const char*>(&header_->tstamp_), sizeof(header_->tstamp_));
-  index += sizeof(header_->tstamp_);
-  std::memcpy(
-      buf_ + index, reinterpret_cast<const char*>(&header_->logType_), sizeof(header_->logType_));
-  index += sizeof(header_->logType_);
-  std::memcpy(
-      buf_ + index, reinterpret_cast<const char*>(&header_->keySize_), sizeof(header_->keySize_));
-  index += sizeof(header_->keySize_);
-  std::memcpy(buf_ + index,
-              reinterpret_cast<const char*>(&header_->valueSize_),
-              sizeof(header_->valueSize_));
-  index += sizeof(header_->valueSize_);
-
-  std::memcpy(buf_ + index, reinterpret_cast<const char*>(&key_), sizeof(key_));
-  index += sizeof(key_);
-  std::memcpy(buf_ + index, value_.data(), value_.size());
-
-  // Calculate CRC-32 of the encoded buffer
-  auto crcSize = sizeof(header_->crc_);
-  uint32_t crcValue = crc::crc32(buf_ + crcSize, totalSize_ - crcSize);
-  memcpy(buf_, reinterpret_cast<const char*>(&crcValue), sizeof(crcValue));
+  encodeTo(buf_, key_, value_.data(), header_->valueSize_, header_->logType_, header_->tstamp_);
+}
+
+size_t LogRecord::encodeTo(char* buf,
+                           const KeyType& key,
+                           const char* value,
+                           uint16_t valueSize,
+                           LogType logType,
+                           int64_t tstamp) {
+  encodeHeader(buf, key, value, valueSize, logType, tstamp);
+  std::memcpy(buf + kLogHeaderAndKeySize, value, valueSize);
+  return kLogHeaderAndKeySize + valueSize;
+}
+
+void LogRecord::encodeHeader(char* buf,
+                             const KeyType& key,
+                             const char* value,
+                             uint16_t valueSize,
+                             LogType logType,
+                             int64_t tstamp) {
+  // Encode the key, timestamp, logType into buf for CRC calculation
+  uint8_t keySize = sizeof(KeyType);
+  int index = sizeof(uint32_t);  // leave room for crc
+  std::memcpy(buf + index, reinterpret_cast<const char*>(&tstamp), sizeof(tstamp));
+  index += sizeof(tstamp);
+  uint8_t logTypeByte = static_cast<uint8_t>(logType) | kLogTypeCrc32cFlag;
+  std::memcpy(buf + index, &logTypeByte, sizeof(logTypeByte));
+  index += sizeof(logTypeByte);
+  std::memcpy(buf + index, reinterpret_cast<const char*>(&keySize), sizeof(keySize));
+  index += sizeof(keySize);
+  std::memcpy(buf + index, reinterpret_cast<const char*>(&valueSize), sizeof(valueSize));
+  index += sizeof(valueSize);
+
+  std::memcpy(buf + index, reinterpret_cast<const char*>(&key), sizeof(key));
+  index += sizeof(key);
+
+  // Calculate CRC32C of the encoded header and key, then extend it over the value in place
+  uint32_t crcValue = computeCrc(buf, index, value, valueSize);
+  memcpy(buf, reinterpret_cast<const char*>(&crcValue), sizeof(crcValue));
 }
 
-std::unique_ptr<LogRecordHeader> LogRecord::decodeLogRecordHeader(char* buf) {
+std::unique_ptr<LogRecordHeader> LogRecord::decodeLogRecordHeader(const char* buf) {
   auto header = std::make_unique<LogRecordHeader>();
+  decodeHeaderTo(buf, header.get());
+  return header;
+}
 
+void LogRecord::decodeHeaderTo(const char* buf, LogRecordHeader* header) {
   int index = 0;
   std::memcpy(&header->crc_, buf + index, sizeof(header->crc_));
   index += sizeof(header->crc_);
@@ -63,16 +80,29 @@ std::unique_ptr<LogRecordHeader> LogRecord::decodeLogRecordHeader(char* buf) {
   std::memcpy(&header->tstamp_, buf + index, sizeof(header->tstamp_));
   index += sizeof(header->tstamp_);
 
-  std::memcpy(&header->logType_, buf + index, sizeof(header->logType_));
-  index += sizeof(header->logType_);
+  uint8_t logTypeByte;
+  std::memcpy(&logTypeByte, buf + index, sizeof(logTypeByte));
+  header->logType_ = static_cast<LogType>(logTypeByte & ~kLogTypeCrc32cFlag);
+  header->crc32c_ = logTypeByte & kLogTypeCrc32cFlag;
+  index += sizeof(logTypeByte);
 
   std::memcpy(&header->keySize_, buf + index, sizeof(header->keySize_));
   index += sizeof(header->keySize_);
 
   std::memcpy(&header->valueSize_, buf + index, sizeof(header->valueSize_));
-  index += sizeof(header->valueSize_);
+}
 
-  return header;
+uint32_t LogRecord::computeCrc(const char* header,
+                               size_t headerSize,
+                               const char* rest,
+                               size_t restSize) {
+  auto crcSize = sizeof(uint32_t);
+  if (static_cast<uint8_t>(header[kLogTypeOffset]) & kLogTypeCrc32cFlag) {
+    auto crcValue = crc::crc32c(header + crcSize, headerSize - crcSize);
+    return crc::extend32c(crcValue, rest, restSize);
+  }
+  auto crcValue = crc::crc32(header + crcSize, headerSize - crcSize);
+  return crc::extend(crcValue, rest, restSize);
 }
 
 void LogRecord::loadKVFromBuf(const char* kvBuf, int32_t keySize, int32_t valueSize) {
@@ -12,12 +12,25 @@ namespace bitcask {
 enum class LogType : uint8_t {
   WRITE = 0,
   DELETE = 1,
+  BATCH = 2,
+  // Fills a range of a data file whose write failed, so that the records after it are still
+  // scanned. Skipped by all readers.
+  PADDING = 3,
 };
 
+// Set in the LogType byte of the records checksummed with CRC32C. The records written before it was
+// introduced are checksummed with CRC-32, and are still read as such.
+static const uint8_t kLogTypeCrc32cFlag = 0x80;
+
+// Offset of the LogType byte in an encoded log record
+static const size_t kLogTypeOffset = sizeof(uint32_t) + sizeof(int64_t);
+
 struct LogRecordHeader {
   uint32_t crc_;
   int64_t tstamp_;
   LogType logType_;
+  // Whether the crc is a CRC32C, i.e. kLogTypeCrc32cFlag is set
+  bool crc32c_{true};
   uint8_t keySize_{4};  // fixed 4B key size
   uint16_t valueSize_{0};
 
@@ -33,8 +46,19 @@ struct LogRecordHeader {
 static const size_t kLogHeaderSize =
     sizeof(uint32_t) + sizeof(int64_t) + sizeof(LogType) + sizeof(uint8_t) + sizeof(uint16_t);
 
+// Size of the encoded header and key, i.e. everything of a log record but the value.
+static const size_t kLogHeaderAndKeySize = kLogHeaderSize + sizeof(KeyType);
+
+// A write batch is stored as a BATCH log record followed by the log records in the batch. The key
+// of the BATCH record is the number of records in the batch, and its value is the size and the crc
+// of all the records following it: batch size (uint32_t) | batch crc (uint32_t) so that a torn
+// batch is detected and dropped as a whole.
+static const size_t kBatchValueSize = sizeof(uint32_t) + sizeof(uint32_t);
+
 // Structure of log record in data file
 // crc |tstamp | LogType | keySize | valueSize | key | value
+// The crc covers everything after itself. New records are checksummed with CRC32C, and flag it with
+// kLogTypeCrc32cFlag.
 class LogRecord {
   FRIEND_TEST(LogRecordTest, ConstructorTest);
 
@@ -54,7 +78,37 @@ class LogRecord {
     return buf_;
   }
 
-  static std::unique_ptr<LogRecordHeader> decodeLogRecordHeader(char* buf);
+  // encode a log record into buf, which must have room for kLogHeaderSize + sizeof(KeyType) +
+  // valueSize bytes. Return the encoded size.
+  static size_t encodeTo(char* buf,
+                         const KeyType& key,
+                         const char* value,
+                         uint16_t valueSize,
+                         LogType logType,
+                         int64_t tstamp);
+
+  // encode the header and the key of a log record into buf, which must have room for
+  // kLogHeaderAndKeySize bytes. The value is not copied, it's only read to compute the crc, so the
+  // caller writes it out right after buf from its own buffer.
+  static void encodeHeader(char* buf,
+                           const KeyType& key,
+                           const char* value,
+                           uint16_t valueSize,
+                           LogType logType,
+                           int64_t tstamp);
+
+  static std::unique_ptr<LogRecordHeader> decodeLogRecordHeader(const char* buf);
+
+  // Decode the header of an encoded log record into header, without allocating
+  static void decodeHeaderTo(const char* buf, LogRecordHeader* header);
+
+  // Compute the crc of an encoded log record, with the algorithm flagged in its header. The record
+  // is given as the first headerSize bytes, at least the header, and the rest of the record, which
+  // need not follow them in memory.
+  static uint32_t computeCrc(const char* header,
+                             size_t headerSize,
+                             const char* rest,
+                             size_t restSize);
 
   KeyType getKey() {
     return key_;
@@ -80,6 +134,10 @@ class LogRecord {
     return header_->logType_;
   }
 
+  bool isCrc32c() {
+    return header_->crc32c_;
+  }
+
   void loadKVFromBuf(const char* kvBuf, int32_t keySize, int32_t valueSize);
 
   ~LogRecord() {
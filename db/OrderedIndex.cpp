@@ -0,0 +1,338 @@
+#include "db/OrderedIndex.h"
+
+namespace bitcask {
+
+namespace {
+
+Status notFound() {
+  return Status::ERROR(Status::Code::kNotFound, "Key not found");
+}
+
+}  // namespace
+
+OrderedIndex::OrderedIndex() : root_(new Leaf()) {}
+
+OrderedIndex::~OrderedIndex() {
+  freeNode(root_);
+}
+
+void OrderedIndex::freeNode(Node* node) {
+  if (node->leaf_) {
+    delete static_cast<Leaf*>(node);
+    return;
+  }
+  auto* inner = static_cast<Inner*>(node);
+  for (int i = 0; i < inner->numChildren_; i++) {
+    freeNode(inner->children_[i]);
+  }
+  delete inner;
+}
+
+bool OrderedIndex::isEmpty(const Node* node) {
+  if (node->leaf_) {
+    return static_cast<const Leaf*>(node)->count_ == 0;
+  }
+  return static_cast<const Inner*>(node)->numChildren_ == 0;
+}
+
+const OrderedIndex::Leaf* OrderedIndex::findLeaf(KeyType key) const {
+  const Node* node = root_;
+  while (!node->leaf_) {
+    auto* inner = static_cast<const Inner*>(node);
+    auto idx = std::upper_bound(inner->keys_, inner->keys_ + inner->numChildren_ - 1, key) -
+               inner->keys_;
+    node = inner->children_[idx];
+  }
+  return static_cast<const Leaf*>(node);
+}
+
+std::optional<OrderedIndex::Split> OrderedIndex::putLocked(Node* node,
+                                                           KeyType key,
+                                                           std::shared_ptr<LogPos> logPos) {
+  if (node->leaf_) {
+    auto* leaf = static_cast<Leaf*>(node);
+    auto* keys = leaf->keys_;
+    auto* values = leaf->values_;
+    auto pos = std::lower_bound(keys, keys + leaf->count_, key) - keys;
+    if (pos < leaf->count_ && keys[pos] == key) {
+      track(values[pos].get(), logPos.get());
+      values[pos] = std::move(logPos);
+      return std::nullopt;
+    }
+    track(nullptr, logPos.get());
+    std::move_backward(keys + pos, keys + leaf->count_, keys + leaf->count_ + 1);
+    std::move_backward(values + pos, values + leaf->count_, values + leaf->count_ + 1);
+    keys[pos] = key;
+    values[pos] = std::move(logPos);
+    leaf->count_++;
+    size_++;
+    if (leaf->count_ <= kLeafCapacity) {
+      return std::nullopt;
+    }
+
+    // Move the upper half to a new leaf, linked right after this one
+    auto* right = new Leaf();
+    auto half = leaf->count_ / 2;
+    right->count_ = leaf->count_ - half;
+    std::move(keys + half, keys + leaf->count_, right->keys_);
+    std::move(values + half, values + leaf->count_, right->values_);
+    leaf->count_ = half;
+    right->prev_ = leaf;
+    right->next_ = leaf->next_;
+    if (leaf->next_) {
+      leaf->next_->prev_ = right;
+    }
+    leaf->next_ = right;
+    return Split{right->keys_[0], right};
+  }
+
+  auto* inner = static_cast<Inner*>(node);
+  auto* keys = inner->keys_;
+  auto* children = inner->children_;
+  auto numKeys = inner->numChildren_ - 1;
+  auto idx = std::upper_bound(keys, keys + numKeys, key) - keys;
+  auto split = putLocked(children[idx], key, std::move(logPos));
+  if (!split) {
+    return std::nullopt;
+  }
+  std::move_backward(keys + idx, keys + numKeys, keys + numKeys + 1);
+  std::move_backward(children + idx + 1, children + inner->numChildren_,
+                     children + inner->numChildren_ + 1);
+  keys[idx] = split->key_;
+  children[idx + 1] = split->right_;
+  inner->numChildren_++;
+  if (inner->numChildren_ <= kInnerCapacity) {
+    return std::nullopt;
+  }
+
+  // Move the upper half of the children to a new node. The key between both halves moves up.
+  auto* right = new Inner();
+  auto half = inner->numChildren_ / 2;
+  right->numChildren_ = inner->numChildren_ - half;
+  std::copy(children + half, children + inner->numChildren_, right->children_);
+  std::copy(keys + half, keys + inner->numChildren_ - 1, right->keys_);
+  inner->numChildren_ = half;
+  return Split{keys[half - 1], right};
+}
+
+void OrderedIndex::putLocked(KeyType key, std::shared_ptr<LogPos> logPos) {
+  auto split = putLocked(root_, key, std::move(logPos));
+  if (split) {
+    auto* root = new Inner();
+    root->numChildren_ = 2;
+    root->children_[0] = root_;
+    root->children_[1] = split->right_;
+    root->keys_[0] = split->key_;
+    root_ = root;
+  }
+}
+
+void OrderedIndex::dropLeaf(Leaf* leaf) {
+  if (leaf->prev_) {
+    leaf->prev_->next_ = leaf->next_;
+  }
+  if (leaf->next_) {
+    leaf->next_->prev_ = leaf->prev_;
+  }
+  delete leaf;
+}
+
+bool OrderedIndex::removeLocked(Node* node, KeyType key) {
+  if (node->leaf_) {
+    auto* leaf = static_cast<Leaf*>(node);
+    auto* keys = leaf->keys_;
+    auto pos = std::lower_bound(keys, keys + leaf->count_, key) - keys;
+    if (pos == leaf->count_ || keys[pos] != key) {
+      return false;
+    }
+    track(leaf->values_[pos].get(), nullptr);
+    std::move(keys + pos + 1, keys + leaf->count_, keys + pos);
+    std::move(leaf->values_ + pos + 1, leaf->values_ + leaf->count_, leaf->values_ + pos);
+    leaf->count_--;
+    leaf->values_[leaf->count_].reset();
+    size_--;
+    return true;
+  }
+
+  auto* inner = static_cast<Inner*>(node);
+  auto* keys = inner->keys_;
+  auto* children = inner->children_;
+  auto numKeys = inner->numChildren_ - 1;
+  auto idx = std::upper_bound(keys, keys + numKeys, key) - keys;
+  auto* child = children[idx];
+  if (!removeLocked(child, key)) {
+    return false;
+  }
+  if (isEmpty(child)) {
+    if (child->leaf_) {
+      dropLeaf(static_cast<Leaf*>(child));
+    } else {
+      delete static_cast<Inner*>(child);
+    }
+    // Drop the child along with the key on its left, or on its right for the first one. Its
+    // neighbour takes over its range of keys.
+    if (numKeys > 0) {
+      auto keyIdx = idx > 0 ? idx - 1 : 0;
+      std::move(keys + keyIdx + 1, keys + numKeys, keys + keyIdx);
+    }
+    std::move(children + idx + 1, children + inner->numChildren_, children + idx);
+    inner->numChildren_--;
+  }
+  return true;
+}
+
+bool OrderedIndex::removeLocked(KeyType key) {
+  if (!removeLocked(root_, key)) {
+    return false;
+  }
+  while (!root_->leaf_) {
+    auto* root = static_cast<Inner*>(root_);
+    if (root->numChildren_ == 0) {
+      delete root;
+      root_ = new Leaf();
+    } else if (root->numChildren_ == 1) {
+      root_ = root->children_[0];
+      delete root;
+    } else {
+      break;
+    }
+  }
+  return true;
+}
+
+Status OrderedIndex::put(const KeyType& key, std::shared_ptr<LogPos> logPos) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  putLocked(key, std::move(logPos));
+  return Status::OK();
+}
+
+StatusOr<std::shared_ptr<LogPos>> OrderedIndex::get(const KeyType& key) {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  auto* leaf = findLeaf(key);
+  auto pos = std::lower_bound(leaf->keys_, leaf->keys_ + leaf->count_, key) - leaf->keys_;
+  if (pos == leaf->count_ || leaf->keys_[pos] != key) {
+    return notFound();
+  }
+  return leaf->values_[pos];
+}
+
+std::vector<StatusOr<std::shared_ptr<LogPos>>> OrderedIndex::multiGet(
+    const std::vector<KeyType>& keys) {
+  std::vector<StatusOr<std::shared_ptr<LogPos>>> results;
+  results.reserve(keys.size());
+  for (const auto& key : keys) {
+    results.emplace_back(get(key));
+  }
+  return results;
+}
+
+Status OrderedIndex::remove(const KeyType& key) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  if (!removeLocked(key)) {
+    return notFound();
+  }
+  return Status::OK();
+}
+
+Status OrderedIndex::compareAndPut(const KeyType& key,
+                                   const LogPos& expected,
+                                   std::shared_ptr<LogPos> logPos) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  auto* leaf = findLeaf(key);
+  auto pos = std::lower_bound(leaf->keys_, leaf->keys_ + leaf->count_, key) - leaf->keys_;
+  if (pos == leaf->count_ || leaf->keys_[pos] != key || !leaf->values_[pos]->sameRecord(expected)) {
+    return notFound();
+  }
+  // The key is there, so the tree doesn't change shape
+  putLocked(key, std::move(logPos));
+  return Status::OK();
+}
+
+Status OrderedIndex::batchUpdate(
+    const std::vector<std::pair<KeyType, std::shared_ptr<LogPos>>>& updates) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  for (const auto& [key, logPos] : updates) {
+    if (logPos) {
+      putLocked(key, logPos);
+    } else {
+      removeLocked(key);
+    }
+  }
+  return Status::OK();
+}
+
+StatusOr<std::vector<KeyType>> OrderedIndex::listKeys() {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  std::vector<KeyType> keys;
+  keys.reserve(size_);
+  for (auto* leaf = findLeaf(std::numeric_limits<KeyType>::min()); leaf; leaf = leaf->next_) {
+    keys.insert(keys.end(), leaf->keys_, leaf->keys_ + leaf->count_);
+  }
+  return keys;
+}
+
+void OrderedIndex::collect(KeyType key,
+                           bool forward,
+                           size_t maxCount,
+                           std::vector<IterRes>* entries) const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  auto* leaf = findLeaf(key);
+  size_t count = 0;
+  if (forward) {
+    int pos = std::lower_bound(leaf->keys_, leaf->keys_ + leaf->count_, key) - leaf->keys_;
+    while (leaf && count < maxCount) {
+      for (; pos < leaf->count_ && count < maxCount; pos++, count++) {
+        entries->push_back({leaf->keys_[pos], leaf->values_[pos]});
+      }
+      leaf = leaf->next_;
+      pos = 0;
+    }
+  } else {
+    int pos = std::upper_bound(leaf->keys_, leaf->keys_ + leaf->count_, key) - leaf->keys_ - 1;
+    while (leaf && count < maxCount) {
+      for (; pos >= 0 && count < maxCount; pos--, count++) {
+        entries->push_back({leaf->keys_[pos], leaf->values_[pos]});
+      }
+      leaf = leaf->prev_;
+      if (leaf) {
+        pos = leaf->count_ - 1;
+      }
+    }
+  }
+}
+
+OrderedIndex::OrderedIndexIterator::OrderedIndexIterator(const OrderedIndex& index)
+    : index_(index) {
+  index_.mutex_.lock_shared();
+  leaf_ = index_.findLeaf(std::numeric_limits<KeyType>::min());
+}
+
+OrderedIndex::OrderedIndexIterator::~OrderedIndexIterator() {
+  index_.mutex_.unlock_shared();
+}
+
+std::unique_ptr<Index::IterRes> OrderedIndex::OrderedIndexIterator::next() {
+  while (leaf_ && pos_ == leaf_->count_) {
+    leaf_ = leaf_->next_;
+    pos_ = 0;
+  }
+  if (!leaf_) {
+    return nullptr;
+  }
+  auto res = std::make_unique<IterRes>();
+  res->key = leaf_->keys_[pos_];
+  res->logPos = leaf_->values_[pos_];
+  pos_++;
+  return res;
+}
+
+std::unique_ptr<Index::Iterator> OrderedIndex::createIterator() {
+  return std::make_unique<OrderedIndexIterator>(*this);
+}
+
+size_t OrderedIndex::size() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return size_;
+}
+
+}  // namespace bitcask
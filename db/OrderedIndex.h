@@ -0,0 +1,139 @@
+#ifndef DB_ORDEREDINDEX_H_
+#define DB_ORDEREDINDEX_H_
+
+#include <optional>
+
+#include "db/Index.h"
+
+namespace bitcask {
+
+// OrderedIndex keeps the keys in order, in a B+-tree, for range scans. Leaves hold up to
+// kLeafCapacity sorted keys along with their locations, and are linked both ways, so that a scan
+// is a walk along the leaves after a single descent. The tree is protected by a single reader
+// writer lock.
+//
+// Leaves emptied by removes are unlinked and dropped right away, and so are the inner nodes left
+// without children, but nodes are not merged with their siblings.
+class OrderedIndex : public Index {
+ public:
+  OrderedIndex();
+
+  ~OrderedIndex() override;
+
+  Status put(const KeyType& key, std::shared_ptr<LogPos> logPos) override;
+
+  StatusOr<std::shared_ptr<LogPos>> get(const KeyType& key) override;
+
+  std::vector<StatusOr<std::shared_ptr<LogPos>>> multiGet(
+      const std::vector<KeyType>& keys) override;
+
+  Status remove(const KeyType& key) override;
+
+  Status compareAndPut(const KeyType& key,
+                       const LogPos& expected,
+                       std::shared_ptr<LogPos> logPos) override;
+
+  Status batchUpdate(
+      const std::vector<std::pair<KeyType, std::shared_ptr<LogPos>>>& updates) override;
+
+  // Keys are listed in order
+  StatusOr<std::vector<KeyType>> listKeys() override;
+
+  // Append to entries up to maxCount keys along with their locations, in key order from the first
+  // key >= key if forward, or in reverse order from the last key <= key otherwise.
+  void collect(KeyType key, bool forward, size_t maxCount, std::vector<IterRes>* entries) const;
+
+ private:
+  struct Leaf;
+
+ public:
+  class OrderedIndexIterator : public Iterator {
+   public:
+    // Hold a shared lock of the index until the iterator is destroyed, no writes are allowed
+    // during iteration. Keys are iterated in order.
+    explicit OrderedIndexIterator(const OrderedIndex& index);
+
+    ~OrderedIndexIterator() override;
+
+    std::unique_ptr<IterRes> next() override;
+
+   private:
+    const OrderedIndex& index_;
+    const Leaf* leaf_{nullptr};
+    int pos_{0};
+  };
+
+  std::unique_ptr<Iterator> createIterator() override;
+
+  // Number of keys
+  size_t size() const;
+
+  OrderedIndex& operator=(const OrderedIndex&) = delete;
+
+ private:
+  static constexpr int kLeafCapacity = 64;
+  static constexpr int kInnerCapacity = 64;
+
+  struct Node {
+    explicit Node(bool leaf) : leaf_(leaf) {}
+    const bool leaf_;
+  };
+
+  // One more slot than the capacity, so that a full node can take a new entry before it's split
+  struct Leaf : Node {
+    Leaf() : Node(true) {}
+    int count_{0};
+    KeyType keys_[kLeafCapacity + 1];
+    std::shared_ptr<LogPos> values_[kLeafCapacity + 1];
+    Leaf* prev_{nullptr};
+    Leaf* next_{nullptr};
+  };
+
+  // Child i holds the keys in [keys_[i - 1], keys_[i])
+  struct Inner : Node {
+    Inner() : Node(false) {}
+    int numChildren_{0};
+    KeyType keys_[kInnerCapacity];
+    Node* children_[kInnerCapacity + 1];
+  };
+
+  // The upper half of a node which has been split, and the lowest key it holds
+  struct Split {
+    KeyType key_;
+    Node* right_;
+  };
+
+  // The leaf where key is, or would be. Require holding mutex_.
+  const Leaf* findLeaf(KeyType key) const;
+
+  // Insert or update key in the subtree of node. Return the upper half of node if it's been
+  // split. Require holding mutex_ exclusively.
+  std::optional<Split> putLocked(Node* node, KeyType key, std::shared_ptr<LogPos> logPos);
+
+  // Insert or update key, growing the tree if the root is split. Require holding mutex_
+  // exclusively.
+  void putLocked(KeyType key, std::shared_ptr<LogPos> logPos);
+
+  // Remove key from the subtree of node, dropping the nodes left empty. Return whether the key was
+  // there. Require holding mutex_ exclusively.
+  bool removeLocked(Node* node, KeyType key);
+
+  // Remove key, shrinking the tree if the root is left with a single child. Require holding mutex_
+  // exclusively.
+  bool removeLocked(KeyType key);
+
+  static bool isEmpty(const Node* node);
+
+  // Unlink an empty leaf from its siblings and free it
+  void dropLeaf(Leaf* leaf);
+
+  static void freeNode(Node* node);
+
+  Node* root_;
+  size_t size_{0};
+  mutable std::shared_mutex mutex_;
+};
+
+}  // namespace bitcask
+
+#endif  // DB_ORDEREDINDEX_H_
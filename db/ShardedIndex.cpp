@@ -0,0 +1,155 @@
+#include "db/ShardedIndex.h"
+
+DEFINE_uint32(index_shards, 64, "Number of independently locked shards of the sharded index");
+
+namespace bitcask {
+
+namespace {
+
+Status notFound() {
+  return Status::ERROR(Status::Code::kNotFound, "Key not found");
+}
+
+}  // namespace
+
+ShardedIndex::ShardedIndex(size_t initialSize)
+    : shards_(std::max<uint32_t>(1, FLAGS_index_shards)) {
+  for (auto& shard : shards_) {
+    shard.map_.reserve(initialSize / shards_.size());
+  }
+}
+
+Status ShardedIndex::put(const KeyType& key, std::shared_ptr<LogPos> logPos) {
+  auto& shard = shards_[shardOf(key)];
+  std::unique_lock<std::shared_mutex> lock(shard.mutex_);
+  auto& slot = shard.map_[key];
+  track(slot.get(), logPos.get());
+  slot = std::move(logPos);
+  return Status::OK();
+}
+
+StatusOr<std::shared_ptr<LogPos>> ShardedIndex::get(const KeyType& key) {
+  const auto& shard = shards_[shardOf(key)];
+  std::shared_lock<std::shared_mutex> lock(shard.mutex_);
+  auto it = shard.map_.find(key);
+  if (it == shard.map_.end()) {
+    return notFound();
+  }
+  return it->second;
+}
+
+std::vector<StatusOr<std::shared_ptr<LogPos>>> ShardedIndex::multiGet(
+    const std::vector<KeyType>& keys) {
+  std::vector<StatusOr<std::shared_ptr<LogPos>>> results;
+  results.reserve(keys.size());
+  for (const auto& key : keys) {
+    results.emplace_back(get(key));
+  }
+  return results;
+}
+
+Status ShardedIndex::remove(const KeyType& key) {
+  auto& shard = shards_[shardOf(key)];
+  std::unique_lock<std::shared_mutex> lock(shard.mutex_);
+  auto it = shard.map_.find(key);
+  if (it == shard.map_.end()) {
+    return notFound();
+  }
+  track(it->second.get(), nullptr);
+  shard.map_.erase(it);
+  return Status::OK();
+}
+
+Status ShardedIndex::compareAndPut(const KeyType& key,
+                                   const LogPos& expected,
+                                   std::shared_ptr<LogPos> logPos) {
+  auto& shard = shards_[shardOf(key)];
+  std::unique_lock<std::shared_mutex> lock(shard.mutex_);
+  auto it = shard.map_.find(key);
+  if (it == shard.map_.end() || !it->second->sameRecord(expected)) {
+    return notFound();
+  }
+  track(it->second.get(), logPos.get());
+  it->second = std::move(logPos);
+  return Status::OK();
+}
+
+Status ShardedIndex::batchUpdate(
+    const std::vector<std::pair<KeyType, std::shared_ptr<LogPos>>>& updates) {
+  // Lock the shards of all keys, in shard order to not deadlock with other batches
+  std::vector<size_t> shardIds;
+  shardIds.reserve(updates.size());
+  for (const auto& update : updates) {
+    shardIds.emplace_back(shardOf(update.first));
+  }
+  std::sort(shardIds.begin(), shardIds.end());
+  shardIds.erase(std::unique(shardIds.begin(), shardIds.end()), shardIds.end());
+  std::vector<std::unique_lock<std::shared_mutex>> locks;
+  locks.reserve(shardIds.size());
+  for (auto shardId : shardIds) {
+    locks.emplace_back(shards_[shardId].mutex_);
+  }
+
+  for (const auto& [key, logPos] : updates) {
+    auto& map = shards_[shardOf(key)].map_;
+    if (logPos) {
+      auto& slot = map[key];
+      track(slot.get(), logPos.get());
+      slot = logPos;
+    } else {
+      auto it = map.find(key);
+      if (it != map.end()) {
+        track(it->second.get(), nullptr);
+        map.erase(it);
+      }
+    }
+  }
+  return Status::OK();
+}
+
+StatusOr<std::vector<KeyType>> ShardedIndex::listKeys() {
+  std::vector<KeyType> keys;
+  for (const auto& shard : shards_) {
+    std::shared_lock<std::shared_mutex> lock(shard.mutex_);
+    for (const auto& pair : shard.map_) {
+      keys.emplace_back(pair.first);
+    }
+  }
+  return keys;
+}
+
+ShardedIndex::ShardedIndexIterator::ShardedIndexIterator(const ShardedIndex& index)
+    : index_(index) {
+  for (const auto& shard : index_.shards_) {
+    shard.mutex_.lock_shared();
+  }
+  it_ = index_.shards_[0].map_.begin();
+}
+
+ShardedIndex::ShardedIndexIterator::~ShardedIndexIterator() {
+  for (const auto& shard : index_.shards_) {
+    shard.mutex_.unlock_shared();
+  }
+}
+
+std::unique_ptr<Index::IterRes> ShardedIndex::ShardedIndexIterator::next() {
+  while (it_ == index_.shards_[shard_].map_.end()) {
+    if (++shard_ == index_.shards_.size()) {
+      // stay at the end of the last shard
+      shard_--;
+      return nullptr;
+    }
+    it_ = index_.shards_[shard_].map_.begin();
+  }
+  auto res = std::make_unique<IterRes>();
+  res->key = it_->first;
+  res->logPos = it_->second;
+  ++it_;
+  return res;
+}
+
+std::unique_ptr<Index::Iterator> ShardedIndex::createIterator() {
+  return std::make_unique<ShardedIndexIterator>(*this);
+}
+
+}  // namespace bitcask
@@ -0,0 +1,84 @@
+#ifndef DB_SHARDEDINDEX_H_
+#define DB_SHARDEDINDEX_H_
+
+#include "db/Index.h"
+
+DECLARE_uint32(index_shards);
+
+namespace bitcask {
+
+// ShardedIndex is a hash index split in FLAGS_index_shards shards by the hash of the key, each
+// with its own lock on its own cache line. A put only blocks the readers of its shard, and readers
+// of different shards don't share any cache line.
+//
+// A batch update locks the shards of all its keys, in shard order, before applying any update, so
+// that it's still observed all at once. Iterating locks all shards shared.
+class ShardedIndex : public Index {
+ public:
+  ShardedIndex() : ShardedIndex(0) {}
+
+  // Reserve room for initialSize keys, spread over the shards
+  explicit ShardedIndex(size_t initialSize);
+
+  ~ShardedIndex() override = default;
+
+  Status put(const KeyType& key, std::shared_ptr<LogPos> logPos) override;
+
+  StatusOr<std::shared_ptr<LogPos>> get(const KeyType& key) override;
+
+  std::vector<StatusOr<std::shared_ptr<LogPos>>> multiGet(
+      const std::vector<KeyType>& keys) override;
+
+  Status remove(const KeyType& key) override;
+
+  Status compareAndPut(const KeyType& key,
+                       const LogPos& expected,
+                       std::shared_ptr<LogPos> logPos) override;
+
+  Status batchUpdate(
+      const std::vector<std::pair<KeyType, std::shared_ptr<LogPos>>>& updates) override;
+
+  StatusOr<std::vector<KeyType>> listKeys() override;
+
+  class ShardedIndexIterator : public Iterator {
+   public:
+    // Hold a shared lock of all shards until the iterator is destroyed, no writes are allowed
+    // during iteration.
+    explicit ShardedIndexIterator(const ShardedIndex& index);
+
+    ~ShardedIndexIterator() override;
+
+    std::unique_ptr<IterRes> next() override;
+
+   private:
+    const ShardedIndex& index_;
+    size_t shard_{0};
+    std::unordered_map<KeyType, std::shared_ptr<LogPos>>::const_iterator it_;
+  };
+
+  std::unique_ptr<Iterator> createIterator() override;
+
+  size_t numShards() const {
+    return shards_.size();
+  }
+
+  ShardedIndex& operator=(const ShardedIndex&) = delete;
+
+ private:
+  struct alignas(64) Shard {
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<KeyType, std::shared_ptr<LogPos>> map_;
+  };
+
+  size_t shardOf(KeyType key) const {
+    // Fibonacci hashing, the high bits of the product depend on all bits of the key
+    return static_cast<size_t>((static_cast<uint32_t>(key) * 0x9E3779B97F4A7C15ULL) >> 32) %
+           shards_.size();
+  }
+
+  std::vector<Shard> shards_;
+};
+
+}  // namespace bitcask
+
+#endif  // DB_SHARDEDINDEX_H_
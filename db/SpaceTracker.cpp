@@ -0,0 +1,93 @@
+#include "db/SpaceTracker.h"
+
+#include "db/LogRecord.h"
+#include "utils/WallClock.h"
+
+namespace bitcask {
+
+namespace {
+
+int64_t recordSize(uint16_t valueSize) {
+  return static_cast<int64_t>(kLogHeaderAndKeySize + valueSize);
+}
+
+}  // namespace
+
+SpaceTracker::Counters* SpaceTracker::find(FileID fileId) const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  auto it = files_.find(fileId);
+  return it == files_.end() ? nullptr : it->second.get();
+}
+
+SpaceTracker::Counters* SpaceTracker::counters(FileID fileId) {
+  auto* counters = find(fileId);
+  if (counters) {
+    return counters;
+  }
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  auto& slot = files_[fileId];
+  if (!slot) {
+    slot = std::make_unique<Counters>();
+  }
+  return slot.get();
+}
+
+void SpaceTracker::addFile(FileID fileId, uint64_t size, int64_t mtimeMs) {
+  auto* file = counters(fileId);
+  file->total_ += static_cast<int64_t>(size);
+  file->lastWriteMs_ = mtimeMs;
+}
+
+void SpaceTracker::append(FileID fileId, uint64_t size) {
+  auto* file = counters(fileId);
+  file->total_ += static_cast<int64_t>(size);
+  file->lastWriteMs_.store(time::WallClock::fastNowInMilliSec(), std::memory_order_relaxed);
+}
+
+void SpaceTracker::put(FileID fileId, uint16_t valueSize) {
+  counters(fileId)->live_ += recordSize(valueSize);
+}
+
+void SpaceTracker::supersede(FileID fileId, uint16_t valueSize) {
+  // Nothing to do for a file merged away meanwhile
+  auto* file = find(fileId);
+  if (file) {
+    file->live_ -= recordSize(valueSize);
+  }
+}
+
+void SpaceTracker::remove(FileID fileId) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  files_.erase(fileId);
+}
+
+bool SpaceTracker::mergeable(FileID fileId, double minDeadRatio, int64_t minAgeMs) const {
+  auto* file = find(fileId);
+  if (!file) {
+    return false;
+  }
+  if (time::WallClock::fastNowInMilliSec() - file->lastWriteMs_ < minAgeMs) {
+    return false;
+  }
+  auto total = file->total_.load();
+  auto dead = total - file->live_.load();
+  return total == 0 || static_cast<double>(dead) >= minDeadRatio * static_cast<double>(total);
+}
+
+std::vector<DataFileStats> SpaceTracker::stats() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  std::vector<DataFileStats> stats;
+  stats.reserve(files_.size());
+  for (const auto& [fileId, file] : files_) {
+    // Both move independently, clamp a live count read ahead of its append
+    auto total = std::max<int64_t>(file->total_.load(), 0);
+    auto live = std::clamp<int64_t>(file->live_.load(), 0, total);
+    stats.push_back({fileId,
+                     static_cast<uint64_t>(total),
+                     static_cast<uint64_t>(live),
+                     static_cast<uint64_t>(total - live)});
+  }
+  return stats;
+}
+
+}  // namespace bitcask
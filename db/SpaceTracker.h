@@ -0,0 +1,66 @@
+#ifndef DB_SPACETRACKER_H_
+#define DB_SPACETRACKER_H_
+
+#include "bitcask/Base.h"
+#include "bitcask/Stats.h"
+#include "bitcask/Types.h"
+
+namespace bitcask {
+
+// SpaceTracker counts the bytes of each data file, and how many of them are live, i.e. the bytes of
+// the records the index points to. It's kept up to date incrementally: appended bytes start out
+// dead, and the index moves the bytes of a record to live when a key is put at it, and back to dead
+// when the key is overwritten or removed. So a merge can pick the files worth merging without
+// scanning them. Dead bytes are the total minus the live ones: superseded records, tombstones and
+// batch headers.
+//
+// The counters of a file are atomic, the map of the files is locked shared on the hot path.
+class SpaceTracker {
+ public:
+  SpaceTracker() = default;
+
+  SpaceTracker(const SpaceTracker&) = delete;
+  SpaceTracker& operator=(const SpaceTracker&) = delete;
+
+  // Start tracking a data file already on disk, of size bytes, last modified at mtimeMs
+  void addFile(FileID fileId, uint64_t size, int64_t mtimeMs);
+
+  // Count size bytes appended to a data file. They are dead until the index points to them.
+  void append(FileID fileId, uint64_t size);
+
+  // The index points to, or no longer points to, a record of a data file with a value of
+  // valueSize bytes
+  void put(FileID fileId, uint16_t valueSize);
+  void supersede(FileID fileId, uint16_t valueSize);
+
+  // Stop tracking a data file, e.g. once it's merged away
+  void remove(FileID fileId);
+
+  // Whether at least minDeadRatio of the bytes of a data file are dead, and it's not been written
+  // for minAgeMs. An empty file is all dead.
+  bool mergeable(FileID fileId, double minDeadRatio, int64_t minAgeMs) const;
+
+  // Counters of all data files, in id order
+  std::vector<DataFileStats> stats() const;
+
+ private:
+  struct Counters {
+    std::atomic<int64_t> total_{0};
+    std::atomic<int64_t> live_{0};
+    // Last append, in milliseconds of the wall clock
+    std::atomic<int64_t> lastWriteMs_{0};
+  };
+
+  // The counters of a file, created if needed
+  Counters* counters(FileID fileId);
+
+  // The counters of a file, or nullptr if it's not tracked
+  Counters* find(FileID fileId) const;
+
+  mutable std::shared_mutex mutex_;
+  std::map<FileID, std::unique_ptr<Counters>> files_;
+};
+
+}  // namespace bitcask
+
+#endif  // DB_SPACETRACKER_H_
@@ -0,0 +1,134 @@
+#include "db/ValueCache.h"
+
+DEFINE_uint32(value_cache_shards, 16, "Number of shards of the value cache");
+DEFINE_uint32(value_cache_protected_percent,
+              80,
+              "Percentage of the value cache capacity taken by values hit more than once");
+
+namespace bitcask {
+
+namespace {
+
+// Rough memory taken by an entry besides the value bytes: the list node, the hash map node, and
+// the shared string
+constexpr size_t kEntryOverhead = 128;
+
+}  // namespace
+
+ValueCache::ValueCache(size_t capacity) : capacity_(capacity) {
+  auto numShards = std::max<uint32_t>(1, FLAGS_value_cache_shards);
+  shards_.reserve(numShards);
+  for (uint32_t i = 0; i < numShards; i++) {
+    shards_.emplace_back(std::make_unique<Shard>(capacity / numShards));
+  }
+}
+
+std::shared_ptr<const std::string> ValueCache::lookup(const CacheKey& key) {
+  return shardOf(key).lookup(key);
+}
+
+void ValueCache::insert(const CacheKey& key, std::shared_ptr<const std::string> value) {
+  shardOf(key).insert(key, std::move(value));
+}
+
+size_t ValueCache::usage() const {
+  size_t usage = 0;
+  for (const auto& shard : shards_) {
+    usage += shard->usage();
+  }
+  return usage;
+}
+
+uint64_t ValueCache::hits() const {
+  uint64_t hits = 0;
+  for (const auto& shard : shards_) {
+    hits += shard->hits();
+  }
+  return hits;
+}
+
+uint64_t ValueCache::misses() const {
+  uint64_t misses = 0;
+  for (const auto& shard : shards_) {
+    misses += shard->misses();
+  }
+  return misses;
+}
+
+ValueCache::Shard::Shard(size_t capacity)
+    : capacity_(capacity),
+      protectedCapacity_(capacity * std::min<uint32_t>(FLAGS_value_cache_protected_percent, 100) /
+                         100) {}
+
+std::shared_ptr<const std::string> ValueCache::Shard::lookup(const CacheKey& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    misses_++;
+    return nullptr;
+  }
+  hits_++;
+  auto entryIt = it->second;
+  if (entryIt->protected_) {
+    protected_.splice(protected_.begin(), protected_, entryIt);
+    return entryIt->value_;
+  }
+
+  // Promote on the second hit, and demote what falls off the protected segment
+  entryIt->protected_ = true;
+  protected_.splice(protected_.begin(), probation_, entryIt);
+  protectedUsage_ += entryIt->charge_;
+  while (protectedUsage_ > protectedCapacity_ && protected_.size() > 1) {
+    auto demoted = std::prev(protected_.end());
+    demoted->protected_ = false;
+    protectedUsage_ -= demoted->charge_;
+    probation_.splice(probation_.begin(), protected_, demoted);
+  }
+  return entryIt->value_;
+}
+
+void ValueCache::Shard::insert(const CacheKey& key, std::shared_ptr<const std::string> value) {
+  auto charge = value->size() + kEntryOverhead;
+  if (charge > capacity_) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (entries_.find(key) != entries_.end()) {
+    // Raced with another reader of the same record, the value is the same
+    return;
+  }
+  probation_.push_front({key, std::move(value), charge, false});
+  entries_.emplace(key, probation_.begin());
+  usage_ += charge;
+  evictLocked();
+}
+
+void ValueCache::Shard::evictLocked() {
+  while (usage_ > capacity_) {
+    auto& segment = probation_.empty() ? protected_ : probation_;
+    auto victim = std::prev(segment.end());
+    usage_ -= victim->charge_;
+    if (victim->protected_) {
+      protectedUsage_ -= victim->charge_;
+    }
+    entries_.erase(victim->key_);
+    segment.erase(victim);
+  }
+}
+
+size_t ValueCache::Shard::usage() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return usage_;
+}
+
+uint64_t ValueCache::Shard::hits() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return hits_;
+}
+
+uint64_t ValueCache::Shard::misses() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return misses_;
+}
+
+}  // namespace bitcask
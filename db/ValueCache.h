@@ -0,0 +1,115 @@
+#ifndef DB_VALUECACHE_H_
+#define DB_VALUECACHE_H_
+
+#include "bitcask/Base.h"
+#include "bitcask/Types.h"
+
+DECLARE_uint32(value_cache_shards);
+DECLARE_uint32(value_cache_protected_percent);
+
+namespace bitcask {
+
+// The location of a log record. Records are never rewritten in place, so an overwritten key gets a
+// new location, and the cached value of the old one is simply never looked up again.
+struct CacheKey {
+  FileID fileId_;
+  FileOffset pos_;
+
+  bool operator==(const CacheKey& other) const {
+    return fileId_ == other.fileId_ && pos_ == other.pos_;
+  }
+};
+
+struct CacheKeyHash {
+  size_t operator()(const CacheKey& key) const {
+    // Fibonacci hashing, so that record offsets, which are far from random, spread over the shards
+    auto x = (static_cast<uint64_t>(key.fileId_) << 40) ^ static_cast<uint64_t>(key.pos_);
+    return static_cast<size_t>((x * 0x9E3779B97F4A7C15ULL) >> 16);
+  }
+};
+
+// ValueCache is a memory bounded cache of values by the location of their log record. It's split
+// in FLAGS_value_cache_shards shards, each with its own lock and its share of the capacity.
+//
+// Each shard is a segmented LRU, which is scan resistant: a value enters the probationary segment,
+// and is promoted to the protected segment on its second hit. The protected segment takes up to
+// FLAGS_value_cache_protected_percent of the capacity, what falls off it is demoted back to the
+// probationary segment. Values are evicted from the probationary segment first, so a scan of keys
+// read once only churns the probationary segment and leaves the hot values alone.
+//
+// Values are shared: a value evicted while in use stays alive until its last user drops it.
+class ValueCache {
+ public:
+  explicit ValueCache(size_t capacity);
+
+  ValueCache(const ValueCache&) = delete;
+  ValueCache& operator=(const ValueCache&) = delete;
+
+  // Return the cached value, or nullptr on a miss
+  std::shared_ptr<const std::string> lookup(const CacheKey& key);
+
+  // Cache value. Values larger than a shard are not cached.
+  void insert(const CacheKey& key, std::shared_ptr<const std::string> value);
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  // bytes charged for the cached values
+  size_t usage() const;
+
+  uint64_t hits() const;
+
+  uint64_t misses() const;
+
+ private:
+  class Shard {
+   public:
+    explicit Shard(size_t capacity);
+
+    std::shared_ptr<const std::string> lookup(const CacheKey& key);
+
+    void insert(const CacheKey& key, std::shared_ptr<const std::string> value);
+
+    size_t usage() const;
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+   private:
+    struct Entry {
+      CacheKey key_;
+      std::shared_ptr<const std::string> value_;
+      size_t charge_;
+      bool protected_;
+    };
+    using EntryList = std::list<Entry>;
+
+    // Evict from the back of the probationary segment, then of the protected one, until the usage
+    // is within capacity. Require holding mutex_.
+    void evictLocked();
+
+    const size_t capacity_;
+    const size_t protectedCapacity_;
+
+    mutable std::mutex mutex_;
+    // Most recently used first
+    EntryList probation_;
+    EntryList protected_;
+    std::unordered_map<CacheKey, EntryList::iterator, CacheKeyHash> entries_;
+    size_t usage_{0};
+    size_t protectedUsage_{0};
+    uint64_t hits_{0};
+    uint64_t misses_{0};
+  };
+
+  Shard& shardOf(const CacheKey& key) {
+    return *shards_[CacheKeyHash()(key) % shards_.size()];
+  }
+
+  const size_t capacity_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+}  // namespace bitcask
+
+#endif  // DB_VALUECACHE_H_
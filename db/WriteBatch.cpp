@@ -0,0 +1,21 @@
+#include "bitcask/WriteBatch.h"
+
+namespace bitcask {
+
+void WriteBatch::put(const KeyType& key, const std::string& value) {
+  ops_.push_back({OpType::kPut, key, value});
+}
+
+void WriteBatch::deleteKey(const KeyType& key) {
+  ops_.push_back({OpType::kDelete, key, ""});
+}
+
+void WriteBatch::clear() {
+  ops_.clear();
+}
+
+size_t WriteBatch::count() const {
+  return ops_.size();
+}
+
+}  // namespace bitcask
@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
 
+#include <random>
+
 #include "db/DBImpl.h"
+#include "db/DBIterator.h"
 
 namespace bitcask {
 
@@ -221,35 +224,1378 @@ TEST_F(DBImplTest, ConcurrentReadWriteTest) {
   db->close();
 }
 
-TEST_F(DBImplTest, IteratorTest) {
-  std::string dbname = "/tmp/DBImplTest/IteratorTest";
+TEST_F(DBImplTest, GroupCommitTest) {
+  std::string dbname = "/tmp/DBImplTest/GroupCommitTest";
+  bitcask::Options options;
+  options.maxFileSize = 1024;  // 1KB max file size, so that groups span data files
+  options.syncOnPut = true;
+  options.readOnly = false;
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+
+  const int numThreads = 16;
+  const int numOperations = 50;
+
+  auto writeFunc = [&db](int threadId) {
+    for (int i = 0; i < numOperations; ++i) {
+      KeyType key = threadId * numOperations + i;
+      auto status = db->put(key, fmt::format("value_{}_{}", threadId, i));
+      ASSERT_TRUE(status.ok());
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < numThreads; ++i) {
+    threads.emplace_back(writeFunc, i);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  // delete goes through group commit as well
+  ASSERT_TRUE(db->deleteKey(0).ok());
+
+  db->close();
+  delete (db.release());
+
+  // All records must be readable after reopen.
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  for (int threadId = 0; threadId < numThreads; ++threadId) {
+    for (int i = 0; i < numOperations; ++i) {
+      KeyType key = threadId * numOperations + i;
+      auto getRet = db->get(key);
+      if (key == 0) {
+        EXPECT_FALSE(getRet.ok());
+        continue;
+      }
+      ASSERT_TRUE(getRet.ok());
+      EXPECT_EQ(getRet.value(), fmt::format("value_{}_{}", threadId, i));
+    }
+  }
+
+  db->close();
+}
+
+TEST_F(DBImplTest, WriteBatchTest) {
+  std::string dbname = "/tmp/DBImplTest/WriteBatchTest";
+  bitcask::Options options;
+  options.readOnly = false;
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+
+  ASSERT_TRUE(db->put(1, "old_value1").ok());
+  ASSERT_TRUE(db->put(2, "old_value2").ok());
+
+  WriteBatch batch;
+  batch.put(1, "value1");
+  batch.deleteKey(2);
+  batch.put(3, "value3");
+  batch.put(3, "new_value3");
+  EXPECT_EQ(4, batch.count());
+  ASSERT_TRUE(db->write(batch).ok());
+
+  auto check = [&db]() {
+    auto getRet = db->get(1);
+    ASSERT_TRUE(getRet.ok());
+    EXPECT_EQ(getRet.value(), "value1");
+    EXPECT_EQ(db->get(2).status().code(), Status::Code::kNotFound);
+    getRet = db->get(3);
+    ASSERT_TRUE(getRet.ok());
+    EXPECT_EQ(getRet.value(), "new_value3");
+  };
+  check();
+
+  // the batch is replayed from the data file
+  db->close();
+  delete (db.release());
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  check();
+
+  // a batch must fit in one data file
+  options.maxFileSize = 128;
+  db->close();
+  delete (db.release());
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  batch.clear();
+  for (int i = 0; i < 10; i++) {
+    batch.put(i, "value");
+  }
+  auto status = db->write(batch);
+  EXPECT_EQ(status.code(), Status::Code::kOverLimit);
+  check();
+}
+
+TEST_F(DBImplTest, HintFileTest) {
+  std::string dbname = "/tmp/DBImplTest/HintFileTest";
+  // The index is loaded from the data files
+  FLAGS_index_snapshot = false;
+  bitcask::Options options;
+  options.maxFileSize = 1024;  // 1KB max file size
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+
+  for (KeyType key = 0; key < 100; ++key) {
+    ASSERT_TRUE(db->put(key, fmt::format("value_{}", key)).ok());
+  }
+  WriteBatch batch;
+  batch.put(1, "batch_value");
+  batch.deleteKey(2);
+  ASSERT_TRUE(db->write(batch).ok());
+  for (KeyType key = 0; key < 100; key += 10) {
+    ASSERT_TRUE(db->deleteKey(key).ok());
+  }
+  ASSERT_TRUE(db->close().ok());
+  db.reset();
+
+  auto check = [&]() {
+    auto reopened = DB::open(dbname, options);
+    ASSERT_TRUE(reopened.ok());
+    auto db = std::move(reopened).value();
+    EXPECT_EQ(db->listKeys().value().size(), 89);
+    EXPECT_EQ(db->get(1).value(), "batch_value");
+    EXPECT_EQ(db->get(2).status().code(), Status::Code::kNotFound);
+    EXPECT_EQ(db->get(50).status().code(), Status::Code::kNotFound);
+    EXPECT_EQ(db->get(99).value(), "value_99");
+    ASSERT_TRUE(db->close().ok());
+  };
+
+  // Every data file but the active one has a hint file
+  std::vector<FileID> fileIds;
+  for (const auto& entry : std::filesystem::directory_iterator(dbname)) {
+    if (entry.path().extension() == ".data") {
+      fileIds.emplace_back(std::stoul(entry.path().stem().string()));
+    }
+  }
+  std::sort(fileIds.begin(), fileIds.end());
+  ASSERT_GT(fileIds.size(), 3);
+  for (auto fileId : fileIds) {
+    EXPECT_EQ(std::filesystem::exists(HintFile::fileName(dbname, fileId)),
+              fileId != fileIds.back());
+  }
+  check();
+
+  // The index is loaded from the hint file, without reading the data file: a corrupted value
+  // would fail the open otherwise
+  auto dataName = fmt::format("{}/{}.data", dbname, fileIds[0]);
+  std::fstream data(dataName, std::ios::in | std::ios::out | std::ios::binary);
+  data.seekg(kLogHeaderAndKeySize);
+  char byte = data.get();
+  data.seekp(kLogHeaderAndKeySize);
+  data.put(byte ^ 1);
+  data.flush();
+  check();
+  data.seekp(kLogHeaderAndKeySize);
+  data.put(byte);
+  data.close();
+
+  // A corrupted hint file is ignored, and a missing one is written on open unless read only
+  auto hintName = HintFile::fileName(dbname, fileIds[0]);
+  std::filesystem::resize_file(hintName, std::filesystem::file_size(hintName) - 1);
+  EXPECT_EQ(HintFile::read(dbname, fileIds[0], options.maxFileSize).status().code(),
+            Status::Code::kError);
+  std::filesystem::remove(HintFile::fileName(dbname, fileIds[1]));
+  options.readOnly = true;
+  check();
+  EXPECT_FALSE(std::filesystem::exists(HintFile::fileName(dbname, fileIds[1])));
+  options.readOnly = false;
+  check();
+  EXPECT_TRUE(HintFile::read(dbname, fileIds[0], options.maxFileSize).ok());
+  EXPECT_TRUE(HintFile::read(dbname, fileIds[1], options.maxFileSize).ok());
+  check();
+  FLAGS_index_snapshot = true;
+}
+
+TEST_F(DBImplTest, ParallelLoadTest) {
+  std::string dbname = "/tmp/DBImplTest/ParallelLoadTest";
+  FLAGS_index_snapshot = false;
+  bitcask::Options options;
+  options.maxFileSize = 1024;  // 1KB max file size
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+
+  // Keys are overwritten and deleted across many data files
+  std::map<KeyType, std::string> expected;
+  std::mt19937 rng(7);
+  for (int i = 0; i < 2000; i++) {
+    KeyType key = rng() % 200;
+    if (rng() % 4 == 0) {
+      db->deleteKey(key);
+      expected.erase(key);
+    } else {
+      auto value = fmt::format("value_{}_{}", key, i);
+      ASSERT_TRUE(db->put(key, value).ok());
+      expected[key] = value;
+    }
+  }
+  ASSERT_TRUE(db->close().ok());
+  db.reset();
+
+  auto check = [&]() {
+    auto reopened = DB::open(dbname, options);
+    ASSERT_TRUE(reopened.ok());
+    auto db = std::move(reopened).value();
+    auto keys = db->listKeys().value();
+    std::sort(keys.begin(), keys.end());
+    ASSERT_EQ(keys.size(), expected.size());
+    for (auto key : keys) {
+      ASSERT_TRUE(expected.count(key));
+      EXPECT_EQ(db->get(key).value(), expected[key]);
+    }
+    ASSERT_TRUE(db->close().ok());
+  };
+
+  // From the hint files, and by scanning the data files
+  options.readOnly = true;
+  for (bool hinted : {true, false}) {
+    if (!hinted) {
+      for (const auto& entry : std::filesystem::directory_iterator(dbname)) {
+        if (entry.path().extension() == ".hint") {
+          std::filesystem::remove(entry.path());
+        }
+      }
+    }
+    for (uint32_t numThreads : {1, 3, 16}) {
+      FLAGS_index_load_threads = numThreads;
+      check();
+    }
+  }
+  FLAGS_index_load_threads = 0;
+  FLAGS_index_snapshot = true;
+}
+
+TEST_F(DBImplTest, IndexSnapshotTest) {
+  std::string dbname = "/tmp/DBImplTest/IndexSnapshotTest";
   bitcask::Options options;
   options.maxFileSize = 1024;  // 1KB max file size
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+
+  std::map<KeyType, std::string> expected;
+  auto update = [&](DB* db, int first, int count) {
+    for (int i = first; i < first + count; i++) {
+      KeyType key = (i * 37) % 200;
+      if (i % 4 == 0) {
+        db->deleteKey(key);
+        expected.erase(key);
+      } else {
+        auto value = fmt::format("value_{}_{}", key, i);
+        ASSERT_TRUE(db->put(key, value).ok());
+        expected[key] = value;
+      }
+    }
+  };
+  auto check = [&](DB* db) {
+    auto keys = db->listKeys().value();
+    ASSERT_EQ(keys.size(), expected.size());
+    for (auto key : keys) {
+      ASSERT_TRUE(expected.count(key));
+      EXPECT_EQ(db->get(key).value(), expected[key]);
+    }
+  };
+  update(db.get(), 0, 1000);
+  ASSERT_TRUE(db->close().ok());
+  db.reset();
+  auto snapshotName = IndexSnapshot::fileName(dbname);
+  ASSERT_TRUE(std::filesystem::exists(snapshotName));
+  auto snapshot = IndexSnapshot::open(dbname);
+  ASSERT_TRUE(snapshot.ok());
+  EXPECT_EQ(snapshot.value()->numEntries(), expected.size());
+  snapshot = Status::OK();
+
+  // The index is loaded from the snapshot, without reading the data files: a corrupted value
+  // would fail the open otherwise
+  auto dataName = fmt::format("{}/1.data", dbname);
+  std::fstream data(dataName, std::ios::in | std::ios::out | std::ios::binary);
+  data.seekg(kLogHeaderAndKeySize);
+  char byte = data.get();
+  data.seekp(kLogHeaderAndKeySize);
+  data.put(byte ^ 1);
+  data.flush();
+  std::filesystem::remove(HintFile::fileName(dbname, 1));
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  check(db.get());
+
+  // Only what's written after the snapshot is replayed. The snapshot is left behind by a crash,
+  // simulated by not writing the snapshot on close.
+  update(db.get(), 1000, 500);
+  check(db.get());
+  static_cast<DBImpl*>(db.get())->opened_ = false;
+  ASSERT_TRUE(db->close().ok());
+  db.reset();
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  check(db.get());
+  ASSERT_TRUE(db->close().ok());
+  db.reset();
+
+  // A snapshot not matching the data files is ignored
+  std::filesystem::remove(fmt::format("{}/2.data", dbname));
+  EXPECT_EQ(DB::open(dbname, options).status().code(), Status::Code::kError);
+  data.seekp(kLogHeaderAndKeySize);
+  data.put(byte);
+  data.close();
+
+  // And so is a corrupted one
+  std::filesystem::resize_file(snapshotName, std::filesystem::file_size(snapshotName) - 1);
+  EXPECT_EQ(IndexSnapshot::open(dbname).status().code(), Status::Code::kError);
+}
+
+TEST_F(DBImplTest, TornWriteBatchTest) {
+  std::string dbname = "/tmp/DBImplTest/TornWriteBatchTest";
+  bitcask::Options options;
   options.readOnly = false;
   auto ret = DB::open(dbname, options);
   ASSERT_TRUE(ret.ok());
   auto db = std::move(ret).value();
 
-  // Add some key-value pairs
+  ASSERT_TRUE(db->put(1, "value1").ok());
+  WriteBatch batch;
+  batch.put(1, "batch_value1");
+  batch.put(2, "batch_value2");
+  ASSERT_TRUE(db->write(batch).ok());
+  db->close();
+  delete (db.release());
+
+  // Cut the last byte of the batch, as if the db crashed in the middle of writing it.
+  auto dataFile = dbname + "/1.data";
+  std::filesystem::resize_file(dataFile, std::filesystem::file_size(dataFile) - 1);
+
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  auto getRet = db->get(1);
+  ASSERT_TRUE(getRet.ok());
+  EXPECT_EQ(getRet.value(), "value1");
+  EXPECT_EQ(db->get(2).status().code(), Status::Code::kNotFound);
+
+  // The torn batch is dropped, so new records are readable after reopen.
+  ASSERT_TRUE(db->put(3, "value3").ok());
+  db->close();
+  delete (db.release());
+
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  getRet = db->get(1);
+  ASSERT_TRUE(getRet.ok());
+  EXPECT_EQ(getRet.value(), "value1");
+  EXPECT_EQ(db->get(2).status().code(), Status::Code::kNotFound);
+  getRet = db->get(3);
+  ASSERT_TRUE(getRet.ok());
+  EXPECT_EQ(getRet.value(), "value3");
+}
+
+TEST_F(DBImplTest, WriteBufferTest) {
+  std::string dbname = "/tmp/DBImplTest/WriteBufferTest";
+  bitcask::Options options;
+  options.maxFileSize = 1024;  // 1KB max file size
+  options.writeBufferSize = 256;
+  options.writeBufferFlushIntervalMs = 10;
+  options.readOnly = false;
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+
+  // read your writes, whether the record is still in the buffer or not
   for (int i = 0; i < 100; ++i) {
-    KeyType key = reinterpret_cast<KeyType>(i);
-    std::string value = "value_" + std::to_string(i);
-    auto status = db->put(key, value);
-    ASSERT_TRUE(status.ok());
+    auto value = "value_" + std::to_string(i);
+    ASSERT_TRUE(db->put(i, value).ok());
+    auto getRet = db->get(i);
+    ASSERT_TRUE(getRet.ok());
+    EXPECT_EQ(getRet.value(), value);
   }
 
-  // Create an iterator and iterate through the keys
-  std::function<void(const KeyType&, const std::string&)> func = [](const KeyType& key,
-                                                                    const std::string& value) {
-    std::string expectedValue = "value_" + std::to_string(key);
-    EXPECT_EQ(value, expectedValue);
+  // the buffer is flushed in the background
+  ASSERT_TRUE(db->put(100, "value_100").ok());
+  auto dbPtr = dynamic_cast<DBImpl*>(db.get());
+  auto activeFile = fmt::format("{}/{}.data", dbname, dbPtr->activeFileId_);
+  auto fileSize = dbPtr->activeFile_->getCurrentFileSize();
+  auto fileSizeOnDisk = [&]() {
+    return static_cast<int64_t>(std::filesystem::file_size(activeFile));
   };
+  for (int i = 0; i < 100 && fileSizeOnDisk() != fileSize; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(fileSize, fileSizeOnDisk());
 
-  db->fold(std::move(func));
+  // and on close
+  ASSERT_TRUE(db->put(101, "value_101").ok());
+  db->close();
+  delete (db.release());
+
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  for (int i = 0; i < 102; ++i) {
+    auto getRet = db->get(i);
+    ASSERT_TRUE(getRet.ok());
+    EXPECT_EQ(getRet.value(), "value_" + std::to_string(i));
+  }
+}
+
+TEST_F(DBImplTest, IoUringTest) {
+  std::string dbname = "/tmp/DBImplTest/IoUringTest";
+  bitcask::Options options;
+  options.maxFileSize = 1024;  // 1KB max file size
+  options.syncOnPut = true;
+  options.ioBackend = IOBackendType::kIoUring;
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(db->put(i, "value_" + std::to_string(i)).ok());
+  }
+  db->close();
+  delete (db.release());
+
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  for (int i = 0; i < 100; ++i) {
+    auto getRet = db->get(i);
+    ASSERT_TRUE(getRet.ok());
+    EXPECT_EQ(getRet.value(), "value_" + std::to_string(i));
+  }
+}
+
+TEST_F(DBImplTest, MmapReadTest) {
+  std::string dbname = "/tmp/DBImplTest/MmapReadTest";
+  bitcask::Options options;
+  options.maxFileSize = 1024;  // 1KB max file size
+  options.mmapReads = true;
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+
+  // Values are read from the rolled out files, retired or not, and the active file
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(db->put(i, "value_" + std::to_string(i)).ok());
+  }
+  for (int i = 0; i < 100; ++i) {
+    auto getRet = db->get(i);
+    ASSERT_TRUE(getRet.ok());
+    EXPECT_EQ(getRet.value(), "value_" + std::to_string(i));
+  }
+  db->close();
+  delete (db.release());
+
+  // The index is built from the mapped files
+  for (bool readOnly : {false, true}) {
+    options.readOnly = readOnly;
+    ret = DB::open(dbname, options);
+    ASSERT_TRUE(ret.ok());
+    db = std::move(ret).value();
+    for (int i = 0; i < 100; ++i) {
+      auto getRet = db->get(i);
+      ASSERT_TRUE(getRet.ok());
+      EXPECT_EQ(getRet.value(), "value_" + std::to_string(i));
+    }
+    db->close();
+    delete (db.release());
+  }
+}
+
+TEST_F(DBImplTest, PinnableValueTest) {
+  std::string dbname = "/tmp/DBImplTest/PinnableValueTest";
+  bitcask::Options options;
+  options.maxFileSize = 1024;  // 1KB max file size
+  options.mmapReads = true;
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(db->put(i, "value_" + std::to_string(i)).ok());
+  }
+  // Both values and buffers are reused across gets
+  PinnableValue pinnable;
+  std::string value;
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(db->get(i, &pinnable).ok());
+    EXPECT_EQ(pinnable.view(), "value_" + std::to_string(i));
+    ASSERT_TRUE(db->get(i, &value).ok());
+    EXPECT_EQ(value, "value_" + std::to_string(i));
+  }
+  EXPECT_FALSE(db->get(100, &pinnable).ok());
+  EXPECT_FALSE(db->get(100, &value).ok());
+
+  db->close();
+  delete (db.release());
+
+  // A value pinned to a mapped file stays valid after the db is closed
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  ASSERT_TRUE(db->get(0, &pinnable).ok());
+  EXPECT_TRUE(pinnable.isPinned());
+  db->close();
+  delete (db.release());
+  EXPECT_EQ(pinnable.toString(), "value_0");
+}
+
+TEST_F(DBImplTest, ValueCacheTest) {
+  std::string dbname = "/tmp/DBImplTest/ValueCacheTest";
+  bitcask::Options options;
+  options.maxFileSize = 1024;  // 1KB max file size
+  options.valueCacheSize = 1024 * 1024;
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+  EXPECT_EQ(db->stats().cacheCapacity, options.valueCacheSize);
+
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(db->put(i, "value_" + std::to_string(i)).ok());
+  }
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 100; ++i) {
+      auto getRet = db->get(i);
+      ASSERT_TRUE(getRet.ok());
+      EXPECT_EQ(getRet.value(), "value_" + std::to_string(i));
+    }
+  }
+  auto stats = db->stats();
+  EXPECT_EQ(stats.cacheMisses, 100);
+  EXPECT_EQ(stats.cacheHits, 200);
+  EXPECT_GT(stats.cacheUsage, 0);
 
+  // An overwrite is a new record, the old value is never served again
+  ASSERT_TRUE(db->put(0, "new_value").ok());
+  PinnableValue pinnable;
+  ASSERT_TRUE(db->get(0, &pinnable).ok());
+  EXPECT_EQ(pinnable.view(), "new_value");
+  ASSERT_TRUE(db->get(0, &pinnable).ok());
+  EXPECT_TRUE(pinnable.isPinned());
+  EXPECT_EQ(pinnable.view(), "new_value");
   db->close();
 }
 
+TEST_F(DBImplTest, MultiGetTest) {
+  for (auto writeBufferSize : {0, 4096}) {
+    std::string dbname = fmt::format("/tmp/DBImplTest/MultiGetTest{}", writeBufferSize);
+    bitcask::Options options;
+    options.maxFileSize = 1024;  // 1KB max file size
+    options.writeBufferSize = writeBufferSize;
+    options.valueCacheSize = 1024 * 1024;
+    auto ret = DB::open(dbname, options);
+    ASSERT_TRUE(ret.ok());
+    auto db = std::move(ret).value();
+
+    for (int i = 0; i < 100; ++i) {
+      ASSERT_TRUE(db->put(i, "value_" + std::to_string(i)).ok());
+    }
+    ASSERT_TRUE(db->deleteKey(50).ok());
+
+    // Keys in all data files, out of order, missing, deleted and repeated
+    std::vector<KeyType> keys;
+    for (int i = 99; i >= 0; i -= 3) {
+      keys.emplace_back(i);
+    }
+    keys.insert(keys.end(), {200, 50, 0, 0});
+    for (int round = 0; round < 2; ++round) {
+      auto results = db->multiGet(keys);
+      ASSERT_EQ(results.size(), keys.size());
+      for (size_t i = 0; i < keys.size(); ++i) {
+        if (keys[i] == 200 || keys[i] == 50) {
+          EXPECT_EQ(results[i].status().code(), Status::Code::kNotFound);
+        } else {
+          ASSERT_TRUE(results[i].ok()) << results[i].status().toString();
+          EXPECT_EQ(results[i].value(), "value_" + std::to_string(keys[i]));
+        }
+      }
+    }
+    // The second round is served from the value cache
+    EXPECT_GE(db->stats().cacheHits, keys.size() - 2);
+    db->close();
+  }
+}
+
+TEST_F(DBImplTest, DirectIOTest) {
+  std::string dbname = "/tmp/DBImplTest/DirectIOTest";
+  bitcask::Options options;
+  options.maxFileSize = 64 * 1024;
+  options.useDirectIO = true;
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(db->put(i, "value_" + std::to_string(i)).ok());
+  }
+  auto dbPtr = dynamic_cast<DBImpl*>(db.get());
+  auto activeFile = fmt::format("{}/{}.data", dbname, dbPtr->activeFileId_);
+  db->close();
+  delete (db.release());
+
+  // simulate a crash leaving the padding of the tail block behind
+  auto fileSize = std::filesystem::file_size(activeFile);
+  std::filesystem::resize_file(activeFile, fileSize + 1000);
+
+  for (int round = 0; round < 2; round++) {
+    ret = DB::open(dbname, options);
+    ASSERT_TRUE(ret.ok());
+    db = std::move(ret).value();
+    for (int i = 0; i < 1000 + round; ++i) {
+      auto getRet = db->get(i);
+      ASSERT_TRUE(getRet.ok());
+      EXPECT_EQ(getRet.value(), "value_" + std::to_string(i));
+    }
+    // new records go right after the last one
+    ASSERT_TRUE(db->put(1000 + round, "value_" + std::to_string(1000 + round)).ok());
+    db->close();
+    delete (db.release());
+  }
+}
+
+TEST_F(DBImplTest, PrecreateNextFileTest) {
+  std::string dbname = "/tmp/DBImplTest/PrecreateNextFileTest";
+  bitcask::Options options;
+  options.maxFileSize = 1024;  // 1KB max file size
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+  auto dbPtr = dynamic_cast<DBImpl*>(db.get());
+  auto fileName = [&](FileID fileId) { return fmt::format("{}/{}.data", dbname, fileId); };
+
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(db->put(i, "value_" + std::to_string(i)).ok());
+    auto getRet = db->get(i);
+    ASSERT_TRUE(getRet.ok());
+    EXPECT_EQ(getRet.value(), "value_" + std::to_string(i));
+  }
+  ASSERT_TRUE(db->sync().ok());
+
+  // the next data file is pre-created and preallocated in the background
+  auto nextFile = fileName(dbPtr->activeFileId_ + 1);
+  for (int i = 0; i < 100 && !std::filesystem::exists(nextFile); i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_TRUE(std::filesystem::exists(nextFile));
+  EXPECT_EQ(0, std::filesystem::file_size(nextFile));
+
+  // rolled out files are retired, i.e. their preallocated space is released
+  auto activeFileId = dbPtr->activeFileId_;
+  for (FileID fileId = 1; fileId < activeFileId; fileId++) {
+    struct stat st;
+    ASSERT_EQ(0, stat(fileName(fileId).c_str(), &st));
+    EXPECT_LE(st.st_blocks * 512, 4096);
+  }
+
+  // the unused pre-created file is removed on close
+  db->close();
+  delete (db.release());
+  EXPECT_FALSE(std::filesystem::exists(nextFile));
+
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  EXPECT_EQ(activeFileId, dynamic_cast<DBImpl*>(db.get())->activeFileId_);
+  for (int i = 0; i < 100; ++i) {
+    auto getRet = db->get(i);
+    ASSERT_TRUE(getRet.ok());
+    EXPECT_EQ(getRet.value(), "value_" + std::to_string(i));
+  }
+}
+
+TEST_F(DBImplTest, SyncPolicyTest) {
+  for (auto policy :
+       {SyncPolicy::kNone, SyncPolicy::kPerWrite, SyncPolicy::kInterval, SyncPolicy::kBytes}) {
+    std::string dbname = fmt::format("/tmp/DBImplTest/SyncPolicyTest{}", static_cast<int>(policy));
+    bitcask::Options options;
+    options.maxFileSize = 1024;  // 1KB max file size
+    options.syncPolicy = policy;
+    options.syncIntervalMs = 10;
+    options.syncBytes = 512;
+    auto ret = DB::open(dbname, options);
+    ASSERT_TRUE(ret.ok());
+    auto db = std::move(ret).value();
+    auto opened = db->durablePosition();
+    EXPECT_EQ(opened, db->writtenPosition());
+
+    for (int i = 0; i < 100; ++i) {
+      ASSERT_TRUE(db->put(i, "value_" + std::to_string(i)).ok());
+      if (policy == SyncPolicy::kPerWrite) {
+        EXPECT_EQ(db->writtenPosition(), db->durablePosition());
+      }
+    }
+    auto written = db->writtenPosition();
+    EXPECT_LT(opened, written);
+
+    if (policy == SyncPolicy::kNone) {
+      EXPECT_EQ(opened, db->durablePosition());
+      ASSERT_TRUE(db->sync().ok());
+    } else {
+      // synced in the background
+      for (int i = 0; i < 100 && db->durablePosition() < written; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+    }
+    if (policy == SyncPolicy::kBytes) {
+      // at most syncBytes are not synced yet
+      EXPECT_LE(WritePosition({written.fileId_, written.offset_ - 512}), db->durablePosition());
+    } else {
+      EXPECT_EQ(written, db->durablePosition());
+    }
+  }
+}
+
+TEST_F(DBImplTest, ConcurrentPutTest) {
+  std::string dbname = "/tmp/DBImplTest/ConcurrentPutTest";
+  bitcask::Options options;
+  options.maxFileSize = 1024;  // 1KB max file size
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+
+  // All threads write the same keys, appending to the active file in parallel
+  const int numThreads = 8;
+  const int numKeys = 64;
+  const int numOperations = 200;
+  auto putFunc = [&db](int threadId) {
+    for (int i = 0; i < numOperations; ++i) {
+      KeyType key = i % numKeys;
+      ASSERT_TRUE(db->put(key, fmt::format("value_{}_{}", threadId, i)).ok());
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 0; i < numThreads; ++i) {
+    threads.emplace_back(putFunc, i);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  std::vector<std::string> values;
+  for (KeyType key = 0; key < numKeys; ++key) {
+    auto getRet = db->get(key);
+    ASSERT_TRUE(getRet.ok());
+    values.emplace_back(std::move(getRet).value());
+  }
+  ASSERT_TRUE(db->close().ok());
+  db.reset();
+
+  // The index rebuilt from the data files agrees with the one built by the writers
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  for (KeyType key = 0; key < numKeys; ++key) {
+    auto getRet = db->get(key);
+    ASSERT_TRUE(getRet.ok());
+    EXPECT_EQ(getRet.value(), values[key]);
+  }
+  db->close();
+}
+
+TEST_F(DBImplTest, IteratorTest) {
+  std::string dbname = "/tmp/DBImplTest/IteratorTest";
+  bitcask::Options options;
+  options.maxFileSize = 1024;  // 1KB max file size
+  options.readOnly = false;
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+
+  // Add some key-value pairs
+  for (int i = 0; i < 100; ++i) {
+    KeyType key = reinterpret_cast<KeyType>(i);
+    std::string value = "value_" + std::to_string(i);
+    auto status = db->put(key, value);
+    ASSERT_TRUE(status.ok());
+  }
+
+  // Create an iterator and iterate through the keys
+  std::function<void(const KeyType&, const std::string&)> func = [](const KeyType& key,
+                                                                    const std::string& value) {
+    std::string expectedValue = "value_" + std::to_string(key);
+    EXPECT_EQ(value, expectedValue);
+  };
+
+  db->fold(std::move(func));
+
+  db->close();
+}
+
+TEST_F(DBImplTest, FoldTest) {
+  std::string dbname = "/tmp/DBImplTest/FoldTest";
+  bitcask::Options options;
+  options.maxFileSize = 1024;  // 1KB max file size
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+
+  // Keys are overwritten and deleted across many data files, including the active one
+  std::map<KeyType, std::string> expected;
+  for (int i = 0; i < 1000; i++) {
+    KeyType key = (i * 37) % 150;
+    if (i % 5 == 0) {
+      db->deleteKey(key);
+      expected.erase(key);
+    } else {
+      auto value = fmt::format("value_{}_{}", key, i);
+      ASSERT_TRUE(db->put(key, value).ok());
+      expected[key] = value;
+    }
+  }
+  WriteBatch batch;
+  batch.put(1000, "batch_value");
+  batch.deleteKey(1);
+  ASSERT_TRUE(db->write(batch).ok());
+  expected[1000] = "batch_value";
+  expected.erase(1);
+
+  // Every live key is passed once, with its last value
+  std::map<KeyType, std::string> folded;
+  ASSERT_TRUE(db->fold([&folded](const KeyType& key, const std::string& value) {
+                  EXPECT_TRUE(folded.emplace(key, value).second);
+                }).ok());
+  EXPECT_EQ(folded, expected);
+  db->close();
+}
+
+TEST_F(DBImplTest, MergeTest) {
+  std::string dbname = "/tmp/DBImplTest/MergeTest";
+  bitcask::Options options;
+  options.maxFileSize = 1024;  // 1KB max file size
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+  auto* impl = static_cast<DBImpl*>(db.get());
+
+  // Keys are overwritten and deleted across many data files
+  std::map<KeyType, std::string> expected;
+  for (int i = 0; i < 2000; i++) {
+    KeyType key = (i * 37) % 150;
+    if (i % 5 == 0) {
+      db->deleteKey(key);
+      expected.erase(key);
+    } else {
+      auto value = fmt::format("value_{}_{}", key, i);
+      ASSERT_TRUE(db->put(key, value).ok());
+      expected[key] = value;
+    }
+  }
+  WriteBatch batch;
+  batch.put(1000, "batch_value");
+  batch.deleteKey(1);
+  ASSERT_TRUE(db->write(batch).ok());
+  expected[1000] = "batch_value";
+  expected.erase(1);
+
+  auto check = [&](DB* db) {
+    auto keys = db->listKeys().value();
+    ASSERT_EQ(keys.size(), expected.size());
+    for (auto key : keys) {
+      ASSERT_TRUE(expected.count(key));
+      EXPECT_EQ(db->get(key).value(), expected[key]);
+    }
+  };
+  auto diskSize = [&dbname] {
+    size_t size = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(dbname)) {
+      if (entry.path().extension() == ".data") {
+        size += entry.file_size();
+      }
+    }
+    return size;
+  };
+
+  // Gets and puts go on during the merge, the keys put keep their new values
+  std::vector<FileID> merged;
+  {
+    std::shared_lock<std::shared_mutex> lock(impl->mutex_);
+    for (const auto& [fileId, file] : impl->oldDataFiles_) {
+      merged.emplace_back(fileId);
+    }
+  }
+  auto sizeBefore = diskSize();
+  std::thread writer([&] {
+    for (int i = 0; i < 200; i++) {
+      KeyType key = 200 + i % 50;
+      ASSERT_TRUE(db->put(key, fmt::format("new_value_{}", i)).ok());
+      ASSERT_TRUE(db->get(key).ok());
+    }
+  });
+  ASSERT_TRUE(db->merge(dbname).ok());
+  writer.join();
+  for (KeyType key = 200; key < 250; key++) {
+    expected[key] = db->get(key).value();
+  }
+  check(db.get());
+
+  // The merged data files and their hint files are gone, and the live records take less space
+  for (auto fileId : merged) {
+    EXPECT_FALSE(std::filesystem::exists(fmt::format("{}/{}.data", dbname, fileId)));
+    EXPECT_FALSE(std::filesystem::exists(HintFile::fileName(dbname, fileId)));
+  }
+  EXPECT_LT(diskSize(), sizeBefore);
+
+  // The merged data files are loaded on open, from their hint files or from the index snapshot
+  impl->opened_ = false;
+  ASSERT_TRUE(db->close().ok());
+  db.reset();
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  check(db.get());
+  ASSERT_TRUE(db->merge(dbname).ok());
+  check(db.get());
+  ASSERT_TRUE(db->close().ok());
+  db.reset();
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  check(db.get());
+  ASSERT_TRUE(db->close().ok());
+  db.reset();
+
+  // A read only db is not merged
+  options.readOnly = true;
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  EXPECT_EQ(ret.value()->merge(dbname).code(), Status::Code::kNotAllowed);
+}
+
+TEST_F(DBImplTest, MergeRemoveFailureTest) {
+  std::string dbname = "/tmp/DBImplTest/MergeRemoveFailureTest";
+  bitcask::Options options;
+  options.maxFileSize = 1024;  // 1KB max file size
+  // The hint file of data file 1 can't be removed, nor data file 1 after it
+  auto blocker = HintFile::fileName(dbname, 1);
+  std::filesystem::create_directories(blocker);
+  std::ofstream(blocker + "/file") << "blocker";
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+  auto dbPtr = dynamic_cast<DBImpl*>(db.get());
+
+  // Key 0 is put in data file 1, and deleted in data file 2
+  std::string value(100, 'v');
+  ASSERT_TRUE(db->put(0, value).ok());
+  KeyType key = 1;
+  while (dbPtr->writtenPosition().fileId_ < 2) {
+    ASSERT_TRUE(db->put(key++, value).ok());
+  }
+  ASSERT_TRUE(db->deleteKey(0).ok());
+  while (dbPtr->writtenPosition().fileId_ < 3) {
+    ASSERT_TRUE(db->put(key++, value).ok());
+  }
+
+  // The tombstone is dropped by the merge, so data file 2 is kept as long as data file 1 is
+  EXPECT_FALSE(db->merge("").ok());
+  EXPECT_EQ(db->stats().merges, 1);
+  EXPECT_TRUE(std::filesystem::exists(dbname + "/1.data"));
+  EXPECT_TRUE(std::filesystem::exists(dbname + "/2.data"));
+  EXPECT_EQ(db->get(0).status().code(), Status::Code::kNotFound);
+  ASSERT_TRUE(db->close().ok());
+  db.reset();
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  EXPECT_EQ(db->get(0).status().code(), Status::Code::kNotFound);
+  for (KeyType k = 1; k < key; k++) {
+    EXPECT_EQ(db->get(k).value(), value);
+  }
+
+  // They are merged again after the reopen, and removed by the next merge once they can be
+  EXPECT_FALSE(db->merge("").ok());
+  EXPECT_TRUE(std::filesystem::exists(dbname + "/1.data"));
+  std::filesystem::remove_all(blocker);
+  ASSERT_TRUE(db->merge("").ok());
+  EXPECT_FALSE(std::filesystem::exists(dbname + "/1.data"));
+  EXPECT_FALSE(std::filesystem::exists(dbname + "/2.data"));
+  ASSERT_TRUE(db->close().ok());
+  db.reset();
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  EXPECT_EQ(db->get(0).status().code(), Status::Code::kNotFound);
+  for (KeyType k = 1; k < key; k++) {
+    EXPECT_EQ(db->get(k).value(), value);
+  }
+}
+
+TEST_F(DBImplTest, AutoMergeTest) {
+  std::string dbname = "/tmp/DBImplTest/AutoMergeTest";
+  bitcask::Options options;
+  options.maxFileSize = 1024;  // 1KB max file size
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+
+  // The first 100 keys are all overwritten, the last 100 never
+  for (int round = 0; round < 2; round++) {
+    for (KeyType key = 0; key < 100 + round * 100; key++) {
+      ASSERT_TRUE(db->put(key, fmt::format("value_{}_{}", key, round)).ok());
+    }
+  }
+  uint64_t liveBytes = 0;
+  for (KeyType key = 0; key < 200; key++) {
+    liveBytes += kLogHeaderAndKeySize + db->get(key).value().size();
+  }
+  auto checkStats = [&](DB* db) {
+    uint64_t live = 0;
+    uint64_t total = 0;
+    for (const auto& file : db->stats().dataFiles) {
+      EXPECT_EQ(file.liveBytes + file.deadBytes, file.totalBytes);
+      live += file.liveBytes;
+      total += file.totalBytes;
+    }
+    EXPECT_EQ(live, liveBytes);
+    return total;
+  };
+  auto stats = db->stats();
+  checkStats(db.get());
+  // The files of the first round are all dead
+  ASSERT_GT(stats.dataFiles.size(), 2);
+  EXPECT_EQ(stats.dataFiles[0].liveBytes, 0);
+  EXPECT_EQ(stats.dataFiles[0].deadBytes, stats.dataFiles[0].totalBytes);
+  EXPECT_EQ(stats.merges, 0);
+
+  // The same counters are rebuilt on open
+  ASSERT_TRUE(db->close().ok());
+  db.reset();
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  auto totalBytes = checkStats(db.get());
+  ASSERT_TRUE(db->close().ok());
+  db.reset();
+
+  // Only the files mostly dead are merged
+  auto checkInterval = FLAGS_merge_check_interval_ms;
+  FLAGS_merge_check_interval_ms = 10;
+  options.mergeMinDeadRatio = 0.5;
+  options.mergeMinFileAgeSec = 0;
+  // Under a background I/O limit
+  options.backgroundIORate = 1 << 20;
+  options.autoTuneBackgroundIO = true;
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  for (int i = 0; i < 1000 && db->stats().merges == 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_GT(db->stats().merges, 0);
+  EXPECT_LT(checkStats(db.get()), totalBytes);
+  for (const auto& file : db->stats().dataFiles) {
+    EXPECT_LE(file.deadBytes * 2, file.totalBytes);
+  }
+  for (KeyType key = 0; key < 200; key++) {
+    EXPECT_EQ(db->get(key).value(), fmt::format("value_{}_1", key));
+  }
+  EXPECT_GT(db->stats().backgroundIORate, 0);
+  EXPECT_LE(db->stats().backgroundIORate, options.backgroundIORate);
+  FLAGS_merge_check_interval_ms = checkInterval;
+}
+
+// Fails the next failures writes
+class FailingIOBackend : public PosixIOBackend {
+ public:
+  Status writev(
+      int fd, struct iovec* iovs, int iovCnt, FileOffset offset, size_t totalSize) override {
+    if (failures > 0) {
+      failures--;
+      return Status::ERROR(Status::Code::kError, "Injected write failure");
+    }
+    return PosixIOBackend::writev(fd, iovs, iovCnt, offset, totalSize);
+  }
+
+  int failures{0};
+};
+
+TEST_F(DBImplTest, FailedWriteTest) {
+  std::string dbname = "/tmp/DBImplTest/FailedWriteTest";
+  // Outlives the db
+  FailingIOBackend io;
+  bitcask::Options options;
+  options.maxFileSize = 1 << 20;
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+  auto dbPtr = dynamic_cast<DBImpl*>(db.get());
+  ASSERT_TRUE(dbPtr->concurrentAppends_);
+  dbPtr->activeFile_->setIOBackend(&io);
+
+  // A failed write is padded, and the records after it are found on open. The batch is larger
+  // than a single padding record.
+  ASSERT_TRUE(db->put(1, "value_1").ok());
+  io.failures = 1;
+  EXPECT_FALSE(db->put(2, "value_2").ok());
+  WriteBatch batch;
+  for (KeyType key = 10; key < 40; key++) {
+    batch.put(key, std::string(4000, 'a' + key % 26));
+  }
+  io.failures = 1;
+  EXPECT_FALSE(db->write(batch).ok());
+  ASSERT_TRUE(db->put(3, "value_3").ok());
+  auto fileId = dbPtr->activeFileId_;
+
+  // A failed write which can't be padded either rolls the file out
+  io.failures = 2;
+  EXPECT_FALSE(db->put(4, "value_4").ok());
+  ASSERT_TRUE(db->put(5, "value_5").ok());
+  EXPECT_EQ(dbPtr->activeFileId_, fileId + 1);
+
+  ASSERT_TRUE(db->close().ok());
+  db.reset();
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  for (KeyType key : {1, 3, 5}) {
+    EXPECT_EQ(db->get(key).value(), fmt::format("value_{}", key));
+  }
+  for (KeyType key : {2, 4, 10, 39}) {
+    EXPECT_EQ(db->get(key).status().code(), Status::Code::kNotFound);
+  }
+  uint64_t liveBytes = 0;
+  for (const auto& file : db->stats().dataFiles) {
+    liveBytes += file.liveBytes;
+  }
+  EXPECT_EQ(liveBytes, 3 * (kLogHeaderAndKeySize + 7));
+}
+
+TEST_F(DBImplTest, FailedRollTest) {
+  std::string dbname = "/tmp/DBImplTest/FailedRollTest";
+  bitcask::Options options;
+  options.maxFileSize = 1024;  // 1KB max file size
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+  auto dbPtr = dynamic_cast<DBImpl*>(db.get());
+  ASSERT_EQ(dbPtr->activeFileId_, 1);
+
+  // Data file 3 can be neither pre-created nor created, file 2 is already pre-created
+  auto blocker = dbname + "/3.data";
+  std::filesystem::create_directories(blocker);
+  std::string value(100, 'v');
+  KeyType key = 0;
+  while (dbPtr->activeFileId_ < 2) {
+    ASSERT_TRUE(db->put(key++, value).ok());
+  }
+  Status status;
+  while ((status = db->put(key, value)).ok()) {
+    key++;
+  }
+  // The roll failed and left everything as it was
+  EXPECT_EQ(dbPtr->activeFileId_, 2);
+  EXPECT_EQ(dbPtr->oldDataFiles_.count(2), 0);
+  {
+    std::lock_guard<std::mutex> lock(dbPtr->bgMutex_);
+    EXPECT_EQ(dbPtr->nextFileId_, 3);
+  }
+  EXPECT_FALSE(std::filesystem::exists(dbname + "/4.data"));
+
+  // Once the file can be created, the next rolls go on from it
+  std::filesystem::remove(blocker);
+  while (dbPtr->activeFileId_ < 5) {
+    ASSERT_TRUE(db->put(key++, value).ok());
+  }
+  for (KeyType k = 0; k < key; k++) {
+    EXPECT_EQ(db->get(k).value(), value);
+  }
+
+  ASSERT_TRUE(db->close().ok());
+  db.reset();
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  for (KeyType k = 0; k < key; k++) {
+    EXPECT_EQ(db->get(k).value(), value);
+  }
+}
+
+TEST_F(DBImplTest, FlatIndexTest) {
+  std::string dbname = "/tmp/DBImplTest/FlatIndexTest";
+  bitcask::Options options;
+  options.maxFileSize = 1024;  // 1KB max file size
+  options.indexType = IndexType::kFlat;
+  auto ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  auto db = std::move(ret).value();
+
+  for (KeyType key = 0; key < 100; ++key) {
+    ASSERT_TRUE(db->put(key, fmt::format("value_{}", key)).ok());
+  }
+  for (KeyType key = 0; key < 100; key += 2) {
+    ASSERT_TRUE(db->deleteKey(key).ok());
+  }
+  ASSERT_TRUE(db->close().ok());
+  db.reset();
+
+  // The index is rebuilt from the data files
+  ret = DB::open(dbname, options);
+  ASSERT_TRUE(ret.ok());
+  db = std::move(ret).value();
+  EXPECT_EQ(db->listKeys().value().size(), 50);
+  for (KeyType key = 0; key < 100; ++key) {
+    auto getRet = db->get(key);
+    if (key % 2 == 0) {
+      EXPECT_EQ(getRet.status().code(), Status::Code::kNotFound);
+    } else {
+      ASSERT_TRUE(getRet.ok());
+      EXPECT_EQ(getRet.value(), fmt::format("value_{}", key));
+    }
+  }
+  db->close();
+
+  // Data files too large for the flat index are refused
+  options.maxFileSize = size_t(2) << 40;
+  EXPECT_EQ(DB::open(dbname, options).status().code(), Status::Code::kOverLimit);
+}
+
+TEST_F(DBImplTest, ScanTest) {
+  // Small chunks, so that iterators load many of them
+  FLAGS_iterator_batch_size = 7;
+  for (auto indexType : {IndexType::kOrdered, IndexType::kHash}) {
+    std::string dbname = "/tmp/DBImplTest/ScanTest";
+    std::filesystem::remove_all(dbname);
+    bitcask::Options options;
+    options.maxFileSize = 1024;  // 1KB max file size
+    options.indexType = indexType;
+    auto ret = DB::open(dbname, options);
+    ASSERT_TRUE(ret.ok());
+    auto db = std::move(ret).value();
+
+    // keys -300, -297, ..., 297, but the multiples of 5
+    std::vector<KeyType> keys;
+    for (KeyType key = -300; key < 300; key += 3) {
+      ASSERT_TRUE(db->put(key, fmt::format("value_{}", key)).ok());
+      keys.emplace_back(key);
+    }
+    for (KeyType key = -300; key < 300; key += 15) {
+      ASSERT_TRUE(db->deleteKey(key).ok());
+    }
+    keys.erase(std::remove_if(keys.begin(), keys.end(), [](KeyType key) { return key % 5 == 0; }),
+               keys.end());
+
+    std::vector<KeyType> scanned;
+    auto func = [&scanned](const KeyType& key, const std::string& value) {
+      EXPECT_EQ(value, fmt::format("value_{}", key));
+      scanned.emplace_back(key);
+      return true;
+    };
+    ASSERT_TRUE(db->scan(Range(), func).ok());
+    EXPECT_EQ(scanned, keys);
+
+    scanned.clear();
+    ASSERT_TRUE(db->scan(Range(-10, 20), func).ok());
+    EXPECT_EQ(scanned, std::vector<KeyType>({-9, -6, -3, 3, 6, 9, 12, 18}));
+
+    // stop early
+    scanned.clear();
+    ASSERT_TRUE(db->scan(Range(0, 300),
+                         [&scanned](const KeyType& key, const std::string& /* value */) {
+                           scanned.emplace_back(key);
+                           return scanned.size() < 3;
+                         })
+                    .ok());
+    EXPECT_EQ(scanned, std::vector<KeyType>({3, 6, 9}));
+
+    auto iterator = db->newIterator();
+    EXPECT_FALSE(iterator->valid());
+    std::vector<KeyType> iterated;
+    for (iterator->seekToLast(); iterator->valid(); iterator->prev()) {
+      EXPECT_EQ(iterator->value(), fmt::format("value_{}", iterator->key()));
+      iterated.emplace_back(iterator->key());
+    }
+    EXPECT_TRUE(iterator->status().ok());
+    EXPECT_EQ(iterated, std::vector<KeyType>(keys.rbegin(), keys.rend()));
+
+    iterator->seek(100);
+    ASSERT_TRUE(iterator->valid());
+    EXPECT_EQ(iterator->key(), 102);
+    iterator->seekForPrev(100);
+    ASSERT_TRUE(iterator->valid());
+    EXPECT_EQ(iterator->key(), 99);
+    // change of direction
+    iterator->next();
+    EXPECT_EQ(iterator->key(), 102);
+    iterator->prev();
+    iterator->prev();
+    EXPECT_EQ(iterator->key(), 96);
+    iterator->seek(298);
+    EXPECT_FALSE(iterator->valid());
+    iterator->seekForPrev(-301);
+    EXPECT_FALSE(iterator->valid());
+    iterator->seekToFirst();
+    ASSERT_TRUE(iterator->valid());
+    EXPECT_EQ(iterator->key(), -297);
+    iterator->prev();
+    EXPECT_FALSE(iterator->valid());
+
+    // A key written during an iteration beyond the current chunk is seen with the ordered index.
+    // Other indexes iterate over the keys there were on the first seek.
+    iterator->seek(250);
+    ASSERT_TRUE(db->put(295, "value_295").ok());
+    iterated.clear();
+    for (; iterator->valid(); iterator->next()) {
+      iterated.emplace_back(iterator->key());
+    }
+    EXPECT_EQ(std::count(iterated.begin(), iterated.end(), 295),
+              indexType == IndexType::kOrdered ? 1 : 0);
+    iterator.reset();
+
+    ASSERT_TRUE(db->close().ok());
+  }
+  FLAGS_iterator_batch_size = 64;
+}
+
+TEST_F(DBImplTest, IteratorRemovedChunkTest) {
+  FLAGS_iterator_batch_size = 8;
+  for (auto indexType : {IndexType::kOrdered, IndexType::kHash}) {
+    std::string dbname = "/tmp/DBImplTest/IteratorRemovedChunkTest";
+    std::filesystem::remove_all(dbname);
+    bitcask::Options options;
+    options.maxFileSize = 1024;  // 1KB max file size
+    options.indexType = indexType;
+    auto ret = DB::open(dbname, options);
+    ASSERT_TRUE(ret.ok());
+    auto db = std::move(ret).value();
+    for (KeyType key = 0; key < 100; key++) {
+      ASSERT_TRUE(db->put(key, fmt::format("value_{}", key)).ok());
+    }
+
+    // The keys of the first two chunks are deleted and merged away once collected, so that none of
+    // their values can be read
+    auto iterator = db->newIterator();
+    auto* dbIterator = dynamic_cast<DBIterator*>(iterator.get());
+    ASSERT_NE(dbIterator, nullptr);
+    int collected = 0;
+    dbIterator->afterCollect_ = [&] {
+      if (collected++ < 2) {
+        for (KeyType key = 8 * (collected - 1); key < 8 * collected; key++) {
+          ASSERT_TRUE(db->deleteKey(key).ok());
+        }
+        ASSERT_TRUE(db->merge("").ok());
+      }
+    };
+    std::vector<KeyType> iterated;
+    for (iterator->seekToFirst(); iterator->valid(); iterator->next()) {
+      EXPECT_EQ(iterator->value(), fmt::format("value_{}", iterator->key()));
+      iterated.emplace_back(iterator->key());
+    }
+    EXPECT_TRUE(iterator->status().ok());
+    ASSERT_EQ(iterated.size(), 84);
+    EXPECT_EQ(iterated.front(), 16);
+    EXPECT_EQ(iterated.back(), 99);
+  }
+  FLAGS_iterator_batch_size = 64;
+}
+
 }  // namespace bitcask
 
 int main(int argc, char** argv) {
@@ -3,6 +3,7 @@
 #include <filesystem>
 
 #include "db/DataFile.h"
+#include "db/DataFileScanner.h"
 
 namespace bitcask {
 class DataFileTest : public ::testing::Test {
@@ -69,9 +70,352 @@ TEST_F(DataFileTest, SimpleRWTest) {
   EXPECT_TRUE(status.ok());
 }
 
+TEST_F(DataFileTest, WriteLogRecordsTest) {
+  std::string dir = "/tmp/DataFileTest/WriteLogRecordsTest";
+  std::filesystem::create_directories(dir);
+  auto dataFile = std::make_unique<DataFile>(dir, 1, false);
+  auto status = dataFile->openDataFile();
+  EXPECT_TRUE(status.ok());
+
+  std::vector<std::unique_ptr<LogRecord>> records;
+  std::vector<LogRecord*> logs;
+  for (int32_t i = 0; i < 10; i++) {
+    records.emplace_back(
+        std::make_unique<LogRecord>(i, "test_value" + std::to_string(i), LogType::WRITE));
+    logs.emplace_back(records.back().get());
+  }
+
+  auto writeRet = dataFile->writeLogRecords(logs);
+  ASSERT_TRUE(writeRet.ok());
+  EXPECT_EQ(writeRet.value(), 0);
+  EXPECT_TRUE(dataFile->syncData().ok());
+
+  // records are laid out back to back
+  FileOffset pos = 0;
+  for (int32_t i = 0; i < 10; i++) {
+    auto readRet = dataFile->readLogRecord(pos);
+    ASSERT_TRUE(readRet.ok());
+    auto log = std::move(readRet).value();
+    EXPECT_EQ(log->getKey(), i);
+    EXPECT_EQ(log->getValue(), "test_value" + std::to_string(i));
+    pos += log->getTotalSize();
+  }
+  EXPECT_EQ(pos, dataFile->getCurrentFileSize());
+
+  status = dataFile->closeDataFile();
+  EXPECT_TRUE(status.ok());
+}
+
+TEST_F(DataFileTest, MmapReadTest) {
+  std::string dir = "/tmp/DataFileTest/MmapReadTest";
+  std::filesystem::create_directories(dir);
+  auto dataFile = std::make_unique<DataFile>(dir, 1, false);
+  ASSERT_TRUE(dataFile->openDataFile().ok());
+  std::vector<FileOffset> positions;
+  for (int32_t i = 0; i < 10; i++) {
+    auto writeRet = dataFile->writeLogRecord(
+        std::make_unique<LogRecord>(i, "test_value" + std::to_string(i), LogType::WRITE));
+    ASSERT_TRUE(writeRet.ok());
+    positions.emplace_back(writeRet.value());
+  }
+  // a torn record at the end
+  ASSERT_TRUE(dataFile->writeBuffer("torn", 4).ok());
+  auto fileSize = dataFile->getCurrentFileSize();
+  ASSERT_TRUE(dataFile->closeDataFile().ok());
+
+  dataFile = std::make_unique<DataFile>(dir, 1, true);
+  dataFile->setMmapReads(true);
+  ASSERT_TRUE(dataFile->openDataFile().ok());
+  for (int32_t i = 0; i < 10; i++) {
+    auto value = "test_value" + std::to_string(i);
+    auto readRet = dataFile->readLogRecord(positions[i]);
+    ASSERT_TRUE(readRet.ok());
+    EXPECT_EQ(readRet.value()->getKey(), i);
+    EXPECT_EQ(readRet.value()->getValue(), value);
+
+    readRet = dataFile->readLogRecord(positions[i], value.size());
+    ASSERT_TRUE(readRet.ok());
+    EXPECT_EQ(readRet.value()->getValue(), value);
+  }
+  auto readRet = dataFile->readLogRecord(fileSize - 4);
+  ASSERT_FALSE(readRet.ok());
+  EXPECT_EQ(readRet.status().code(), Status::Code::kEOF);
+
+  char buf[4];
+  ASSERT_TRUE(dataFile->read(fileSize - 4, 4, buf).ok());
+  EXPECT_EQ(std::string(buf, 4), "torn");
+  EXPECT_EQ(dataFile->read(fileSize - 2, 4, buf).code(), Status::Code::kEOF);
+  EXPECT_TRUE(dataFile->closeDataFile().ok());
+}
+
+TEST_F(DataFileTest, ScannerTest) {
+  std::string dir = "/tmp/DataFileTest/ScannerTest";
+  std::filesystem::create_directories(dir);
+  auto dataFile = std::make_unique<DataFile>(dir, 1, false);
+  ASSERT_TRUE(dataFile->openDataFile().ok());
+  std::vector<FileOffset> positions;
+  std::vector<std::string> values;
+  for (int32_t i = 0; i < 100; i++) {
+    values.emplace_back(std::string((i * 379) % 3000, 'a' + i % 26));
+    auto writeRet = dataFile->writeLogRecord(std::make_unique<LogRecord>(
+        i, values.back(), i % 7 == 0 ? LogType::DELETE : LogType::WRITE));
+    ASSERT_TRUE(writeRet.ok());
+    positions.emplace_back(writeRet.value());
+  }
+  // a torn record at the end
+  ASSERT_TRUE(dataFile->writeBuffer("torn", 4).ok());
+  ASSERT_TRUE(dataFile->closeDataFile().ok());
+
+  // Chunks smaller than some records, and larger than the file
+  for (size_t chunkSize : {size_t(1000), size_t(4096), size_t(1) << 20}) {
+    for (bool mmapReads : {false, true}) {
+      dataFile = std::make_unique<DataFile>(dir, 1, true);
+      dataFile->setMmapReads(mmapReads);
+      ASSERT_TRUE(dataFile->openDataFile().ok());
+      DataFileScanner scanner(dataFile.get(), 0, chunkSize);
+      for (int32_t i = 0; i < 100; i++) {
+        ASSERT_TRUE(scanner.next().ok());
+        EXPECT_EQ(scanner.offset(), positions[i]);
+        EXPECT_EQ(scanner.key(), i);
+        EXPECT_EQ(scanner.header().logType_, i % 7 == 0 ? LogType::DELETE : LogType::WRITE);
+        EXPECT_EQ(scanner.header().valueSize_, values[i].size());
+        EXPECT_EQ(scanner.value(), values[i]);
+      }
+      EXPECT_EQ(scanner.end(), dataFile->getCurrentFileSize() - 4);
+      EXPECT_EQ(scanner.next().code(), Status::Code::kEOF);
+      EXPECT_EQ(scanner.next().code(), Status::Code::kEOF);
+    }
+  }
+
+  // A corrupted value fails the crc check, unless it's not checked
+  {
+    std::fstream file(dir + "/1.data", std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(positions[1] + kLogHeaderAndKeySize);
+    file.put('X');
+  }
+  dataFile = std::make_unique<DataFile>(dir, 1, true);
+  ASSERT_TRUE(dataFile->openDataFile().ok());
+  DataFileScanner scanner(dataFile.get());
+  ASSERT_TRUE(scanner.next().ok());
+  EXPECT_EQ(scanner.next().code(), Status::Code::kError);
+  ASSERT_TRUE(scanner.next(false).ok());
+  EXPECT_EQ(scanner.value()[0], 'X');
+  ASSERT_TRUE(scanner.next().ok());
+  EXPECT_EQ(scanner.key(), 2);
+}
+
+TEST_F(DataFileTest, RateLimiterTest) {
+  std::string dir = "/tmp/DataFileTest/RateLimiterTest";
+  std::filesystem::create_directories(dir);
+  auto dataFile = std::make_unique<DataFile>(dir, 1, false);
+  ASSERT_TRUE(dataFile->openDataFile().ok());
+  std::string value(2000, 'v');
+  for (int32_t i = 0; i < 500; i++) {
+    auto writeRet = dataFile->writeLogRecord(std::make_unique<LogRecord>(i, value, LogType::WRITE));
+    ASSERT_TRUE(writeRet.ok());
+  }
+  ASSERT_TRUE(dataFile->closeDataFile().ok());
+
+  // 4MB/s, of which the bucket holds 400KB: a background scan of the 1MB file has to wait for
+  // about 150ms, a foreground one never waits
+  RateLimiter limiter(4 << 20, false);
+  dataFile = std::make_unique<DataFile>(dir, 1, true);
+  dataFile->setRateLimiter(&limiter);
+  ASSERT_TRUE(dataFile->openDataFile().ok());
+  auto scan = [&](IOPriority priority) {
+    auto start = std::chrono::steady_clock::now();
+    DataFileScanner scanner(dataFile.get(), 0, 64 << 10, priority);
+    int32_t count = 0;
+    while (scanner.next().ok()) {
+      EXPECT_EQ(scanner.key(), count++);
+    }
+    EXPECT_EQ(count, 500);
+    return std::chrono::steady_clock::now() - start;
+  };
+  EXPECT_GE(scan(IOPriority::kLow), std::chrono::milliseconds(100));
+  auto throttled = limiter.throttledMicros();
+  EXPECT_GT(throttled, 0);
+  scan(IOPriority::kHigh);
+  EXPECT_EQ(limiter.throttledMicros(), throttled);
+
+  // The foreground scan put the bucket in debt, background I/O waits for it to be paid back
+  char buf[16];
+  ASSERT_TRUE(dataFile->read(0, sizeof(buf), buf, IOPriority::kLow).ok());
+  EXPECT_GT(limiter.throttledMicros(), throttled);
+
+  // Background reads larger than a second worth of tokens are limited as well, e.g. of chunks of
+  // the default size at a low rate: 1MB at 500KB/s takes about 2s
+  RateLimiter slowLimiter(500 * 1000, false);
+  dataFile->setRateLimiter(&slowLimiter);
+  auto start = std::chrono::steady_clock::now();
+  size_t size = 1000 * 1000;
+  auto data = std::make_unique<char[]>(size);
+  ASSERT_TRUE(dataFile->read(0, size, data.get(), IOPriority::kLow).ok());
+  ASSERT_TRUE(dataFile->read(0, sizeof(buf), buf, IOPriority::kLow).ok());
+  EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(1500));
+  EXPECT_GE(slowLimiter.throttledMicros(), 1500 * 1000);
+}
+
+TEST_F(DataFileTest, ReadValueTest) {
+  std::string dir = "/tmp/DataFileTest/ReadValueTest";
+  std::filesystem::create_directories(dir);
+  auto dataFile = std::make_unique<DataFile>(dir, 1, false);
+  ASSERT_TRUE(dataFile->openDataFile().ok());
+  std::vector<FileOffset> positions;
+  std::vector<std::string> values;
+  for (int32_t i = 0; i < 10; i++) {
+    values.emplace_back(std::string(i * 100, 'a' + i));
+    auto writeRet =
+        dataFile->writeLogRecord(std::make_unique<LogRecord>(i, values.back(), LogType::WRITE));
+    ASSERT_TRUE(writeRet.ok());
+    positions.emplace_back(writeRet.value());
+  }
+  // corrupt the last byte of the last value
+  ASSERT_TRUE(dataFile->writeBuffer("x", 1).ok());
+  ASSERT_TRUE(dataFile->truncate(dataFile->getCurrentFileSize() - 2).ok());
+  ASSERT_TRUE(dataFile->writeBuffer("x", 1).ok());
+
+  auto check = [&](DataFile* file, bool pinned) {
+    PinnableValue pinnable;
+    std::string value;
+    for (int32_t i = 0; i < 9; i++) {
+      ASSERT_TRUE(file->readValue(positions[i], values[i].size(), &pinnable).ok());
+      EXPECT_EQ(pinnable.isPinned(), pinned);
+      EXPECT_EQ(pinnable.view(), values[i]);
+      ASSERT_TRUE(file->readValue(positions[i], values[i].size(), &value).ok());
+      EXPECT_EQ(value, values[i]);
+    }
+    EXPECT_FALSE(file->readValue(positions[9], values[9].size(), &pinnable).ok());
+    EXPECT_FALSE(file->readValue(positions[9], values[9].size(), &value).ok());
+  };
+  check(dataFile.get(), false);
+  dataFile->enableWriteBuffer(4096);
+  check(dataFile.get(), false);
+  ASSERT_TRUE(dataFile->closeDataFile().ok());
+
+  // values pinned to the mapping outlive the file
+  dataFile = std::make_unique<DataFile>(dir, 1, true);
+  dataFile->setMmapReads(true);
+  ASSERT_TRUE(dataFile->openDataFile().ok());
+  check(dataFile.get(), true);
+  PinnableValue pinnable;
+  ASSERT_TRUE(dataFile->readValue(positions[5], values[5].size(), &pinnable).ok());
+  ASSERT_TRUE(dataFile->closeDataFile().ok());
+  dataFile.reset();
+  EXPECT_EQ(pinnable.view(), values[5]);
+}
+
+TEST_F(DataFileTest, WriteBufferTest) {
+  std::string dir = "/tmp/DataFileTest/WriteBufferTest";
+  std::filesystem::create_directories(dir);
+  auto dataFile = std::make_unique<DataFile>(dir, 1, false);
+  ASSERT_TRUE(dataFile->openDataFile().ok());
+  dataFile->enableWriteBuffer(256);
+
+  // 3 records of 31B fit in the buffer, nothing is written to the file yet
+  std::vector<FileOffset> positions;
+  for (int32_t i = 0; i < 3; i++) {
+    auto writeRet = dataFile->writeLogRecord(
+        std::make_unique<LogRecord>(i, "test_value" + std::to_string(i), LogType::WRITE));
+    ASSERT_TRUE(writeRet.ok());
+    positions.emplace_back(writeRet.value());
+  }
+  EXPECT_EQ(0, std::filesystem::file_size(dir + "/1.data"));
+  EXPECT_EQ(93, dataFile->getCurrentFileSize());
+
+  // buffered records are readable
+  for (int32_t i = 0; i < 3; i++) {
+    auto readRet = dataFile->readLogRecord(positions[i]);
+    ASSERT_TRUE(readRet.ok());
+    EXPECT_EQ(readRet.value()->getKey(), i);
+    EXPECT_EQ(readRet.value()->getValue(), "test_value" + std::to_string(i));
+  }
+  // reading past the buffered records hits EOF
+  auto readRet = dataFile->readLogRecord(93);
+  EXPECT_EQ(readRet.status().code(), Status::Code::kEOF);
+
+  // a record larger than the buffer flushes it and is written through
+  auto writeRet = dataFile->writeLogRecord(
+      std::make_unique<LogRecord>(3, std::string(300, 'x'), LogType::WRITE));
+  ASSERT_TRUE(writeRet.ok());
+  EXPECT_EQ(93 + 320, std::filesystem::file_size(dir + "/1.data"));
+
+  // flush on sync
+  writeRet =
+      dataFile->writeLogRecord(std::make_unique<LogRecord>(4, "test_value4", LogType::WRITE));
+  ASSERT_TRUE(writeRet.ok());
+  EXPECT_EQ(93 + 320, std::filesystem::file_size(dir + "/1.data"));
+  ASSERT_TRUE(dataFile->syncData().ok());
+  EXPECT_EQ(93 + 320 + 31, std::filesystem::file_size(dir + "/1.data"));
+
+  // flush on close
+  writeRet =
+      dataFile->writeLogRecord(std::make_unique<LogRecord>(5, "test_value5", LogType::WRITE));
+  ASSERT_TRUE(writeRet.ok());
+  ASSERT_TRUE(dataFile->closeDataFile().ok());
+  EXPECT_EQ(93 + 320 + 31 * 2, std::filesystem::file_size(dir + "/1.data"));
+}
+
 // Main function for running all tests
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
 }
+TEST_F(DataFileTest, DirectIOTest) {
+  std::string dir = "/tmp/DataFileTest/DirectIOTest";
+  std::filesystem::create_directories(dir);
+  auto fileName = dir + "/1.data";
+  auto dataFile = std::make_unique<DataFile>(dir, 1, false, true);
+  ASSERT_TRUE(dataFile->openDataFile().ok());
+
+  // records are written through in whole blocks
+  std::vector<std::pair<FileOffset, std::string>> records;
+  auto writeRecords = [&](int32_t from, int32_t to) {
+    for (int32_t i = from; i < to; i++) {
+      auto value = std::string(i % 3 == 0 ? 4000 : 100, 'a' + i % 26);
+      auto writeRet =
+          dataFile->writeLogRecord(std::make_unique<LogRecord>(i, value, LogType::WRITE));
+      ASSERT_TRUE(writeRet.ok());
+      records.emplace_back(writeRet.value(), value);
+    }
+  };
+  auto checkRecords = [&]() {
+    for (size_t i = 0; i < records.size(); i++) {
+      auto readRet = dataFile->readLogRecord(records[i].first);
+      ASSERT_TRUE(readRet.ok());
+      EXPECT_EQ(readRet.value()->getKey(), i);
+      EXPECT_EQ(readRet.value()->getValue(), records[i].second);
+    }
+  };
+  writeRecords(0, 10);
+  EXPECT_EQ(0, std::filesystem::file_size(fileName) % kDirectIOAlignment);
+  EXPECT_LT(dataFile->getCurrentFileSize(), std::filesystem::file_size(fileName));
+  checkRecords();
+
+  // the padding is trimmed on close
+  auto fileSize = dataFile->getCurrentFileSize();
+  ASSERT_TRUE(dataFile->closeDataFile().ok());
+  EXPECT_EQ(fileSize, std::filesystem::file_size(fileName));
+
+  // the tail block is carried over when appending to an existing file. Buffered appends, some
+  // larger than the buffer, are readable before being written out.
+  dataFile = std::make_unique<DataFile>(dir, 1, false, true);
+  ASSERT_TRUE(dataFile->openDataFile().ok());
+  EXPECT_EQ(fileSize, dataFile->getCurrentFileSize());
+  dataFile->enableWriteBuffer(kDirectIOAlignment);
+  writeRecords(10, 20);
+  checkRecords();
+  ASSERT_TRUE(dataFile->syncData().ok());
+  fileSize = dataFile->getCurrentFileSize();
+  ASSERT_TRUE(dataFile->closeDataFile().ok());
+
+  // a zeroed header after the last record marks the end of data
+  std::filesystem::resize_file(fileName, fileSize + 100);
+  dataFile = std::make_unique<DataFile>(dir, 1, true, true);
+  ASSERT_TRUE(dataFile->openDataFile().ok());
+  checkRecords();
+  auto readRet = dataFile->readLogRecord(fileSize);
+  EXPECT_EQ(readRet.status().code(), Status::Code::kEOF);
+}
+
 }  // namespace bitcask
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+
+#include "db/FileTable.h"
+
+namespace bitcask {
+
+class FileTableTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    std::filesystem::create_directories(dir_);
+  }
+
+  void TearDown() override {
+    std::filesystem::remove_all("/tmp/FileTableTest");
+  }
+
+  std::shared_ptr<DataFile> openFile(FileID fileId) {
+    auto dataFile = std::make_shared<DataFile>(dir_, fileId, false);
+    EXPECT_TRUE(dataFile->openDataFile().ok());
+    return dataFile;
+  }
+
+  const std::string dir_ = "/tmp/FileTableTest/db";
+};
+
+TEST_F(FileTableTest, FindTest) {
+  auto file3 = openFile(3);
+  auto file5 = openFile(5);
+  FileTable table({{5, file5}, {3, file3}});
+  EXPECT_EQ(table.size(), 2);
+  EXPECT_EQ(table.find(3), file3.get());
+  EXPECT_EQ(table.find(5), file5.get());
+  // a gap, and ids out of the range
+  EXPECT_EQ(table.find(4), nullptr);
+  EXPECT_EQ(table.find(2), nullptr);
+  EXPECT_EQ(table.find(6), nullptr);
+  EXPECT_EQ(table.find(0), nullptr);
+
+  FileTable empty({});
+  EXPECT_EQ(empty.size(), 0);
+  EXPECT_EQ(empty.find(0), nullptr);
+}
+
+TEST_F(FileTableTest, ReaderTest) {
+  VersionedFileTable versioned;
+  std::weak_ptr<DataFile> file1;
+  {
+    auto dataFile = openFile(1);
+    file1 = dataFile;
+    versioned.publish(std::make_unique<FileTable>(
+        std::vector<std::pair<FileID, std::shared_ptr<DataFile>>>{{1, dataFile}}));
+  }
+  {
+    VersionedFileTable::Reader reader(versioned);
+    EXPECT_EQ(reader->find(1), file1.lock().get());
+
+    // Replace file 1. The reader keeps seeing its snapshot, which is not reclaimed until it leaves.
+    versioned.publish(std::make_unique<FileTable>(
+        std::vector<std::pair<FileID, std::shared_ptr<DataFile>>>{{2, openFile(2)}}));
+    EXPECT_FALSE(versioned.reclaim());
+    EXPECT_EQ(versioned.numRetired(), 1);
+    EXPECT_FALSE(file1.expired());
+    EXPECT_NE(reader->find(1), nullptr);
+
+    // New readers see the new snapshot
+    VersionedFileTable::Reader newReader(versioned);
+    EXPECT_EQ(newReader->find(1), nullptr);
+    EXPECT_NE(newReader->find(2), nullptr);
+  }
+  // The last reader of the old snapshot has left, the replaced file is closed
+  EXPECT_TRUE(versioned.reclaim());
+  EXPECT_EQ(versioned.numRetired(), 0);
+  EXPECT_TRUE(file1.expired());
+}
+
+TEST_F(FileTableTest, ConcurrentReadersTest) {
+  VersionedFileTable versioned;
+  const FileID numFiles = 64;
+  std::vector<std::shared_ptr<DataFile>> files;
+  for (FileID fileId = 1; fileId <= numFiles; fileId++) {
+    files.emplace_back(openFile(fileId));
+  }
+  std::vector<std::pair<FileID, std::shared_ptr<DataFile>>> tableFiles{{1, files[0]}};
+  versioned.publish(std::make_unique<FileTable>(tableFiles));
+
+  // Readers always find the file published first, along with a growing number of others
+  std::atomic<bool> stop{false};
+  auto readFunc = [&] {
+    size_t lastSize = 0;
+    while (!stop) {
+      VersionedFileTable::Reader reader(versioned);
+      ASSERT_EQ(reader->find(1), files[0].get());
+      ASSERT_GE(reader->size(), lastSize);
+      lastSize = reader->size();
+      ASSERT_NE(reader->find(static_cast<FileID>(lastSize)), nullptr);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back(readFunc);
+  }
+  for (FileID fileId = 2; fileId <= numFiles; fileId++) {
+    tableFiles.emplace_back(fileId, files[fileId - 1]);
+    versioned.publish(std::make_unique<FileTable>(tableFiles));
+    std::this_thread::yield();
+  }
+  versioned.synchronize();
+  EXPECT_EQ(versioned.numRetired(), 0);
+  stop = true;
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+}  // namespace bitcask
@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "db/FlatIndex.h"
+#include "db/HashIndex.h"
+
+namespace bitcask {
+
+class FlatIndexTest : public ::testing::Test {
+ protected:
+  void SetUp() override {}
+
+  void TearDown() override {}
+};
+
+TEST_F(FlatIndexTest, SimpleTest) {
+  auto index = std::make_unique<FlatIndex>(128);
+  KeyType key = 1234;
+  // an offset past 4GB
+  auto logPos = std::make_shared<LogPos>(7, 10, (FileOffset(3) << 32) + 100, 0);
+  auto status = index->put(key, logPos);
+  EXPECT_TRUE(status.ok());
+
+  auto ret = index->get(key);
+  ASSERT_TRUE(ret.ok());
+  auto retrievedLogPos = std::move(ret).value();
+  EXPECT_EQ(retrievedLogPos->fileId_, logPos->fileId_);
+  EXPECT_EQ(retrievedLogPos->valueSize_, logPos->valueSize_);
+  EXPECT_EQ(retrievedLogPos->pos_, logPos->pos_);
+
+  // overwrite
+  ASSERT_TRUE(index->put(key, std::make_shared<LogPos>(8, 20, 40, 0)).ok());
+  EXPECT_EQ(index->size(), 1);
+  EXPECT_EQ(index->get(key).value()->fileId_, 8);
+
+  // compare and put only moves the key from the record expected
+  auto moved = std::make_shared<LogPos>(9, 20, 80, 0);
+  EXPECT_EQ(index->compareAndPut(key, LogPos(9, 10, 0, 0), moved).code(), Status::Code::kNotFound);
+  EXPECT_EQ(index->compareAndPut(key + 1, LogPos(8, 20, 40, 0), moved).code(),
+            Status::Code::kNotFound);
+  ASSERT_TRUE(index->compareAndPut(key, LogPos(8, 20, 40, 0), moved).ok());
+  EXPECT_EQ(index->get(key).value()->fileId_, 9);
+  EXPECT_EQ(index->get(key).value()->pos_, 80);
+
+  // remove
+  status = index->remove(key);
+  EXPECT_TRUE(status.ok());
+  ret = index->get(key);
+  EXPECT_FALSE(ret.ok());
+  EXPECT_EQ(ret.status().message(), "Key not found");
+  EXPECT_EQ(index->remove(key).code(), Status::Code::kNotFound);
+
+  // offsets are limited to 40 bits
+  status = index->put(key, std::make_shared<LogPos>(1, 10, FileOffset(1) << 40, 0));
+  EXPECT_EQ(status.code(), Status::Code::kOverLimit);
+}
+
+TEST_F(FlatIndexTest, BatchUpdateTest) {
+  FlatIndex index;
+  ASSERT_TRUE(index.put(1, std::make_shared<LogPos>(1, 10, 0, 0)).ok());
+
+  std::vector<std::pair<KeyType, std::shared_ptr<LogPos>>> updates;
+  updates.emplace_back(1, nullptr);
+  updates.emplace_back(2, std::make_shared<LogPos>(1, 10, 30, 0));
+  updates.emplace_back(2, std::make_shared<LogPos>(1, 10, 60, 0));
+  ASSERT_TRUE(index.batchUpdate(updates).ok());
+
+  EXPECT_FALSE(index.get(1).ok());
+  auto ret = index.get(2);
+  ASSERT_TRUE(ret.ok());
+  EXPECT_EQ(ret.value()->pos_, 60);
+
+  auto results = index.multiGet({2, 1, 2});
+  ASSERT_EQ(results.size(), 3);
+  EXPECT_EQ(results[0].value()->pos_, 60);
+  EXPECT_EQ(results[1].status().code(), Status::Code::kNotFound);
+  EXPECT_EQ(results[2].value()->pos_, 60);
+}
+
+TEST_F(FlatIndexTest, RandomOpsTest) {
+  // Random puts and removes, checked against HashIndex. Keys are multiples of 1024, so that they
+  // share their low bits.
+  FlatIndex index;
+  HashIndex expected;
+  std::mt19937 rng(42);
+  const int numKeys = 5000;
+  for (int i = 0; i < 100000; i++) {
+    KeyType key = static_cast<KeyType>(rng() % numKeys) * 1024;
+    if (rng() % 3 == 0) {
+      EXPECT_EQ(index.remove(key).ok(), expected.remove(key).ok());
+    } else {
+      auto logPos = std::make_shared<LogPos>(rng() % 100, rng() % 4096, rng() % (1 << 30), 0);
+      ASSERT_TRUE(index.put(key, logPos).ok());
+      expected.put(key, logPos);
+    }
+  }
+
+  auto keys = expected.listKeys().value();
+  EXPECT_EQ(index.size(), keys.size());
+  for (auto key : keys) {
+    auto ret = index.get(key);
+    ASSERT_TRUE(ret.ok());
+    auto expectedLogPos = expected.get(key).value();
+    EXPECT_EQ(ret.value()->fileId_, expectedLogPos->fileId_);
+    EXPECT_EQ(ret.value()->valueSize_, expectedLogPos->valueSize_);
+    EXPECT_EQ(ret.value()->pos_, expectedLogPos->pos_);
+  }
+
+  // The iterator and listKeys see every key once
+  auto listed = index.listKeys().value();
+  std::sort(listed.begin(), listed.end());
+  std::sort(keys.begin(), keys.end());
+  EXPECT_EQ(listed, keys);
+  std::vector<KeyType> iterated;
+  {
+    auto iterator = index.createIterator();
+    while (auto res = iterator->next()) {
+      iterated.emplace_back(res->key);
+    }
+  }
+  std::sort(iterated.begin(), iterated.end());
+  EXPECT_EQ(iterated, keys);
+
+  // The table grew to fit the keys and no more, at 17 bytes per slot
+  EXPECT_GE(index.capacity() / 8 * 7, index.size());
+  EXPECT_LE(index.capacity(), 4 * numKeys);
+  EXPECT_EQ(index.memoryUsage(), index.capacity() * 17 + 16);
+}
+
+}  // namespace bitcask
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -28,6 +28,14 @@ TEST_F(HashMapIndexTest, SimpleTest) {
   EXPECT_EQ(retrievedLogPos->pos_, logPos->pos_);
   EXPECT_EQ(retrievedLogPos->tstamp_, logPos->tstamp_);
 
+  // compare and put only moves the key from the record expected
+  auto moved = std::make_shared<LogPos>(9, 20, 80, 0);
+  EXPECT_EQ(index->compareAndPut(key, LogPos(9, 10, 0, 0), moved).code(), Status::Code::kNotFound);
+  EXPECT_EQ(index->compareAndPut(key + 1, *logPos, moved).code(), Status::Code::kNotFound);
+  ASSERT_TRUE(index->compareAndPut(key, *logPos, moved).ok());
+  EXPECT_EQ(index->get(key).value()->fileId_, 9);
+  EXPECT_EQ(index->get(key).value()->pos_, 80);
+
   // remove
   status = index->remove(key);
   EXPECT_TRUE(status.ok());
@@ -38,6 +46,41 @@ TEST_F(HashMapIndexTest, SimpleTest) {
   EXPECT_EQ(ret.status().message(), "Key not found");
 }
 
+TEST_F(HashMapIndexTest, BatchUpdateTest) {
+  auto index = std::make_unique<HashIndex>(128);
+  auto tstamp = time::WallClock::fastNowInMicroSec();
+  ASSERT_TRUE(index->put(1, std::make_shared<LogPos>(1, 10, 0, tstamp)).ok());
+
+  std::vector<std::pair<KeyType, std::shared_ptr<LogPos>>> updates;
+  updates.emplace_back(1, nullptr);
+  updates.emplace_back(2, std::make_shared<LogPos>(1, 10, 30, tstamp));
+  updates.emplace_back(2, std::make_shared<LogPos>(1, 10, 60, tstamp));
+  ASSERT_TRUE(index->batchUpdate(updates).ok());
+
+  EXPECT_FALSE(index->get(1).ok());
+  auto ret = index->get(2);
+  ASSERT_TRUE(ret.ok());
+  EXPECT_EQ(ret.value()->pos_, 60);
+}
+
+TEST_F(HashMapIndexTest, MultiGetTest) {
+  auto index = std::make_unique<HashIndex>(128);
+  auto tstamp = time::WallClock::fastNowInMicroSec();
+  for (KeyType key = 0; key < 10; key++) {
+    ASSERT_TRUE(index->put(key, std::make_shared<LogPos>(1, 10, key * 30, tstamp)).ok());
+  }
+
+  auto results = index->multiGet({9, 20, 0, 9});
+  ASSERT_EQ(results.size(), 4);
+  ASSERT_TRUE(results[0].ok());
+  EXPECT_EQ(results[0].value()->pos_, 270);
+  EXPECT_EQ(results[1].status().code(), Status::Code::kNotFound);
+  ASSERT_TRUE(results[2].ok());
+  EXPECT_EQ(results[2].value()->pos_, 0);
+  ASSERT_TRUE(results[3].ok());
+  EXPECT_EQ(results[3].value()->pos_, 270);
+}
+
 }  // namespace bitcask
 
 int main(int argc, char** argv) {
@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+
+#include "db/IOBackend.h"
+
+namespace bitcask {
+class IOBackendTest : public ::testing::TestWithParam<IOBackendType> {
+ protected:
+  void SetUp() override {
+    std::filesystem::create_directories("/tmp/IOBackendTest");
+    fd_ = open("/tmp/IOBackendTest/file", O_CREAT | O_RDWR, 0644);
+    ASSERT_NE(fd_, -1);
+    io_ = IOBackend::get(GetParam());
+  }
+
+  void TearDown() override {
+    close(fd_);
+    std::filesystem::remove_all("/tmp/IOBackendTest");
+  }
+
+  int fd_{-1};
+  IOBackend* io_{nullptr};
+};
+
+TEST_P(IOBackendTest, ReadWriteTest) {
+  // More iovecs than a single writev takes
+  std::vector<std::string> values;
+  std::vector<struct iovec> iovs;
+  std::string expected;
+  for (int i = 0; i < 2000; i++) {
+    values.emplace_back(fmt::format("value_{}", i));
+  }
+  for (auto& value : values) {
+    iovs.push_back({value.data(), value.size()});
+    expected += value;
+  }
+  auto status = io_->writev(fd_, iovs.data(), iovs.size(), 10, expected.size());
+  ASSERT_TRUE(status.ok()) << status.toString();
+  status = io_->sync(fd_, true);
+  ASSERT_TRUE(status.ok()) << status.toString();
+
+  std::string buf(expected.size(), '\0');
+  status = io_->read(fd_, buf.data(), buf.size(), 10);
+  ASSERT_TRUE(status.ok()) << status.toString();
+  EXPECT_EQ(buf, expected);
+
+  // Read past the end of file
+  status = io_->read(fd_, buf.data(), buf.size(), 20);
+  EXPECT_EQ(status.code(), Status::Code::kEOF);
+
+  // Read many pieces at once, more than the ring size
+  size_t pieceSize = 7;
+  size_t pieceCnt = expected.size() / pieceSize;
+  std::string pieces(pieceCnt * pieceSize, '\0');
+  std::vector<IOBackend::ReadRequest> requests;
+  for (size_t i = 0; i < pieceCnt; i++) {
+    FileOffset offset = 10 + i * pieceSize;
+    requests.push_back({fd_, pieces.data() + i * pieceSize, pieceSize, offset, Status()});
+  }
+  requests.push_back({fd_, buf.data(), buf.size(), 20, Status()});
+  io_->readBatch(requests);
+  for (size_t i = 0; i < pieceCnt; i++) {
+    EXPECT_TRUE(requests[i].status_.ok()) << requests[i].status_.toString();
+  }
+  EXPECT_EQ(pieces, expected.substr(0, pieces.size()));
+  EXPECT_EQ(requests.back().status_.code(), Status::Code::kEOF);
+
+  // Scatter the file back into the values
+  std::vector<std::string> readValues;
+  std::vector<struct iovec> readIovs;
+  for (auto& value : values) {
+    readValues.emplace_back(value.size(), '\0');
+  }
+  for (auto& value : readValues) {
+    readIovs.push_back({value.data(), value.size()});
+  }
+  status = io_->readv(fd_, readIovs.data(), readIovs.size(), 10, expected.size());
+  ASSERT_TRUE(status.ok()) << status.toString();
+  EXPECT_EQ(readValues, values);
+  char tail[16];
+  struct iovec tailIov = {tail, sizeof(tail)};
+  FileOffset tailOffset = 10 + expected.size() - 8;
+  status = io_->readv(fd_, &tailIov, 1, tailOffset, sizeof(tail));
+  EXPECT_EQ(status.code(), Status::Code::kEOF);
+}
+
+TEST_P(IOBackendTest, ErrorTest) {
+  std::string value = "value";
+  struct iovec iov = {value.data(), value.size()};
+  ASSERT_TRUE(io_->writev(fd_, &iov, 1, 0, value.size()).ok());
+
+  // Failed reads of a batch leave the ring usable for the next operations
+  char buf[8];
+  std::vector<IOBackend::ReadRequest> requests;
+  for (int i = 0; i < 100; i++) {
+    requests.push_back({i % 2 == 0 ? -1 : fd_, buf, value.size(), 0, Status()});
+  }
+  io_->readBatch(requests);
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(requests[i].status_.ok(), i % 2 == 1) << requests[i].status_.toString();
+  }
+  EXPECT_FALSE(io_->sync(-1, true).ok());
+  EXPECT_FALSE(io_->writev(-1, &iov, 1, 0, value.size()).ok());
+  auto status = io_->read(fd_, buf, value.size(), 0);
+  ASSERT_TRUE(status.ok()) << status.toString();
+  EXPECT_EQ(std::string(buf, value.size()), value);
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends,
+                         IOBackendTest,
+                         ::testing::Values(IOBackendType::kPosix, IOBackendType::kIoUring));
+
+}  // namespace bitcask
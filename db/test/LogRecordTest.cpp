@@ -30,6 +30,89 @@ TEST_F(LogRecordTest, ConstructorTest) {
   EXPECT_EQ(1, true);
 }
 
+// The header encoded without copying the value must match the fully encoded record
+TEST_F(LogRecordTest, EncodeHeaderTest) {
+  KeyType key = 1234;
+  std::string value = "test_value";
+  LogRecord record(key, value, LogType::WRITE);
+  record.encode();
+
+  char header[kLogHeaderAndKeySize];
+  LogRecord::encodeHeader(header,
+                          key,
+                          value.data(),
+                          static_cast<uint16_t>(value.size()),
+                          LogType::WRITE,
+                          record.getTimeStamp());
+  EXPECT_EQ(0, std::memcmp(header, record.getEncodedBuffer(), kLogHeaderAndKeySize));
+  EXPECT_EQ(0,
+            std::memcmp(
+                value.data(), record.getEncodedBuffer() + kLogHeaderAndKeySize, value.size()));
+}
+
+TEST_F(LogRecordTest, CrcExtendTest) {
+  std::string data = "hello bitcask";
+  for (size_t split = 0; split <= data.size(); split++) {
+    auto crc = crc::crc32(data.data(), split);
+    EXPECT_EQ(crc::crc32(data.data(), data.size()),
+              crc::extend(crc, data.data() + split, data.size() - split));
+  }
+}
+
+TEST_F(LogRecordTest, Crc32cTest) {
+  std::string check = "123456789";
+  EXPECT_EQ(crc::crc32c(check.data(), check.size()), 0xE3069283);
+  EXPECT_EQ(crc::crc32(check.data(), check.size()), 0xCBF43926);
+
+  // Both implementations agree, whatever the length and the alignment
+  std::string data;
+  for (int i = 0; i < 256; i++) {
+    data.push_back(static_cast<char>(i * 31 + 7));
+  }
+  for (size_t start = 0; start < 8; start++) {
+    for (size_t length = 0; start + length <= data.size(); length += 13) {
+      auto expected = crc::extend32cSlicing8(0, data.data() + start, length);
+      EXPECT_EQ(crc::crc32c(data.data() + start, length), expected);
+      if (crc::hasHardwareCrc32c()) {
+        EXPECT_EQ(crc::extend32cHardware(0, data.data() + start, length), expected);
+      }
+    }
+  }
+  for (size_t split = 0; split <= data.size(); split += 7) {
+    auto crc = crc::crc32c(data.data(), split);
+    EXPECT_EQ(crc::crc32c(data.data(), data.size()),
+              crc::extend32c(crc, data.data() + split, data.size() - split));
+  }
+}
+
+// Records are written with CRC32C, and the ones written with CRC-32 before are still verified
+TEST_F(LogRecordTest, CrcFormatTest) {
+  KeyType key = 1234;
+  std::string value = "test_value";
+  LogRecord record(key, value, LogType::DELETE);
+  record.encode();
+  char* buf = record.getEncodedBuffer();
+  auto size = record.getTotalSize();
+
+  auto header = LogRecord::decodeLogRecordHeader(buf);
+  EXPECT_TRUE(header->crc32c_);
+  EXPECT_EQ(header->logType_, LogType::DELETE);
+  EXPECT_EQ(header->crc_, crc::crc32c(buf + sizeof(uint32_t), size - sizeof(uint32_t)));
+  auto restSize = size - kLogHeaderSize;
+  auto crc = LogRecord::computeCrc(buf, kLogHeaderSize, buf + kLogHeaderSize, restSize);
+  EXPECT_EQ(header->crc_, crc);
+
+  // the same record in the old format
+  buf[kLogTypeOffset] = static_cast<char>(LogType::DELETE);
+  uint32_t legacyCrc = crc::crc32(buf + sizeof(uint32_t), size - sizeof(uint32_t));
+  std::memcpy(buf, &legacyCrc, sizeof(legacyCrc));
+  header = LogRecord::decodeLogRecordHeader(buf);
+  EXPECT_FALSE(header->crc32c_);
+  EXPECT_EQ(header->logType_, LogType::DELETE);
+  crc = LogRecord::computeCrc(buf, kLogHeaderSize, buf + kLogHeaderSize, restSize);
+  EXPECT_EQ(legacyCrc, crc);
+}
+
 // Main function for running all tests
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "db/HashIndex.h"
+#include "db/OrderedIndex.h"
+
+namespace bitcask {
+
+class OrderedIndexTest : public ::testing::Test {
+ protected:
+  void SetUp() override {}
+
+  void TearDown() override {}
+};
+
+TEST_F(OrderedIndexTest, SimpleTest) {
+  auto index = std::make_unique<OrderedIndex>();
+  KeyType key = 1234;
+  auto logPos = std::make_shared<LogPos>(1, 10, 0, 0);
+  ASSERT_TRUE(index->put(key, logPos).ok());
+
+  auto ret = index->get(key);
+  ASSERT_TRUE(ret.ok());
+  EXPECT_EQ(ret.value(), logPos);
+  EXPECT_FALSE(index->get(key + 1).ok());
+
+  // overwrite
+  ASSERT_TRUE(index->put(key, std::make_shared<LogPos>(2, 20, 40, 0)).ok());
+  EXPECT_EQ(index->size(), 1);
+  EXPECT_EQ(index->get(key).value()->fileId_, 2);
+
+  // compare and put only moves the key from the record expected
+  auto moved = std::make_shared<LogPos>(9, 20, 80, 0);
+  EXPECT_EQ(index->compareAndPut(key, LogPos(9, 10, 0, 0), moved).code(), Status::Code::kNotFound);
+  EXPECT_EQ(index->compareAndPut(key + 1, LogPos(2, 20, 40, 0), moved).code(),
+            Status::Code::kNotFound);
+  ASSERT_TRUE(index->compareAndPut(key, LogPos(2, 20, 40, 0), moved).ok());
+  EXPECT_EQ(index->get(key).value()->fileId_, 9);
+  EXPECT_EQ(index->get(key).value()->pos_, 80);
+
+  ASSERT_TRUE(index->remove(key).ok());
+  ret = index->get(key);
+  EXPECT_FALSE(ret.ok());
+  EXPECT_EQ(ret.status().message(), "Key not found");
+  EXPECT_EQ(index->remove(key).code(), Status::Code::kNotFound);
+  EXPECT_EQ(index->size(), 0);
+}
+
+TEST_F(OrderedIndexTest, CollectTest) {
+  OrderedIndex index;
+  // keys 0, 10, ..., 9990, in many leaves
+  std::vector<std::pair<KeyType, std::shared_ptr<LogPos>>> updates;
+  for (KeyType key = 0; key < 10000; key += 10) {
+    updates.emplace_back(key, std::make_shared<LogPos>(1, 10, key, 0));
+  }
+  ASSERT_TRUE(index.batchUpdate(updates).ok());
+  EXPECT_EQ(index.size(), 1000);
+
+  std::vector<Index::IterRes> entries;
+  index.collect(995, true, 200, &entries);
+  ASSERT_EQ(entries.size(), 200);
+  for (size_t i = 0; i < entries.size(); i++) {
+    EXPECT_EQ(entries[i].key, 1000 + 10 * static_cast<KeyType>(i));
+    EXPECT_EQ(entries[i].logPos->pos_, entries[i].key);
+  }
+
+  entries.clear();
+  index.collect(1000, false, 200, &entries);
+  ASSERT_EQ(entries.size(), 101);
+  for (size_t i = 0; i < entries.size(); i++) {
+    EXPECT_EQ(entries[i].key, 1000 - 10 * static_cast<KeyType>(i));
+  }
+
+  // past both ends
+  entries.clear();
+  index.collect(9991, true, 10, &entries);
+  EXPECT_TRUE(entries.empty());
+  index.collect(-1, false, 10, &entries);
+  EXPECT_TRUE(entries.empty());
+  index.collect(std::numeric_limits<KeyType>::max(), false, 2, &entries);
+  ASSERT_EQ(entries.size(), 2);
+  EXPECT_EQ(entries[1].key, 9980);
+}
+
+TEST_F(OrderedIndexTest, RandomOpsTest) {
+  // Random puts and removes, checked against HashIndex. Removes empty whole leaves and subtrees.
+  OrderedIndex index;
+  HashIndex expected;
+  std::mt19937 rng(42);
+  const int numKeys = 20000;
+  for (int round = 0; round < 4; round++) {
+    for (int i = 0; i < 50000; i++) {
+      auto key = static_cast<KeyType>(rng() % numKeys) - numKeys / 2;
+      // remove more than put in odd rounds
+      if (rng() % 4 < (round % 2 == 0 ? 1u : 3u)) {
+        EXPECT_EQ(index.remove(key).ok(), expected.remove(key).ok());
+      } else {
+        auto logPos = std::make_shared<LogPos>(rng() % 100, rng() % 4096, rng() % (1 << 30), 0);
+        ASSERT_TRUE(index.put(key, logPos).ok());
+        expected.put(key, logPos);
+      }
+    }
+
+    auto keys = expected.listKeys().value();
+    std::sort(keys.begin(), keys.end());
+    EXPECT_EQ(index.size(), keys.size());
+    for (auto key : keys) {
+      auto ret = index.get(key);
+      ASSERT_TRUE(ret.ok());
+      EXPECT_EQ(ret.value(), expected.get(key).value());
+    }
+
+    // listKeys, the iterator and collect go through the keys in order
+    EXPECT_EQ(index.listKeys().value(), keys);
+    std::vector<KeyType> iterated;
+    {
+      auto iterator = index.createIterator();
+      while (auto res = iterator->next()) {
+        iterated.emplace_back(res->key);
+      }
+      EXPECT_EQ(iterator->next(), nullptr);
+    }
+    EXPECT_EQ(iterated, keys);
+    std::vector<Index::IterRes> entries;
+    index.collect(std::numeric_limits<KeyType>::max(), false, keys.size() + 1, &entries);
+    ASSERT_EQ(entries.size(), keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      EXPECT_EQ(entries[i].key, keys[keys.size() - 1 - i]);
+    }
+  }
+
+  // Remove all keys, the tree shrinks back to an empty leaf
+  for (auto key : expected.listKeys().value()) {
+    ASSERT_TRUE(index.remove(key).ok());
+  }
+  EXPECT_EQ(index.size(), 0);
+  EXPECT_TRUE(index.listKeys().value().empty());
+  ASSERT_TRUE(index.put(7, std::make_shared<LogPos>(1, 10, 0, 0)).ok());
+  EXPECT_EQ(index.listKeys().value(), std::vector<KeyType>{7});
+}
+
+}  // namespace bitcask
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+
+#include "db/ShardedIndex.h"
+#include "utils/WallClock.h"
+
+namespace bitcask {
+
+class ShardedIndexTest : public ::testing::Test {
+ protected:
+  void SetUp() override {}
+
+  void TearDown() override {}
+};
+
+TEST_F(ShardedIndexTest, SimpleTest) {
+  auto index = std::make_unique<ShardedIndex>(128);
+  EXPECT_EQ(index->numShards(), FLAGS_index_shards);
+  KeyType key = 1234;
+  auto logPos = std::make_shared<LogPos>(1, 10, 0, time::WallClock::fastNowInMicroSec());
+  ASSERT_TRUE(index->put(key, logPos).ok());
+
+  auto ret = index->get(key);
+  ASSERT_TRUE(ret.ok());
+  EXPECT_EQ(ret.value(), logPos);
+
+  // compare and put only moves the key from the record expected
+  auto moved = std::make_shared<LogPos>(9, 20, 80, 0);
+  EXPECT_EQ(index->compareAndPut(key, LogPos(9, 10, 0, 0), moved).code(), Status::Code::kNotFound);
+  EXPECT_EQ(index->compareAndPut(key + 1, *logPos, moved).code(), Status::Code::kNotFound);
+  ASSERT_TRUE(index->compareAndPut(key, *logPos, moved).ok());
+  EXPECT_EQ(index->get(key).value()->fileId_, 9);
+  EXPECT_EQ(index->get(key).value()->pos_, 80);
+
+  ASSERT_TRUE(index->remove(key).ok());
+  ret = index->get(key);
+  EXPECT_FALSE(ret.ok());
+  EXPECT_EQ(ret.status().message(), "Key not found");
+  EXPECT_EQ(index->remove(key).code(), Status::Code::kNotFound);
+}
+
+TEST_F(ShardedIndexTest, BatchUpdateTest) {
+  ShardedIndex index;
+  ASSERT_TRUE(index.put(1, std::make_shared<LogPos>(1, 10, 0, 0)).ok());
+
+  // keys of many shards
+  std::vector<std::pair<KeyType, std::shared_ptr<LogPos>>> updates;
+  updates.emplace_back(1, nullptr);
+  for (KeyType key = 2; key < 200; key++) {
+    updates.emplace_back(key, std::make_shared<LogPos>(1, 10, key * 30, 0));
+  }
+  updates.emplace_back(2, std::make_shared<LogPos>(1, 10, 1000, 0));
+  ASSERT_TRUE(index.batchUpdate(updates).ok());
+
+  EXPECT_FALSE(index.get(1).ok());
+  EXPECT_EQ(index.get(2).value()->pos_, 1000);
+  EXPECT_EQ(index.get(199).value()->pos_, 199 * 30);
+
+  auto results = index.multiGet({199, 1, 2});
+  ASSERT_EQ(results.size(), 3);
+  EXPECT_EQ(results[0].value()->pos_, 199 * 30);
+  EXPECT_EQ(results[1].status().code(), Status::Code::kNotFound);
+  EXPECT_EQ(results[2].value()->pos_, 1000);
+
+  // listKeys and the iterator go through all shards
+  auto keys = index.listKeys().value();
+  EXPECT_EQ(keys.size(), 198);
+  std::vector<KeyType> iterated;
+  {
+    auto iterator = index.createIterator();
+    while (auto res = iterator->next()) {
+      iterated.emplace_back(res->key);
+    }
+    EXPECT_EQ(iterator->next(), nullptr);
+  }
+  std::sort(keys.begin(), keys.end());
+  std::sort(iterated.begin(), iterated.end());
+  EXPECT_EQ(iterated, keys);
+}
+
+TEST_F(ShardedIndexTest, ConcurrentTest) {
+  ShardedIndex index;
+  const int numThreads = 8;
+  const KeyType numKeys = 1000;
+  // Each thread owns the keys equal to its id modulo numThreads, and reads all keys
+  auto func = [&index](int threadId) {
+    for (KeyType key = threadId; key < numKeys; key += numThreads) {
+      ASSERT_TRUE(index.put(key, std::make_shared<LogPos>(threadId, 10, key, 0)).ok());
+      ASSERT_TRUE(index.get(key).ok());
+      index.get((key * 7) % numKeys);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 0; i < numThreads; ++i) {
+    threads.emplace_back(func, i);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  for (KeyType key = 0; key < numKeys; key++) {
+    auto ret = index.get(key);
+    ASSERT_TRUE(ret.ok());
+    EXPECT_EQ(ret.value()->fileId_, static_cast<FileID>(key % numThreads));
+  }
+}
+
+}  // namespace bitcask
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
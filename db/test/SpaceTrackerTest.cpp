@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+
+#include "db/FlatIndex.h"
+#include "db/HashIndex.h"
+#include "db/LogRecord.h"
+#include "db/OrderedIndex.h"
+#include "db/ShardedIndex.h"
+#include "db/SpaceTracker.h"
+#include "utils/WallClock.h"
+
+namespace bitcask {
+
+class SpaceTrackerTest : public ::testing::Test {
+ protected:
+  static DataFileStats fileStats(const SpaceTracker& tracker, FileID fileId) {
+    for (const auto& stats : tracker.stats()) {
+      if (stats.fileId == fileId) {
+        return stats;
+      }
+    }
+    return {};
+  }
+};
+
+TEST_F(SpaceTrackerTest, CountersTest) {
+  SpaceTracker tracker;
+  tracker.addFile(1, 1000, 0);
+  tracker.append(2, 100);
+  tracker.put(1, 80);
+  auto stats = fileStats(tracker, 1);
+  EXPECT_EQ(stats.totalBytes, 1000);
+  EXPECT_EQ(stats.liveBytes, kLogHeaderAndKeySize + 80);
+  EXPECT_EQ(stats.deadBytes, 1000 - kLogHeaderAndKeySize - 80);
+  EXPECT_EQ(fileStats(tracker, 2).deadBytes, 100);
+
+  tracker.supersede(1, 80);
+  EXPECT_EQ(fileStats(tracker, 1).liveBytes, 0);
+  EXPECT_EQ(fileStats(tracker, 1).deadBytes, 1000);
+
+  // File 1 is old and all dead, file 2 was just written
+  EXPECT_TRUE(tracker.mergeable(1, 0.5, 1000));
+  EXPECT_FALSE(tracker.mergeable(2, 0.5, 1000000));
+  EXPECT_TRUE(tracker.mergeable(2, 0.5, 0));
+  tracker.put(2, 80 - kLogHeaderAndKeySize);
+  EXPECT_FALSE(tracker.mergeable(2, 0.5, 0));
+
+  tracker.remove(1);
+  EXPECT_FALSE(tracker.mergeable(1, 0.5, 0));
+  tracker.supersede(1, 80);
+  ASSERT_EQ(tracker.stats().size(), 1);
+  EXPECT_EQ(tracker.stats()[0].fileId, 2);
+}
+
+TEST_F(SpaceTrackerTest, IndexTest) {
+  std::vector<std::unique_ptr<Index>> indexes;
+  indexes.emplace_back(std::make_unique<HashIndex>());
+  indexes.emplace_back(std::make_unique<FlatIndex>());
+  indexes.emplace_back(std::make_unique<ShardedIndex>());
+  indexes.emplace_back(std::make_unique<OrderedIndex>());
+  for (auto& index : indexes) {
+    SpaceTracker tracker;
+    index->setSpaceTracker(&tracker);
+    auto tstamp = time::WallClock::fastNowInMicroSec();
+    size_t recordSize = kLogHeaderAndKeySize + 10;
+    for (int i = 0; i < 100; i++) {
+      tracker.append(1, recordSize);
+      index->put(i, std::make_shared<LogPos>(1, 10, i * recordSize, tstamp));
+    }
+    EXPECT_EQ(fileStats(tracker, 1).liveBytes, 100 * recordSize);
+
+    // Overwritten, removed, moved and batched keys leave their records dead
+    for (int i = 0; i < 50; i++) {
+      tracker.append(2, recordSize);
+      index->put(i, std::make_shared<LogPos>(2, 10, i * recordSize, tstamp));
+    }
+    for (int i = 50; i < 60; i++) {
+      index->remove(i);
+    }
+    index->compareAndPut(60, LogPos(1, 10, 60 * recordSize, tstamp),
+                         std::make_shared<LogPos>(3, 10, 0, tstamp));
+    index->batchUpdate({{61, std::make_shared<LogPos>(3, 10, recordSize, tstamp)}, {62, nullptr}});
+    EXPECT_EQ(fileStats(tracker, 1).liveBytes, 37 * recordSize);
+    EXPECT_EQ(fileStats(tracker, 1).deadBytes, 63 * recordSize);
+    EXPECT_EQ(fileStats(tracker, 2).liveBytes, 50 * recordSize);
+    EXPECT_EQ(fileStats(tracker, 2).deadBytes, 0);
+  }
+}
+
+}  // namespace bitcask
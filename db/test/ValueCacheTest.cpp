@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+
+#include "db/ValueCache.h"
+
+namespace bitcask {
+
+class ValueCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    FLAGS_value_cache_shards = 1;
+  }
+
+  void TearDown() override {
+    FLAGS_value_cache_shards = 16;
+  }
+
+  static std::shared_ptr<const std::string> value(size_t size) {
+    return std::make_shared<std::string>(size, 'v');
+  }
+};
+
+TEST_F(ValueCacheTest, LookupInsertTest) {
+  ValueCache cache(64 * 1024);
+  CacheKey key{1, 100};
+  EXPECT_EQ(cache.lookup(key), nullptr);
+  cache.insert(key, std::make_shared<std::string>("value"));
+  auto cached = cache.lookup(key);
+  ASSERT_NE(cached, nullptr);
+  EXPECT_EQ(*cached, "value");
+
+  // Same offset of another file is another record
+  EXPECT_EQ(cache.lookup({2, 100}), nullptr);
+  EXPECT_EQ(cache.hits(), 1);
+  EXPECT_EQ(cache.misses(), 2);
+
+  // Too large to be cached
+  cache.insert({1, 200}, value(64 * 1024));
+  EXPECT_EQ(cache.lookup({1, 200}), nullptr);
+}
+
+TEST_F(ValueCacheTest, EvictionTest) {
+  // room for about 10 values
+  ValueCache cache(10 * (1024 + 128));
+  for (FileOffset pos = 0; pos < 5; pos++) {
+    cache.insert({1, pos}, value(1024));
+  }
+  // hot values are protected
+  for (FileOffset pos = 0; pos < 5; pos++) {
+    ASSERT_NE(cache.lookup({1, pos}), nullptr);
+  }
+
+  // a scan of values read once doesn't evict them
+  for (FileOffset pos = 100; pos < 200; pos++) {
+    cache.insert({1, pos}, value(1024));
+    EXPECT_LE(cache.usage(), cache.capacity());
+  }
+  for (FileOffset pos = 0; pos < 5; pos++) {
+    EXPECT_NE(cache.lookup({1, pos}), nullptr);
+  }
+  EXPECT_EQ(cache.lookup({1, 100}), nullptr);
+  EXPECT_NE(cache.lookup({1, 199}), nullptr);
+
+  // values hit once are protected too, and the least recently used protected values are demoted
+  for (FileOffset pos = 100; pos < 200; pos++) {
+    cache.lookup({1, pos});
+  }
+  for (FileOffset pos = 200; pos < 300; pos++) {
+    cache.insert({1, pos}, value(1024));
+  }
+  EXPECT_EQ(cache.lookup({1, 0}), nullptr);
+  EXPECT_NE(cache.lookup({1, 199}), nullptr);
+  EXPECT_LE(cache.usage(), cache.capacity());
+}
+
+}  // namespace bitcask
@@ -9,7 +9,9 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <any>
+#include <array>
 #include <atomic>
 #include <cassert>
 #include <cerrno>
@@ -2,25 +2,29 @@
 #define BITCASK_DB_H_
 
 #include "bitcask/Base.h"
+#include "bitcask/Iterator.h"
 #include "bitcask/Options.h"
+#include "bitcask/PinnableValue.h"
+#include "bitcask/Stats.h"
 #include "bitcask/StatusOr.h"
 #include "bitcask/Types.h"
+#include "bitcask/WriteBatch.h"
 
 namespace bitcask {
 
 struct Options;
 // struct ReadOptions;
 // struct WriteOptions;
-// class WriteBatch;
+class WriteBatch;
 
-// A range of keys
-// struct Range {
-//   Range() = default;
-//   Range(const Slice& s, const Slice& l) : start(s), limit(l) {}
+// A range of keys. The default range covers all keys but the largest one.
+struct Range {
+  Range() = default;
+  Range(const KeyType& s, const KeyType& l) : start(s), limit(l) {}
 
-//   Slice start;  // Included in the range
-//   Slice limit;  // Not included in the range
-// };
+  KeyType start = std::numeric_limits<KeyType>::min();  // Included in the range
+  KeyType limit = std::numeric_limits<KeyType>::max();  // Not included in the range
+};
 
 // A DB is a persistent ordered map from keys to values.
 // A DB is safe for concurrent access from multiple threads without
@@ -34,12 +38,27 @@ class DB {
   // Retrieve a value by key from a Bitcask datastore
   virtual StatusOr<std::string> get(const KeyType& key) = 0;
 
+  // Same as above, but the value is pinned to the db memory it's in, e.g. a mapped data file, or
+  // read into the buffer of value, which is reused across gets. No copy of the value is made.
+  virtual Status get(const KeyType& key, PinnableValue* value) = 0;
+
+  // Same as above, but the value is read into value, reusing its capacity
+  virtual Status get(const KeyType& key, std::string* value) = 0;
+
+  // Retrieve the values of many keys at once. The reads of all values are issued together, in file
+  // order, with nearby records merged into one read. Results are in the order of keys.
+  virtual std::vector<StatusOr<std::string>> multiGet(const std::vector<KeyType>& keys) = 0;
+
   // Store a key and value in a Bitcask datastore.
   virtual Status put(const KeyType& key, const std::string& value) = 0;
 
   // Delete a key from a Bitcask datastore
   virtual Status deleteKey(const KeyType& key) = 0;
 
+  // Apply all updates in the batch atomically. The batch is appended to one data file with a single
+  // write, and is either fully replayed or fully dropped when reopening the db after a crash.
+  virtual Status write(const WriteBatch& batch) = 0;
+
   // List all keys in a Bitcask datastore
   virtual StatusOr<std::vector<KeyType>> listKeys() = 0;
 
@@ -47,12 +66,33 @@ class DB {
   // of values.
   virtual Status fold(std::function<void(const KeyType&, const std::string&)>&& func) = 0;
 
+  // Apply func to the keys in range and their values, in key order, until func returns false.
+  // Scans are efficient with IndexType::kOrdered. Other indexes take a sorted copy of all keys
+  // first.
+  virtual Status scan(const Range& range,
+                      std::function<bool(const KeyType&, const std::string&)>&& func) = 0;
+
+  // Return an iterator over the keys of the db in order, and their values. The iterator is
+  // unpositioned until one of its seek methods is called. Like scan, it's efficient with
+  // IndexType::kOrdered.
+  virtual std::unique_ptr<Iterator> newIterator() = 0;
+
   // merge the datafiles in the db
   virtual Status merge(const std::string& name) = 0;
 
   // Force any writes to sync to disk
   virtual Status sync() = 0;
 
+  // The position right after the last write. A write is durable once durablePosition() has reached
+  // the writtenPosition() read after the write returned.
+  virtual WritePosition writtenPosition() const = 0;
+
+  // The position up to which all writes are synced to disk
+  virtual WritePosition durablePosition() const = 0;
+
+  // Counters of the db since it was opened, and the space taken by its data files
+  virtual Stats stats() const = 0;
+
   // Close a Bitcask data store and flush all pending writes (if any) to disk.
   virtual Status close() = 0;
 
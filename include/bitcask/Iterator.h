@@ -0,0 +1,58 @@
+#ifndef BITCASK_ITERATOR_H_
+#define BITCASK_ITERATOR_H_
+
+#include "bitcask/Base.h"
+#include "bitcask/Status.h"
+#include "bitcask/Types.h"
+
+namespace bitcask {
+
+// An Iterator goes through the keys of a DB in order, forward or backward, along with their
+// values. It's created unpositioned: one of the seek methods must be called before anything else.
+// Keys and values are loaded a chunk at a time, so the iterator is not a snapshot of the DB: the
+// writes done during the iteration may or may not be seen.
+// An Iterator is not safe for concurrent access without external synchronization.
+class Iterator {
+ public:
+  Iterator() = default;
+
+  Iterator(const Iterator&) = delete;
+  Iterator& operator=(const Iterator&) = delete;
+
+  virtual ~Iterator() = default;
+
+  // Whether the iterator is positioned at a key. It's not once it's moved past the first or the
+  // last key, or if an error happened.
+  virtual bool valid() const = 0;
+
+  // Position at the first key, if any.
+  virtual void seekToFirst() = 0;
+
+  // Position at the last key, if any.
+  virtual void seekToLast() = 0;
+
+  // Position at the first key >= target, if any.
+  virtual void seek(const KeyType& target) = 0;
+
+  // Position at the last key <= target, if any.
+  virtual void seekForPrev(const KeyType& target) = 0;
+
+  // Move to the next key. Require valid().
+  virtual void next() = 0;
+
+  // Move to the previous key. Require valid().
+  virtual void prev() = 0;
+
+  // The key at the current position. Require valid().
+  virtual KeyType key() const = 0;
+
+  // The value at the current position, until the iterator is moved. Require valid().
+  virtual const std::string& value() const = 0;
+
+  // The error which made the iterator invalid, if any
+  virtual Status status() const = 0;
+};
+
+}  // namespace bitcask
+
+#endif  // BITCASK_ITERATOR_H_
@@ -5,6 +5,41 @@
 
 namespace bitcask {
 
+// How data files do their I/O
+enum class IOBackendType : uint8_t {
+  // Blocking pread/pwritev/fsync
+  kPosix = 0,
+  // io_uring, falling back to kPosix if the kernel does not support it
+  kIoUring = 1,
+};
+
+// When writes are synced to disk. Syncs use fdatasync.
+enum class SyncPolicy : uint8_t {
+  // Only synced by DB::sync and on close
+  kNone = 0,
+  // Every write is synced before it returns. Concurrent writes are group committed, so that one
+  // sync covers all of them.
+  kPerWrite = 1,
+  // Synced in the background every syncIntervalMs
+  kInterval = 2,
+  // Synced in the background once syncBytes have been written since the last sync
+  kBytes = 3,
+};
+
+// The in memory index of the keys
+enum class IndexType : uint8_t {
+  // A hash map from each key to a shared location of its record
+  kHash = 0,
+  // A compact open addressing table with the locations stored inline, taking several times less
+  // memory per key. Data files can't be larger than 1TB.
+  kFlat = 1,
+  // A hash map split in independently locked shards, so that a write only blocks the reads of its
+  // shard. For many concurrent readers and writers.
+  kSharded = 2,
+  // A B+-tree keeping the keys in order, for efficient range scans and iterators
+  kOrdered = 3,
+};
+
 // Options to control the behavior of a database (passed to DB::Open)
 struct Options {
   // Create an Options object with default values for all fields.
@@ -13,11 +48,73 @@ struct Options {
   // If true, the database is open in read only mode.
   bool readOnly = false;
 
-  // If this writer would prefer to sync the write file after every write operation
+  // If this writer would prefer to sync the write file after every write operation.
+  // Concurrent writers are group committed, so that one sync covers all of them.
+  // Same as syncPolicy = SyncPolicy::kPerWrite, which it overrides.
   bool syncOnPut = false;
 
+  // When writes are synced to disk. With kInterval and kBytes, at most the writes of the last
+  // interval or the last syncBytes are lost on a crash. DB::durablePosition tells which writes are
+  // synced.
+  SyncPolicy syncPolicy = SyncPolicy::kNone;
+
+  // Sync interval in milliseconds of SyncPolicy::kInterval
+  uint32_t syncIntervalMs = 1000;
+
+  // Number of bytes written between syncs of SyncPolicy::kBytes
+  size_t syncBytes = 4 * 1024 * 1024;
+
   // Max data file size in bytes.
   size_t maxFileSize = 64 * 1024 * 1024;
+
+  // Size in bytes of the in-process write buffer of the active data file. Appends are coalesced in
+  // it and written out in large writes, on a sync, a file roll, or close. Reads of records still in
+  // the buffer are served from it. 0 disables the buffer and every append is written right away.
+  size_t writeBufferSize = 0;
+
+  // Max time in milliseconds appends stay in the write buffer before being written out.
+  uint32_t writeBufferFlushIntervalMs = 100;
+
+  // I/O backend used for reading, writing and syncing data files.
+  IOBackendType ioBackend = IOBackendType::kPosix;
+
+  // If true, data files are opened with O_DIRECT and bypass the page cache. Appends are staged in
+  // an aligned buffer and written in whole blocks: right away if writeBufferSize is 0, otherwise
+  // when the buffer, resized to writeBufferSize, is full or flushed. Reads fetch the aligned blocks
+  // around a record. As nothing is cached by the kernel any more, this is meant to be paired with
+  // an application level cache.
+  bool useDirectIO = false;
+
+  // If true, data files which no longer change, i.e. the rolled out ones, and all files of a read
+  // only database, are mapped into memory read only, and records are decoded right from the mapping
+  // instead of being read with a syscall. Ignored with useDirectIO.
+  bool mmapReads = false;
+
+  // Capacity in bytes of the in-process cache of values. Values are cached by the location of their
+  // log record on their first get, and the values hit again are protected from eviction by values
+  // read only once, e.g. by a scan. 0 disables the cache.
+  size_t valueCacheSize = 0;
+
+  // The in memory index of the keys, rebuilt from the data files on open.
+  IndexType indexType = IndexType::kHash;
+
+  // Old data files are merged automatically in the background once at least this fraction of their
+  // bytes is dead, i.e. overwritten or deleted records, see Stats::dataFiles. 0 disables automatic
+  // merges, DB::merge merges all old data files either way.
+  double mergeMinDeadRatio = 0;
+
+  // Data files written in the last mergeMinFileAgeSec seconds are not merged automatically, as
+  // their records are likely to be overwritten soon.
+  uint32_t mergeMinFileAgeSec = 300;
+
+  // Bytes per second of background I/O of the data files, i.e. the reads and writes of merges and
+  // of hint files. Gets and writes are never throttled, but their I/O is counted against the same
+  // budget, so background I/O backs off while they are busy. 0 disables the limit.
+  size_t backgroundIORate = 0;
+
+  // If true, the limit of background I/O is lowered, down to a twentieth of backgroundIORate, while
+  // the latency of reads of values rises, and raised back once it settles.
+  bool autoTuneBackgroundIO = false;
 };
 
 }  // namespace bitcask
@@ -0,0 +1,85 @@
+#ifndef BITCASK_PINNABLEVALUE_H_
+#define BITCASK_PINNABLEVALUE_H_
+
+#include <string_view>
+
+#include "bitcask/Base.h"
+
+namespace bitcask {
+
+// PinnableValue holds the value read by a get without copying it when possible. The value is either
+// pinned, i.e. a view of memory owned by the db such as a mapped data file, which is kept alive
+// until the PinnableValue is reset, reused or destroyed, or it's read into a buffer owned by the
+// PinnableValue. The buffer keeps its capacity across gets, so reusing a PinnableValue avoids
+// allocating for every get. A PinnableValue is not safe for concurrent access without external
+// synchronization.
+class PinnableValue {
+ public:
+  PinnableValue() = default;
+
+  PinnableValue(const PinnableValue&) = delete;
+  PinnableValue& operator=(const PinnableValue&) = delete;
+
+  PinnableValue(PinnableValue&&) = default;
+  PinnableValue& operator=(PinnableValue&&) = default;
+
+  const char* data() const {
+    return pin_ ? pinnedData_ : buffer_.data() + bufferOffset_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  std::string_view view() const {
+    return std::string_view(data(), size_);
+  }
+
+  std::string toString() const {
+    return std::string(data(), size_);
+  }
+
+  // Whether the value is a view of memory owned by the db
+  bool isPinned() const {
+    return pin_ != nullptr;
+  }
+
+  // Release the pinned memory, if any, and empty the value. The buffer keeps its capacity.
+  void reset() {
+    pin_.reset();
+    pinnedData_ = nullptr;
+    bufferOffset_ = 0;
+    size_ = 0;
+  }
+
+  // The value is the size bytes at data, which stay valid as long as pin is held
+  void pin(const char* data, size_t size, std::shared_ptr<const void> pin) {
+    pin_ = std::move(pin);
+    pinnedData_ = data;
+    size_ = size;
+  }
+
+  // The buffer to read the value into. Call setFromBuffer once it's filled.
+  std::string* buffer() {
+    reset();
+    return &buffer_;
+  }
+
+  // The value is the size bytes at offset of the buffer
+  void setFromBuffer(size_t offset, size_t size) {
+    bufferOffset_ = offset;
+    size_ = size;
+  }
+
+ private:
+  std::shared_ptr<const void> pin_;
+  const char* pinnedData_{nullptr};
+  // An offset rather than a pointer, so that moving the buffer doesn't invalidate the value
+  std::string buffer_;
+  size_t bufferOffset_{0};
+  size_t size_{0};
+};
+
+}  // namespace bitcask
+
+#endif  // BITCASK_PINNABLEVALUE_H_
@@ -0,0 +1,43 @@
+#ifndef BITCASK_STATS_H_
+#define BITCASK_STATS_H_
+
+#include "bitcask/Base.h"
+#include "bitcask/Types.h"
+
+namespace bitcask {
+
+// Space taken by the records of a data file. A byte is live while the index points to its record,
+// and dead once the record is overwritten or deleted. Tombstones are dead too.
+struct DataFileStats {
+  FileID fileId = 0;
+  uint64_t totalBytes = 0;
+  uint64_t liveBytes = 0;
+  uint64_t deadBytes = 0;
+};
+
+// Counters of a DB since it was opened, and the space of its data files (returned by DB::stats)
+struct Stats {
+  // Gets served from the value cache, and gets which had to read the data files. Both are 0 if the
+  // value cache is disabled.
+  uint64_t cacheHits = 0;
+  uint64_t cacheMisses = 0;
+
+  // Bytes charged for the values in the value cache, and its capacity
+  size_t cacheUsage = 0;
+  size_t cacheCapacity = 0;
+
+  // The data files, in id order
+  std::vector<DataFileStats> dataFiles;
+
+  // Merges done, asked for by DB::merge or started automatically
+  uint64_t merges = 0;
+
+  // Microseconds background I/O waited for the rate limiter, and the rate it's limited to at the
+  // moment, in bytes per second. Both are 0 without Options::backgroundIORate.
+  uint64_t ioThrottledMicros = 0;
+  uint64_t backgroundIORate = 0;
+};
+
+}  // namespace bitcask
+
+#endif  // BITCASK_STATS_H_
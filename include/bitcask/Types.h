@@ -7,6 +7,25 @@ using KeyType = int32_t;
 using FileID = uint32_t;
 using FileOffset = int64_t;
 
+// A position in the data files. Data files are written in file id order, so positions are ordered
+// by file id first, then by offset.
+struct WritePosition {
+  FileID fileId_{0};
+  FileOffset offset_{0};
+};
+
+inline bool operator==(const WritePosition& lhs, const WritePosition& rhs) {
+  return lhs.fileId_ == rhs.fileId_ && lhs.offset_ == rhs.offset_;
+}
+
+inline bool operator<(const WritePosition& lhs, const WritePosition& rhs) {
+  return lhs.fileId_ < rhs.fileId_ || (lhs.fileId_ == rhs.fileId_ && lhs.offset_ < rhs.offset_);
+}
+
+inline bool operator<=(const WritePosition& lhs, const WritePosition& rhs) {
+  return !(rhs < lhs);
+}
+
 }  // namespace bitcask
 
 #endif  // BITCASK_TYPES_H_
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef BITCASK_WRITEBATCH_H_
+#define BITCASK_WRITEBATCH_H_
+
+#include "bitcask/Base.h"
+#include "bitcask/Types.h"
+
+namespace bitcask {
+
+// WriteBatch holds a collection of puts and deletes to apply to a DB atomically: after a crash,
+// either all of them or none of them are visible. Updates are applied in the order they were added.
+// A WriteBatch is not safe for concurrent access without external synchronization.
+class WriteBatch {
+ public:
+  WriteBatch() = default;
+
+  // Store the mapping key->value in the DB.
+  void put(const KeyType& key, const std::string& value);
+
+  // Erase the mapping for key from the DB, if any.
+  void deleteKey(const KeyType& key);
+
+  // Clear all updates buffered in this batch.
+  void clear();
+
+  // Number of updates in the batch.
+  size_t count() const;
+
+ private:
+  friend class DBImpl;
+
+  enum class OpType : uint8_t {
+    kPut = 0,
+    kDelete = 1,
+  };
+
+  struct Op {
+    OpType type_;
+    KeyType key_;
+    std::string value_;
+  };
+
+  std::vector<Op> ops_;
+};
+
+}  // namespace bitcask
+
+#endif  // BITCASK_WRITEBATCH_H_
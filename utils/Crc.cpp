@@ -1,10 +1,18 @@
 #include "utils/Crc.h"
 
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
 namespace bitcask {
 namespace crc {
 
 uint32_t crc32(const char* data, size_t length) {
-  uint32_t crc = 0xFFFFFFFF;               // Initial CRC value
+  return extend(0, data, length);
+}
+
+uint32_t extend(uint32_t crcValue, const char* data, size_t length) {
+  uint32_t crc = ~crcValue;                // Initial CRC value is 0xFFFFFFFF for an empty A
   const uint32_t polynomial = 0xEDB88320;  // Polynomial used in CRC-32
 
   for (size_t i = 0; i < length; ++i) {
@@ -21,5 +29,116 @@ uint32_t crc32(const char* data, size_t length) {
   return ~crc;  // Final XOR value
 }
 
+namespace {
+
+// Slicing-by-8 tables of the reflected Castagnoli polynomial. tables[0] is the classic byte at a
+// time table, tables[k][b] is the crc of byte b followed by k zero bytes, so that 8 bytes are
+// folded in with 8 independent lookups.
+struct Crc32cTables {
+  uint32_t tables_[8][256];
+
+  Crc32cTables() {
+    const uint32_t polynomial = 0x82F63B78;
+    for (uint32_t b = 0; b < 256; b++) {
+      uint32_t crc = b;
+      for (int j = 0; j < 8; j++) {
+        crc = (crc & 1) ? (crc >> 1) ^ polynomial : crc >> 1;
+      }
+      tables_[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; b++) {
+      for (int k = 1; k < 8; k++) {
+        tables_[k][b] = (tables_[k - 1][b] >> 8) ^ tables_[0][tables_[k - 1][b] & 0xFF];
+      }
+    }
+  }
+};
+
+const Crc32cTables& crc32cTables() {
+  static const Crc32cTables tables;
+  return tables;
+}
+
+using ExtendFunc = uint32_t (*)(uint32_t, const char*, size_t);
+
+ExtendFunc pickExtend32c() {
+  return hasHardwareCrc32c() ? extend32cHardware : extend32cSlicing8;
+}
+
+}  // namespace
+
+uint32_t crc32c(const char* data, size_t length) {
+  return extend32c(0, data, length);
+}
+
+uint32_t extend32c(uint32_t crc, const char* data, size_t length) {
+  static const ExtendFunc extendFunc = pickExtend32c();
+  return extendFunc(crc, data, length);
+}
+
+bool hasHardwareCrc32c() {
+#if defined(__x86_64__)
+  return __builtin_cpu_supports("sse4.2");
+#else
+  return false;
+#endif
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) uint32_t extend32cHardware(uint32_t crcValue,
+                                                              const char* data,
+                                                              size_t length) {
+  uint64_t crc = ~crcValue;
+  // Byte by byte up to an 8 byte boundary, then 8 bytes at a time
+  while (length > 0 && (reinterpret_cast<uintptr_t>(data) & 7) != 0) {
+    crc = _mm_crc32_u8(static_cast<uint32_t>(crc), static_cast<uint8_t>(*data));
+    data++;
+    length--;
+  }
+  while (length >= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    crc = _mm_crc32_u64(crc, word);
+    data += 8;
+    length -= 8;
+  }
+  while (length > 0) {
+    crc = _mm_crc32_u8(static_cast<uint32_t>(crc), static_cast<uint8_t>(*data));
+    data++;
+    length--;
+  }
+  return ~static_cast<uint32_t>(crc);
+}
+#else
+uint32_t extend32cHardware(uint32_t crc, const char* data, size_t length) {
+  return extend32cSlicing8(crc, data, length);
+}
+#endif
+
+uint32_t extend32cSlicing8(uint32_t crcValue, const char* data, size_t length) {
+  const auto& t = crc32cTables().tables_;
+  uint32_t crc = ~crcValue;
+  const auto* p = reinterpret_cast<const uint8_t*>(data);
+  while (length >= 8) {
+    // little endian: the low 4 bytes are folded into the crc
+    uint32_t low;
+    uint32_t high;
+    std::memcpy(&low, p, sizeof(low));
+    std::memcpy(&high, p + 4, sizeof(high));
+    low ^= crc;
+    crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+          t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^
+          t[0][high >> 24];
+    p += 8;
+    length -= 8;
+  }
+  while (length > 0) {
+    crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFF];
+    p++;
+    length--;
+  }
+  return ~crc;
+}
+
 }  // namespace crc
-}  // namespace bitcask
\ No newline at end of file
+}  // namespace bitcask
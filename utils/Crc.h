@@ -8,7 +8,25 @@ namespace crc {
 
 uint32_t crc32(const char* data, size_t length);
 
+// Return the crc32 of concat(A, data) where crc is the crc32 of some string A. It allows to
+// checksum data scattered in several buffers without copying them together:
+// crc32(A + B) == extend(crc32(A), B)
+uint32_t extend(uint32_t crc, const char* data, size_t length);
+
+// CRC32C (Castagnoli polynomial). It's computed with the SSE4.2 crc32 instruction if the CPU has
+// it, and with slicing-by-8 tables otherwise, as picked at runtime.
+uint32_t crc32c(const char* data, size_t length);
+
+// Same as extend, for crc32c
+uint32_t extend32c(uint32_t crc, const char* data, size_t length);
+
+// The implementations extend32c picks from. extend32cHardware must only be called if
+// hasHardwareCrc32c().
+bool hasHardwareCrc32c();
+uint32_t extend32cHardware(uint32_t crc, const char* data, size_t length);
+uint32_t extend32cSlicing8(uint32_t crc, const char* data, size_t length);
+
 }  // namespace crc
 }  // namespace bitcask
 
-#endif  // UTILS_CRC_H_
\ No newline at end of file
+#endif  // UTILS_CRC_H_
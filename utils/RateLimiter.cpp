@@ -0,0 +1,105 @@
+#include "utils/RateLimiter.h"
+
+#include "utils/WallClock.h"
+
+namespace bitcask {
+
+namespace {
+
+// Background I/O checks the bucket at least this often while it waits
+constexpr int64_t kMaxWaitUs = 10 * 1000;
+
+}  // namespace
+
+RateLimiter::RateLimiter(int64_t bytesPerSec, bool autoTune)
+    : maxBytesPerSec_(std::max<int64_t>(bytesPerSec, 1)),
+      autoTune_(autoTune),
+      bytesPerSec_(maxBytesPerSec_),
+      available_(burstBytes()),
+      lastRefillUs_(time::WallClock::fastNowInMicroSec()),
+      lastTuneUs_(lastRefillUs_) {}
+
+void RateLimiter::request(size_t bytes, IOPriority priority) {
+  if (priority == IOPriority::kHigh) {
+    available_ -= static_cast<int64_t>(bytes);
+    return;
+  }
+  // Taken in pieces of at most a burst, so that the debt of background I/O stays under the cap
+  // and none of it is written off
+  auto left = static_cast<int64_t>(bytes);
+  int64_t start = 0;
+  while (left > 0) {
+    int64_t waitUs = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto now = time::WallClock::fastNowInMicroSec();
+      refillLocked(now);
+      auto available = available_.load();
+      if (available > 0) {
+        auto piece = std::min(left, std::max<int64_t>(burstBytes(), 1));
+        available_ -= piece;
+        left -= piece;
+        continue;
+      }
+      if (start == 0) {
+        start = now;
+      }
+      waitUs = (1 - available) * kMicrosPerSec / bytesPerSec_ + 1;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(std::min(waitUs, kMaxWaitUs)));
+  }
+  if (start > 0) {
+    throttledMicros_ += time::WallClock::fastNowInMicroSec() - start;
+  }
+}
+
+void RateLimiter::recordForeground(size_t bytes, int64_t latencyUs) {
+  available_ -= static_cast<int64_t>(bytes);
+  if (autoTune_) {
+    latencySumUs_.fetch_add(latencyUs, std::memory_order_relaxed);
+    latencyCount_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void RateLimiter::refillLocked(int64_t nowUs) {
+  if (autoTune_ && nowUs - lastTuneUs_ >= kMicrosPerSec) {
+    tuneLocked(nowUs);
+  }
+  auto elapsed = nowUs - lastRefillUs_;
+  if (elapsed <= 0) {
+    return;
+  }
+  lastRefillUs_ = nowUs;
+  int64_t rate = bytesPerSec_;
+  auto refill = elapsed * rate / kMicrosPerSec;
+  auto maxTokens = burstBytes();
+  // Foreground I/O takes tokens concurrently without the lock
+  auto available = available_.load();
+  while (!available_.compare_exchange_weak(available,
+                                           std::clamp(available + refill, -rate, maxTokens))) {
+  }
+}
+
+void RateLimiter::tuneLocked(int64_t nowUs) {
+  lastTuneUs_ = nowUs;
+  auto count = latencyCount_.exchange(0);
+  auto sum = latencySumUs_.exchange(0);
+  int64_t rate = bytesPerSec_;
+  auto minRate = std::max<int64_t>(maxBytesPerSec_ / 20, 1);
+  if (count > 0) {
+    auto latencyUs = static_cast<double>(sum) / static_cast<double>(count);
+    if (baselineUs_ == 0 || latencyUs < baselineUs_) {
+      baselineUs_ = latencyUs;
+    } else {
+      // Follow a lasting change of the usual latency, slowly
+      baselineUs_ += (latencyUs - baselineUs_) / 64;
+    }
+    if (latencyUs > 2 * baselineUs_) {
+      bytesPerSec_ = std::max(rate / 2, minRate);
+      return;
+    }
+  }
+  bytesPerSec_ = std::min(rate + maxBytesPerSec_ / 20, maxBytesPerSec_);
+}
+
+}  // namespace bitcask
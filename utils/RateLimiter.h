@@ -0,0 +1,86 @@
+#ifndef UTILS_RATELIMITER_H_
+#define UTILS_RATELIMITER_H_
+
+#include "bitcask/Base.h"
+
+namespace bitcask {
+
+// Who an I/O is done for
+enum class IOPriority : uint8_t {
+  // Background work: merges, hint files
+  kLow = 0,
+  // Gets and writes, which are never throttled
+  kHigh = 1,
+};
+
+// RateLimiter is a token bucket shared by the I/O of all data files, which limits the bytes per
+// second of background I/O. Tokens are added continuously at the rate, and the bucket holds at most
+// a tenth of a second worth of them.
+//
+// Background I/O takes its bytes a burst at a time, each once the bucket is out of debt, which may
+// put the bucket in debt again. Foreground I/O never waits, but takes its bytes too, so that
+// background I/O backs off while foreground I/O is busy. The debt is capped at a second worth of
+// tokens, which only foreground I/O can run into.
+//
+// With auto tune, the rate is halved, down to a twentieth of the rate configured, when the latency
+// of foreground I/O over the last second is more than twice its usual level, and raised back step
+// by step otherwise.
+class RateLimiter {
+ public:
+  RateLimiter(int64_t bytesPerSec, bool autoTune);
+
+  RateLimiter(const RateLimiter&) = delete;
+  RateLimiter& operator=(const RateLimiter&) = delete;
+
+  // Take bytes of tokens for an I/O about to be done, waiting for them if it's background I/O
+  void request(size_t bytes, IOPriority priority);
+
+  // Take bytes of tokens for a foreground I/O which took latencyUs, watched by auto tune
+  void recordForeground(size_t bytes, int64_t latencyUs);
+
+  // The current rate, lower than the configured one while auto tune backs off
+  int64_t bytesPerSecond() const {
+    return bytesPerSec_;
+  }
+
+  // Total time background I/O has waited for tokens
+  uint64_t throttledMicros() const {
+    return throttledMicros_;
+  }
+
+ private:
+  // Add the tokens accrued since the last refill, and tune the rate every second. Require holding
+  // mutex_.
+  void refillLocked(int64_t nowUs);
+  void tuneLocked(int64_t nowUs);
+
+  // Tokens the bucket holds at most at the current rate
+  int64_t burstBytes() const {
+    return bytesPerSec_ * kBurstUs / kMicrosPerSec;
+  }
+
+  static constexpr int64_t kMicrosPerSec = 1000 * 1000;
+  // The bucket holds this much time worth of tokens
+  static constexpr int64_t kBurstUs = kMicrosPerSec / 10;
+
+  const int64_t maxBytesPerSec_;
+  const bool autoTune_;
+  std::atomic<int64_t> bytesPerSec_;
+
+  // Tokens in the bucket, negative when it's in debt. Taken without the lock, refilled with it.
+  std::atomic<int64_t> available_;
+  std::mutex mutex_;
+  int64_t lastRefillUs_;
+
+  std::atomic<uint64_t> throttledMicros_{0};
+
+  // Latency of foreground I/O since the last tuning, and its usual level. Tuned with mutex_ held.
+  std::atomic<int64_t> latencySumUs_{0};
+  std::atomic<int64_t> latencyCount_{0};
+  int64_t lastTuneUs_;
+  double baselineUs_{0};
+};
+
+}  // namespace bitcask
+
+#endif  // UTILS_RATELIMITER_H_